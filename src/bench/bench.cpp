@@ -0,0 +1,45 @@
+// bench/bench.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "bench.h"
+
+#include <common/scenes.h>
+
+namespace rtiow {
+namespace bench {
+
+bool construct_bench_scene(const argh::parser &cmd_line, uint32_t width, uint32_t height, Scene &scene, int &scene_id) {
+
+	scene_id = option<int>(cmd_line, "--scene", 3);
+	auto scene_size = option<int>(cmd_line, "--scene-size", 11);
+
+	if (width < 2 || height < 2) {
+		fprintf(stderr, "Invalid resolution\n");
+		return false;
+	}
+
+	if (!construct_scene(scene, scene_id, float(width) / float(height), scene_size)) {
+		fprintf(stderr, "Unknown scene %d\n", scene_id);
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<Ray> camera_rays(const Scene &scene, uint32_t width, uint32_t height) {
+	std::vector<Ray> rays;
+	rays.reserve(size_t(width) * height);
+
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			RandomGenerator rng(random_seed(size_t(y) * width + x));
+			auto u = (static_cast<float>(x) + random_float(rng)) / static_cast<float>(width - 1);
+			auto v = (static_cast<float>(y) + random_float(rng)) / static_cast<float>(height - 1);
+			rays.push_back(scene.camera().create_ray(u, v, rng));
+		}
+	}
+
+	return rays;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
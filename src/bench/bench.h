@@ -0,0 +1,140 @@
+// bench/bench.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// minimal infrastructure for the micro-benchmarks
+
+#pragma once
+
+#include <argh/argh.h>
+#include <raytrace/bvh.h>
+#include <raytrace/scene.h>
+#include <raytrace/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+using bench_func_t = int (*)(const argh::parser &cmd_line);
+
+struct Benchmark {
+	const char *	m_name;
+	const char *	m_description;
+	bench_func_t	m_func;
+};
+
+// benchmarks (return EXIT_SUCCESS or EXIT_FAILURE)
+int bench_bvh_build(const argh::parser &cmd_line);
+int bench_framebuffer(const argh::parser &cmd_line);
+int bench_occlusion(const argh::parser &cmd_line);
+int bench_packets(const argh::parser &cmd_line);
+int bench_sampler(const argh::parser &cmd_line);
+int bench_spheres(const argh::parser &cmd_line);
+int bench_triangles(const argh::parser &cmd_line);
+int bench_wide_bvh(const argh::parser &cmd_line);
+
+// run the function once and return the elapsed wall clock time in milliseconds
+template <typename Func>
+double time_ms(Func &&func) {
+	auto start = std::chrono::steady_clock::now();
+	func();
+	auto finish = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+// read an option from the command line
+template <typename T>
+T option(const argh::parser &cmd_line, const char *name, T default_value) {
+	T result = default_value;
+	cmd_line(name, default_value) >> result;
+	return result;
+}
+
+// construct the built-in scene selected with --scene and --scene-size (default: scene 3) for a width x height image
+//	reports an invalid resolution or an unknown scene and returns false
+bool construct_bench_scene(const argh::parser &cmd_line, uint32_t width, uint32_t height, Scene &scene, int &scene_id);
+
+// one jittered camera ray per pixel, row by row
+std::vector<Ray> camera_rays(const Scene &scene, uint32_t width, uint32_t height);
+
+// compare a scalar and a SIMD intersection kernel for ranges of primitives (BVH leaf sized and long brute-force ranges)
+//	The kernels have the signature: bool (uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit).
+//	The primitives should be in the cube [-1, 1], the rays are shot from outside the cube towards random points inside it.
+//	Returns false when the kernels don't find the same hits.
+template <typename ScalarKernel, typename SimdKernel>
+bool compare_range_kernels(const char *primitive_name, uint32_t num_primitives, uint32_t num_rays, RandomGenerator &rng,
+						   ScalarKernel &&scalar_kernel, SimdKernel &&simd_kernel) {
+
+	struct KernelResult {
+		double		m_ms = 0.0;
+		uint64_t	m_hits = 0;
+		std::vector<float> m_t;
+	};
+
+	std::vector<Ray> rays;
+	rays.reserve(num_rays);
+
+	for (uint32_t i = 0; i < num_rays; ++i) {
+		auto origin = 4.0f * random_unit_vector(rng);
+		auto target = random_vector(rng, -1.0f, 1.0f);
+		rays.emplace_back(origin, glm::normalize(target - origin));
+	}
+
+	auto run_kernel = [&rays, num_primitives](uint32_t range_size, auto &&kernel) {
+		KernelResult result;
+		result.m_t.resize(rays.size());
+
+		result.m_ms = time_ms([&]() {
+			uint32_t first = 0;
+
+			for (size_t r = 0; r < rays.size(); ++r) {
+				HitRecord hit;
+				if (kernel(first, range_size, rays[r], 0.001f, hit)) {
+					++result.m_hits;
+				}
+				result.m_t[r] = hit.m_at_t;
+
+				first += range_size;
+				if (first + range_size > num_primitives) {
+					first = 0;
+				}
+			}
+		});
+
+		return result;
+	};
+
+	bool ok = true;
+
+	for (uint32_t range_size : {BVH::MAX_LEAF_SIZE, std::min(num_primitives, 256u)}) {
+		auto scalar = run_kernel(range_size, scalar_kernel);
+		auto simd = run_kernel(range_size, simd_kernel);
+
+		uint64_t mismatches = 0;
+		for (size_t r = 0; r < rays.size(); ++r) {
+			if (glm::abs(scalar.m_t[r] - simd.m_t[r]) > 1e-4f * glm::max(1.0f, scalar.m_t[r])) {
+				++mismatches;
+			}
+		}
+
+		auto tests = double(num_rays) * double(range_size);
+
+		printf("\nrange of %u %s (%u rays, %" PRIu64 " hits)\n", range_size, primitive_name, num_rays, scalar.m_hits);
+		printf("  scalar: %9.2fms  %8.2f M tests/s\n", scalar.m_ms, tests / (1000.0 * scalar.m_ms));
+		printf("  simd:   %9.2fms  %8.2f M tests/s  (speedup %.2fx)\n", simd.m_ms, tests / (1000.0 * simd.m_ms),
+				scalar.m_ms / simd.m_ms);
+
+		if (mismatches > 0) {
+			printf("  ERROR: %" PRIu64 " rays have different results\n", mismatches);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,128 @@
+// bench/bench_bvh_build.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// BVH construction: the binned SAH and linear (Morton code) builders on a single thread versus on the thread pool, for
+//	fields of 1M to 50M random spheres. The SAH cost of the trees indicates how expensive they are to trace.
+//	The build needs about 150 bytes per sphere (bounds, primitive references, node arena), 50M spheres need ~7 GiB.
+
+#include "bench.h"
+
+#include <raytrace/bvh.h>
+#include <raytrace/thread_pool.h>
+#include <raytrace/utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+namespace {
+
+// spheres spread uniformly over a cube, the size of the cube grows with the number of spheres to keep the density constant
+std::vector<AABB> sphere_field(uint32_t count) {
+	RandomGenerator rng(42);
+	const auto half_size = std::cbrt(static_cast<float>(count));
+
+	std::vector<AABB> result;
+	result.reserve(count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		auto center = random_vector(rng, -half_size, half_size);
+		auto extent = vector_t(random_float(rng, 0.1f, 0.4f));
+		result.emplace_back(center - extent, center + extent);
+	}
+
+	return result;
+}
+
+struct BuildResult {
+	double					m_ms = 0.0;
+	float					m_sah_cost = 0.0f;
+	size_t					m_node_count = 0;
+	std::vector<uint32_t>	m_order;
+};
+
+BuildResult build(const std::vector<AABB> &bounds, BVHBuilder builder, ThreadPool *pool) {
+	BuildResult result;
+	BVH bvh;
+
+	result.m_ms = time_ms([&]() {
+		bvh.build(bounds, result.m_order, builder, pool);
+	});
+	result.m_sah_cost = bvh.sah_cost();
+	result.m_node_count = bvh.node_count();
+
+	return result;
+}
+
+} // unnamed namespace
+
+int bench_bvh_build(const argh::parser &cmd_line) {
+
+	auto min_spheres = option<uint32_t>(cmd_line, "--min-spheres", 1000000);
+	auto max_spheres = option<uint32_t>(cmd_line, "--max-spheres", 10000000);
+	auto threads = option<uint32_t>(cmd_line, "--threads", uint32_t(std::max(ThreadPool::hardware_concurrency(), 1)));
+	auto compare_sweep = cmd_line["--sweep"];
+
+	// only these sizes are benchmarked, --min-spheres and --max-spheres select a range of them
+	const uint32_t sizes[] = {1000000u, 2000000u, 5000000u, 10000000u, 20000000u, 50000000u};
+	auto in_range = [&](uint32_t count) {return count >= min_spheres && count <= max_spheres;};
+
+	if (threads == 0 || std::none_of(std::begin(sizes), std::end(sizes), in_range)) {
+		fprintf(stderr, "Invalid options (benchmarked sizes: 1M, 2M, 5M, 10M, 20M and 50M spheres)\n");
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool pool(threads);
+	bool ok = true;
+
+	printf("\nbinned SAH and linear builders: 1 thread vs %u threads\n", threads);
+	printf("  %10s  %12s  %12s  %8s  %10s  %10s", "spheres", "1 thread", "N threads", "speedup", "nodes", "SAH cost");
+	printf("  %12s  %12s  %10s  %10s", "lbvh 1", "lbvh N", "lbvh nodes", "lbvh SAH");
+	if (compare_sweep) {
+		printf("  %12s  %10s", "sweep", "sweep SAH");
+	}
+	printf("\n");
+
+	for (uint32_t count : sizes) {
+		if (!in_range(count)) {
+			continue;
+		}
+
+		auto bounds = sphere_field(count);
+		auto single = build(bounds, BVHBuilder::BINNED, nullptr);
+		auto parallel = build(bounds, BVHBuilder::BINNED, &pool);
+
+		printf("  %10u  %10.0fms  %10.0fms  %7.2fx  %10zu  %10.2f", count, single.m_ms, parallel.m_ms,
+				single.m_ms / std::max(parallel.m_ms, 0.001), parallel.m_node_count, double(parallel.m_sah_cost));
+
+		auto linear_single = build(bounds, BVHBuilder::LBVH, nullptr);
+		auto linear_parallel = build(bounds, BVHBuilder::LBVH, &pool);
+		printf("  %10.0fms  %10.0fms  %10zu  %10.2f", linear_single.m_ms, linear_parallel.m_ms, linear_parallel.m_node_count,
+				double(linear_parallel.m_sah_cost));
+
+		if (compare_sweep) {
+			auto sweep = build(bounds, BVHBuilder::SWEEP, nullptr);
+			printf("  %10.0fms  %10.2f", sweep.m_ms, double(sweep.m_sah_cost));
+		}
+		printf("\n");
+
+		// the tree shouldn't depend on the number of threads
+		auto same_tree = [](const BuildResult &a, const BuildResult &b) {
+			return a.m_order == b.m_order && a.m_node_count == b.m_node_count && a.m_sah_cost == b.m_sah_cost;
+		};
+
+		if (!same_tree(single, parallel) || !same_tree(linear_single, linear_parallel)) {
+			printf("  MISMATCH: the single and multi-threaded builds differ\n");
+			ok = false;
+		}
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
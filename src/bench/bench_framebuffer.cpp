@@ -0,0 +1,167 @@
+// bench/bench_framebuffer.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// compare render tasks writing their pixels straight into the shared frame buffers with tasks rendering into a private
+// tile buffer that is published when the tile is done
+//	The per sample work is kept trivial so the cost of the memory traffic (and false sharing) dominates. A separate
+//	thread copies the RGB buffer continuously, like the display thread of the interactive front-end.
+
+#include "bench.h"
+
+#include <raytrace/hdr_buffer.h>
+#include <raytrace/random.h>
+#include <raytrace/rgb_buffer.h>
+#include <raytrace/thread_pool.h>
+#include <raytrace/tile_buffer.h>
+#include <raytrace/utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+namespace {
+
+struct FrameBuffers {
+	FrameBuffers(uint32_t width, uint32_t height) : m_hdr(width, height), m_rgb(width, height) {}
+
+	HDRBuffer	m_hdr;
+	RGBBuffer	m_rgb;
+};
+
+inline color_t sample_color(size_t pixel_index, uint32_t sample) {
+	RandomGenerator rng(random_seed(pixel_index, sample));
+	return {rng.next_float(), rng.next_float(), rng.next_float()};
+}
+
+// add a number of samples to a pixel: the same for both strategies, only the memory the pixel lives in differs
+inline void add_samples(color_t &accum, uint32_t &count, float &luminance_sq, uint8_t *rgb, size_t pixel_index, uint32_t samples) {
+	for (uint32_t s = 0; s < samples; ++s) {
+		auto c = sample_color(pixel_index, count + s);
+		auto l = luminance(c);
+		accum += c;
+		luminance_sq += l * l;
+	}
+
+	count += samples;
+	write_color(&rgb, accum, count);
+}
+
+void render_shared(FrameBuffers &fb, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+	auto &hdr = fb.m_hdr;
+
+	for (uint32_t y = y0; y < y1; ++y) {
+		for (uint32_t x = x0; x < x1; ++x) {
+			auto idx = size_t(y) * hdr.width() + x;
+			add_samples(hdr.data()[idx], hdr.sample_count()[idx], hdr.luminance_sq()[idx], fb.m_rgb.data() + 3 * idx, idx, samples);
+		}
+	}
+}
+
+void render_tile_buffer(FrameBuffers &fb, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t samples) {
+	static thread_local TileBuffer tile;
+	tile.load(fb.m_hdr, fb.m_rgb, x0, y0, x1, y1);
+
+	for (uint32_t y = y0; y < y1; ++y) {
+		for (uint32_t x = x0; x < x1; ++x) {
+			auto idx = size_t(y) * fb.m_hdr.width() + x;
+			auto t = size_t(y - y0) * tile.width() + (x - x0);
+			add_samples(tile.data()[t], tile.sample_count()[t], tile.luminance_sq()[t], tile.rgb() + 3 * t, idx, samples);
+		}
+	}
+
+	tile.publish(fb.m_hdr, fb.m_rgb);
+}
+
+template <typename RenderFunc>
+double run(FrameBuffers &fb, size_t num_threads, uint32_t tile_size, uint32_t passes, uint32_t samples, RenderFunc render) {
+	const auto width = fb.m_hdr.width();
+	const auto height = fb.m_hdr.height();
+	fb.m_hdr.clear();
+
+	ThreadPool pool(num_threads);
+
+	// simulated display thread
+	std::atomic<bool> done = false;
+	std::thread display([&]() {
+		std::vector<uint8_t> copy(size_t(width) * height * 3);
+		while (!done) {
+			memcpy(copy.data(), fb.m_rgb.data(), copy.size());
+		}
+	});
+
+	auto ms = time_ms([&]() {
+		for (uint32_t pass = 0; pass < passes; ++pass) {
+			TaskGroup tasks;
+
+			for (uint32_t y0 = 0; y0 < height; y0 += tile_size) {
+				for (uint32_t x0 = 0; x0 < width; x0 += tile_size) {
+					auto x1 = std::min(x0 + tile_size, width);
+					auto y1 = std::min(y0 + tile_size, height);
+					pool.add_task(tasks, [&fb, render, x0, y0, x1, y1, samples]() {render(fb, x0, y0, x1, y1, samples);});
+				}
+			}
+
+			pool.wait(tasks);
+		}
+	});
+
+	done = true;
+	display.join();
+
+	return ms;
+}
+
+} // unnamed namespace
+
+int bench_framebuffer(const argh::parser &cmd_line) {
+
+	auto width = option<uint32_t>(cmd_line, "--width", 1920);
+	auto height = option<uint32_t>(cmd_line, "--height", 1080);
+	auto tile_size = option<uint32_t>(cmd_line, "--tile-size", 128);
+	auto passes = option<uint32_t>(cmd_line, "--passes", 16);
+	auto samples = option<uint32_t>(cmd_line, "--samples", 1);
+	auto max_threads = option<uint32_t>(cmd_line, "--threads", std::max(1u, std::thread::hardware_concurrency()));
+
+	if (width == 0 || height == 0 || tile_size == 0 || passes == 0 || samples == 0 || max_threads == 0) {
+		fprintf(stderr, "Invalid parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	FrameBuffers shared(width, height);
+	FrameBuffers tiled(width, height);
+	const auto pixel_samples = double(width) * double(height) * double(passes) * double(samples);
+	bool ok = true;
+
+	printf("\n%ux%u pixels, %ux%u tiles, %u passes of %u samples per pixel\n", width, height, tile_size, tile_size, passes, samples);
+	printf("  threads      shared (M samples/s)    tile buffer (M samples/s)\n");
+
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+		auto shared_ms = run(shared, threads, tile_size, passes, samples, render_shared);
+		auto tiled_ms = run(tiled, threads, tile_size, passes, samples, render_tile_buffer);
+
+		printf("  %7u  %9.2fms (%8.2f)  %9.2fms (%8.2f)  speedup %.2fx\n", threads,
+				shared_ms, pixel_samples / (1000.0 * shared_ms),
+				tiled_ms, pixel_samples / (1000.0 * tiled_ms),
+				shared_ms / tiled_ms);
+
+		if (memcmp(shared.m_rgb.data(), tiled.m_rgb.data(), size_t(width) * height * 3) != 0 ||
+			memcmp(shared.m_hdr.sample_count(), tiled.m_hdr.sample_count(), size_t(width) * height * sizeof(uint32_t)) != 0) {
+			printf("  ERROR: the images are different\n");
+			ok = false;
+		}
+
+		if (threads == max_threads) {
+			break;
+		}
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,89 @@
+// bench/bench_occlusion.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// visibility queries: closest hit search limited to t_max versus the any-hit occlusion query
+//	The rays are ambient occlusion rays: they start at the points visible from the camera and go in a random direction
+//	of the hemisphere around the surface normal. Short rays are mostly unoccluded, long rays mostly occluded.
+
+#include "bench.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+int bench_occlusion(const argh::parser &cmd_line) {
+
+	auto width = option<uint32_t>(cmd_line, "--width", 960);
+	auto height = option<uint32_t>(cmd_line, "--height", 540);
+	auto acceleration = cmd_line["--no-bvh"] ? AccelerationStructure::NONE : AccelerationStructure::BVH;
+
+	Scene scene;
+	int scene_id;
+	if (!construct_bench_scene(cmd_line, width, height, scene, scene_id)) {
+		return EXIT_FAILURE;
+	}
+	scene.finalize(acceleration);
+
+	// one ambient occlusion ray for every pixel where the camera sees something
+	auto primary = camera_rays(scene, width, height);
+	std::vector<Ray> rays;
+	rays.reserve(primary.size());
+
+	for (size_t r = 0; r < primary.size(); ++r) {
+		HitRecord hit;
+		if (scene.hit_detection(primary[r], hit)) {
+			RandomGenerator rng(random_seed(primary.size() + r));
+			rays.emplace_back(hit.m_point, glm::normalize(hit.m_normal + random_unit_vector(rng)));
+		}
+	}
+
+	printf("\nscene %d: %zu spheres, %zu triangles, %zu occlusion rays (%s)\n",
+			scene_id, scene.spheres().size(), scene.triangles().size(), rays.size(),
+			acceleration == AccelerationStructure::BVH ? "bvh" : "brute force");
+	printf("  %10s  %10s  %22s  %22s\n", "t_max", "occluded", "closest hit (M rays/s)", "any hit (M rays/s)");
+
+	std::vector<uint8_t> closest(rays.size());
+	std::vector<uint8_t> any(rays.size());
+	bool ok = true;
+
+	const float distances[] = {0.1f, 1.0f, 10.0f, std::numeric_limits<float>::infinity()};
+
+	for (auto t_max : distances) {
+		auto closest_ms = time_ms([&]() {
+			for (size_t r = 0; r < rays.size(); ++r) {
+				HitRecord hit;
+				hit.m_at_t = t_max;
+				closest[r] = scene.hit_detection(rays[r], hit);
+			}
+		});
+
+		auto any_ms = time_ms([&]() {
+			for (size_t r = 0; r < rays.size(); ++r) {
+				any[r] = scene.occluded(rays[r], t_max);
+			}
+		});
+
+		uint64_t occluded = 0;
+		for (size_t r = 0; r < rays.size(); ++r) {
+			occluded += closest[r];
+		}
+
+		auto num_rays = double(rays.size());
+		printf("  %10.1f  %9.1f%%  %9.2fms (%8.2f)  %9.2fms (%8.2f)  speedup %.2fx\n",
+				double(t_max), 100.0 * double(occluded) / num_rays,
+				closest_ms, num_rays / (1000.0 * closest_ms), any_ms, num_rays / (1000.0 * any_ms), closest_ms / any_ms);
+
+		if (closest != any) {
+			printf("  ERROR: the occlusion query doesn't agree with the closest hit search\n");
+			ok = false;
+		}
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,73 @@
+// bench/bench_packets.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// primary visibility: trace one camera ray per pixel one by one and in packets of 8 horizontally adjacent pixels
+
+#include "bench.h"
+
+#include <raytrace/ray_packet.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+int bench_packets(const argh::parser &cmd_line) {
+
+	auto width = option<uint32_t>(cmd_line, "--width", 3840);
+	auto height = option<uint32_t>(cmd_line, "--height", 2160);
+
+	Scene scene;
+	int scene_id;
+	if (!construct_bench_scene(cmd_line, width, height, scene, scene_id)) {
+		return EXIT_FAILURE;
+	}
+	scene.finalize(AccelerationStructure::BVH);
+
+	auto rays = camera_rays(scene, width, height);
+
+	std::vector<HitRecord> single(rays.size());
+	std::vector<HitRecord> packets(rays.size());
+
+	auto single_ms = time_ms([&]() {
+		for (size_t r = 0; r < rays.size(); ++r) {
+			scene.hit_detection(rays[r], single[r]);
+		}
+	});
+
+	auto packet_ms = time_ms([&]() {
+		for (size_t r = 0; r < rays.size(); r += RayPacket::SIZE) {
+			auto count = static_cast<uint32_t>(std::min<size_t>(RayPacket::SIZE, rays.size() - r));
+			scene.hit_detection(RayPacket(&rays[r], count), &packets[r]);
+		}
+	});
+
+	uint64_t hits = 0, mismatches = 0;
+	for (size_t r = 0; r < rays.size(); ++r) {
+		hits += single[r].m_at_t < std::numeric_limits<float>::infinity();
+		if (single[r].m_at_t != packets[r].m_at_t ||
+			(single[r].m_at_t < std::numeric_limits<float>::infinity() && single[r].m_material != packets[r].m_material)) {
+			++mismatches;
+		}
+	}
+
+	auto num_rays = double(rays.size());
+
+	printf("\nscene %d: %zu spheres, %zu triangles, %ux%u primary rays (%" PRIu64 " hits)\n",
+			scene_id, scene.spheres().size(), scene.triangles().size(), width, height, hits);
+	printf("  single: %9.2fms  %8.2f M rays/s\n", single_ms, num_rays / (1000.0 * single_ms));
+	printf("  packet: %9.2fms  %8.2f M rays/s  (speedup %.2fx)\n", packet_ms, num_rays / (1000.0 * packet_ms), single_ms / packet_ms);
+
+	if (mismatches > 0) {
+		printf("  ERROR: %" PRIu64 " rays have different results\n", mismatches);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,116 @@
+// bench/bench_sampler.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// convergence of the samplers: error (RMSE) of renders with an increasing number of samples per pixel compared to a
+//	reference image rendered with many more samples
+//	The reference uses independent random samples. It is rendered as the second frame of its ray tracer so it doesn't
+//	share its random sequences with the renders that are measured.
+
+#include "bench.h"
+
+#include <common/scenes.h>
+#include <raytrace/raytrace.h>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+namespace {
+
+std::vector<color_t> render_image(Scene &scene, RayTracerConfig config, SamplerType sampler, uint32_t samples_per_pixel,
+								  uint32_t frame) {
+	config.m_sampler = sampler;
+	config.m_samples_per_pixel = samples_per_pixel;
+
+	RayTracer raytracer(config);
+	for (uint32_t f = 0; f <= frame; ++f) {
+		raytracer.render(scene);
+	}
+
+	const auto &accumulation = raytracer.accumulation();
+	std::vector<color_t> result(size_t(accumulation.width()) * accumulation.height());
+
+	for (size_t i = 0; i < result.size(); ++i) {
+		result[i] = accumulation.data()[i] / static_cast<float>(accumulation.sample_count()[i]);
+	}
+
+	return result;
+}
+
+double rmse(const std::vector<color_t> &image, const std::vector<color_t> &reference) {
+	double sum = 0.0;
+	for (size_t i = 0; i < image.size(); ++i) {
+		for (int c = 0; c < 3; ++c) {
+			auto delta = double(image[i][c]) - double(reference[i][c]);
+			sum += delta * delta;
+		}
+	}
+
+	return std::sqrt(sum / double(3 * image.size()));
+}
+
+} // unnamed namespace
+
+int bench_sampler(const argh::parser &cmd_line) {
+
+	RayTracerConfig config;
+	config.m_print_report = false;
+	config.m_render_resolution_x = option<uint32_t>(cmd_line, "--width", 160);
+	config.m_render_resolution_y = option<uint32_t>(cmd_line, "--height", 90);
+	auto scene_id = option<int>(cmd_line, "--scene", 1);
+	auto scene_size = option<int>(cmd_line, "--scene-size", 11);
+	auto max_samples = option<uint32_t>(cmd_line, "--max-samples", 64);
+	auto reference_samples = option<uint32_t>(cmd_line, "--reference-samples", 4096);
+
+	if (config.m_render_resolution_x < 2 || config.m_render_resolution_y < 2) {
+		fprintf(stderr, "Invalid resolution\n");
+		return EXIT_FAILURE;
+	}
+
+	if (max_samples == 0 || reference_samples < max_samples) {
+		fprintf(stderr, "Invalid number of samples\n");
+		return EXIT_FAILURE;
+	}
+
+	Scene scene;
+	if (!construct_scene(scene, scene_id, float(config.m_render_resolution_x) / float(config.m_render_resolution_y), scene_size)) {
+		fprintf(stderr, "Unknown scene %d\n", scene_id);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<color_t> reference;
+	auto reference_ms = time_ms([&]() {
+		reference = render_image(scene, config, SamplerType::RANDOM, reference_samples, 1);
+	});
+
+	printf("\nscene %d: %ux%u, reference %u samples per pixel (%.0fms)\n", scene_id,
+			config.m_render_resolution_x, config.m_render_resolution_y, reference_samples, reference_ms);
+	printf("  %8s  %12s  %12s  %12s\n", "spp", "random", "stratified", "sobol");
+
+	const SamplerType samplers[] = {SamplerType::RANDOM, SamplerType::STRATIFIED, SamplerType::SOBOL};
+	double last_error[3] = {};
+
+	for (uint32_t spp = 1; spp <= max_samples; spp *= 2) {
+		printf("  %8u", spp);
+		for (int s = 0; s < 3; ++s) {
+			last_error[s] = rmse(render_image(scene, config, samplers[s], spp, 0), reference);
+			printf("  %12.5f", last_error[s]);
+		}
+		printf("\n");
+
+		if (spp > max_samples / 2) {
+			// the error of random samples goes down with the square root of the number of samples
+			printf("\n  at %u spp the error of stratified is the error of random at %.0f spp, sobol at %.0f spp\n", spp,
+					double(spp) * (last_error[0] / last_error[1]) * (last_error[0] / last_error[1]),
+					double(spp) * (last_error[0] / last_error[2]) * (last_error[0] / last_error[2]));
+			break;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,34 @@
+// bench/bench_spheres.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// compare the scalar (array-of-structures) and the SIMD (structure-of-arrays) ray/sphere kernels
+
+#include "bench.h"
+
+#include <raytrace/geometry_spheres.h>
+
+namespace rtiow {
+namespace bench {
+
+int bench_spheres(const argh::parser &cmd_line) {
+
+	auto num_spheres = option<uint32_t>(cmd_line, "--spheres", 4096);
+	auto num_rays = option<uint32_t>(cmd_line, "--rays", 1000000);
+
+	// random spheres in a unit cube
+	RandomGenerator rng(42);
+	GeometrySpheres spheres;
+
+	for (uint32_t i = 0; i < num_spheres; ++i) {
+		spheres.add_sphere(random_vector(rng, -1.0f, 1.0f), random_float(rng, 0.05f, 0.25f), i);
+	}
+	spheres.finalize(AccelerationStructure::NONE);
+
+	bool ok = compare_range_kernels("spheres", num_spheres, num_rays, rng,
+		[&spheres](uint32_t f, uint32_t c, const Ray &r, float t, HitRecord &h) {return spheres.hit_range_scalar(f, c, r, t, h);},
+		[&spheres](uint32_t f, uint32_t c, const Ray &r, float t, HitRecord &h) {return spheres.hit_range_simd(f, c, r, t, h);});
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,37 @@
+// bench/bench_triangles.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// compare the scalar and the SIMD (structure-of-arrays) Möller-Trumbore ray/triangle kernels
+
+#include "bench.h"
+
+#include <raytrace/geometry_triangles.h>
+
+namespace rtiow {
+namespace bench {
+
+int bench_triangles(const argh::parser &cmd_line) {
+
+	auto num_triangles = option<uint32_t>(cmd_line, "--triangles", 4096);
+	auto num_rays = option<uint32_t>(cmd_line, "--rays", 1000000);
+
+	// random triangles in a unit cube
+	RandomGenerator rng(42);
+	GeometryTriangles triangles;
+
+	for (uint32_t i = 0; i < num_triangles; ++i) {
+		auto v0 = random_vector(rng, -1.0f, 1.0f);
+		auto v1 = v0 + random_vector(rng, -0.5f, 0.5f);
+		auto v2 = v0 + random_vector(rng, -0.5f, 0.5f);
+		triangles.add_mesh({v0, v1, v2}, {0, 1, 2}, i);
+	}
+	triangles.finalize(AccelerationStructure::NONE);
+
+	bool ok = compare_range_kernels("triangles", num_triangles, num_rays, rng,
+		[&triangles](uint32_t f, uint32_t c, const Ray &r, float t, HitRecord &h) {return triangles.hit_range_scalar(f, c, r, t, h);},
+		[&triangles](uint32_t f, uint32_t c, const Ray &r, float t, HitRecord &h) {return triangles.hit_range_simd(f, c, r, t, h);});
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
@@ -0,0 +1,124 @@
+// bench/bench_wide_bvh.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// traversal of the binary BVH versus the BVH collapsed to 4 and 8 children per node, for scene 2 with a growing grid
+//	of random spheres. Camera rays are coherent, the diffuse bounce rays from the points they hit are not.
+
+#include "bench.h"
+
+#include <common/scenes.h>
+
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace rtiow {
+namespace bench {
+
+namespace {
+
+struct RaySet {
+	const char *		m_name;
+	std::vector<Ray>	m_rays;
+};
+
+// closest hit of every ray (distance and material, to compare the acceleration structures)
+double trace(const Scene &scene, const std::vector<Ray> &rays, std::vector<HitRecord> &hits) {
+	hits.assign(rays.size(), HitRecord());
+
+	return time_ms([&]() {
+		for (size_t r = 0; r < rays.size(); ++r) {
+			scene.hit_detection(rays[r], hits[r]);
+		}
+	});
+}
+
+bool same_hits(const std::vector<HitRecord> &a, const std::vector<HitRecord> &b) {
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (a[i].m_at_t != b[i].m_at_t || (a[i].m_at_t < std::numeric_limits<float>::infinity() && a[i].m_material != b[i].m_material)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // unnamed namespace
+
+int bench_wide_bvh(const argh::parser &cmd_line) {
+
+	auto width = option<uint32_t>(cmd_line, "--width", 640);
+	auto height = option<uint32_t>(cmd_line, "--height", 360);
+	auto max_scene_size = option<int>(cmd_line, "--max-scene-size", 250);
+
+	if (width < 2 || height < 2) {
+		fprintf(stderr, "Invalid resolution\n");
+		return EXIT_FAILURE;
+	}
+
+	const AccelerationStructure structures[] = {AccelerationStructure::BVH, AccelerationStructure::BVH4, AccelerationStructure::BVH8};
+	bool ok = true;
+
+	printf("\nscene 2, %ux%u camera rays + one diffuse bounce per hit, M rays/s (speedup over the binary BVH)\n", width, height);
+	printf("  %10s  %8s  %18s  %18s  %18s\n", "spheres", "rays", "bvh", "bvh4", "bvh8");
+
+	for (int scene_size : {11, 40, 100, 250, 500}) {
+		if (scene_size > max_scene_size) {
+			continue;
+		}
+
+		Scene scene;
+		construct_scene_02(scene, float(width) / float(height), scene_size);
+		scene.finalize(AccelerationStructure::BVH);
+
+		RaySet ray_sets[2] = {{"camera", camera_rays(scene, width, height)}, {"bounce", {}}};
+		const auto &primary = ray_sets[0].m_rays;
+
+		for (size_t r = 0; r < primary.size(); ++r) {
+			HitRecord hit;
+			if (scene.hit_detection(primary[r], hit)) {
+				RandomGenerator rng(random_seed(primary.size() + r));
+				ray_sets[1].m_rays.emplace_back(hit.m_point, glm::normalize(hit.m_normal + random_unit_vector(rng)));
+			}
+		}
+
+		// the same binary tree is built for each structure, the wide ones are collapsed from it
+		double ms[2][3];
+		size_t memory[3];
+		std::vector<HitRecord> reference[2];
+
+		for (int s = 0; s < 3; ++s) {
+			scene.finalize(structures[s]);
+			memory[s] = scene.spheres().bvh().memory_usage();
+
+			for (int r = 0; r < 2; ++r) {
+				std::vector<HitRecord> hits;
+				ms[r][s] = trace(scene, ray_sets[r].m_rays, hits);
+
+				if (s == 0) {
+					reference[r] = std::move(hits);
+				} else if (!same_hits(reference[r], hits)) {
+					printf("  MISMATCH: %s rays, %s\n", ray_sets[r].m_name, s == 1 ? "bvh4" : "bvh8");
+					ok = false;
+				}
+			}
+		}
+
+		for (int r = 0; r < 2; ++r) {
+			printf("  %10zu  %8s", scene.spheres().size(), ray_sets[r].m_name);
+			for (int s = 0; s < 3; ++s) {
+				printf("  %9.2f (%5.2fx)", double(ray_sets[r].m_rays.size()) / (1000.0 * ms[r][s]), ms[r][0] / ms[r][s]);
+			}
+			printf("\n");
+		}
+
+		printf("  %10zu  %8s", scene.spheres().size(), "KiB");
+		for (int s = 0; s < 3; ++s) {
+			printf("  %18.0f", double(memory[s]) / 1024.0);
+		}
+		printf("\n");
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace rtiow::bench
+} // namespace rtiow
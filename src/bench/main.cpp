@@ -0,0 +1,54 @@
+// bench/main.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// micro-benchmarks for the performance critical parts of the ray tracer
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <raytrace/simd.h>
+#include "bench.h"
+
+using namespace rtiow::bench;
+
+static const Benchmark BENCHMARKS[] = {
+	{"spheres", "ray/sphere intersection: scalar vs SIMD kernel [--spheres N --rays N]", bench_spheres},
+	{"triangles", "ray/triangle intersection: scalar vs SIMD kernel [--triangles N --rays N]", bench_triangles},
+	{"framebuffer", "frame buffer writes: shared buffers vs tile buffers [--tile-size N --threads N --passes N]", bench_framebuffer},
+	{"packets", "primary visibility: single rays vs ray packets [--width N --height N --scene ID]", bench_packets},
+	{"occlusion", "visibility queries: closest hit vs any hit [--width N --height N --scene ID --no-bvh]", bench_occlusion},
+	{"bvh_build", "BVH construction: binned SAH and linear builders on 1 vs N threads [--min-spheres N --max-spheres N --threads N --sweep]", bench_bvh_build},
+	{"wide_bvh", "BVH traversal: binary vs 4 and 8 children per node on a scaled up scene 2 [--width N --height N --max-scene-size N]", bench_wide_bvh},
+	{"sampler", "convergence of the samplers: RMSE vs samples per pixel [--scene ID --max-samples N --reference-samples N]", bench_sampler},
+};
+
+static void print_help() {
+	printf("Usage:\n\n");
+	printf("rtiow_bench <benchmark> [options]\n\n");
+	printf("Benchmarks (SIMD instruction set: %s)\n", rtiow::simd::INSTRUCTION_SET);
+	for (const auto &bench : BENCHMARKS) {
+		printf(" %-15s %s\n", bench.m_name, bench.m_description);
+	}
+}
+
+int main(int argc, char *argv[]) {
+
+	argh::parser cmd_line(argc, argv, argh::parser::PREFER_PARAM_FOR_UNREG_OPTION);
+
+	auto name = cmd_line[1];
+	if (name.empty() || cmd_line[{"-h", "--help"}]) {
+		print_help();
+		return EXIT_SUCCESS;
+	}
+
+	for (const auto &bench : BENCHMARKS) {
+		if (name == bench.m_name) {
+			printf("Running benchmark '%s' (SIMD instruction set: %s)\n", bench.m_name, rtiow::simd::INSTRUCTION_SET);
+			return bench.m_func(cmd_line);
+		}
+	}
+
+	fprintf(stderr, "Unknown benchmark '%s'\n", name.c_str());
+	print_help();
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+// cli/main.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// headless front-end: render a scene to an image file without opening a window
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <raytrace/raytrace.h>
+#include <common/image_io.h>
+#include <common/options.h>
+#include <common/scene_file.h>
+#include <common/scenes.h>
+
+static constexpr rtiow::argh_list_t ARG_OUTPUT = {"-o", "--output"};
+static constexpr rtiow::argh_list_t ARG_STATS = {"--stats"};
+
+static rtiow::Options options;
+static std::string output_filename = "output.ppm";
+static std::string stats_filename;
+
+namespace rtiow {
+
+void print_help() {
+	printf("Usage:\n\n");
+	printf("rtiow_cli [options]\n\n");
+	printf("Options\n");
+	printf(" %-25s file to write the rendered image to, PPM or PFM (.pfm extension) format (%s)\n",
+			format_argh_list(ARG_OUTPUT).c_str(), output_filename.c_str());
+	if constexpr (RENDER_STATS_ENABLED) {
+		printf(" %-25s write the ray and path statistics of the render to this file (JSON)\n",
+				format_argh_list(ARG_STATS).c_str());
+	}
+	options_print_help(options);
+}
+
+bool write_stats(const char *filename, const RenderStats &stats) {
+	auto *fp = fopen(filename, "w");
+	if (fp == nullptr) {
+		fprintf(stderr, "Unable to open '%s' for writing\n", filename);
+		return false;
+	}
+
+	auto json = stats.to_json();
+	bool ok = fwrite(json.data(), 1, json.size(), fp) == json.size();
+
+	if (fclose(fp) != 0 || !ok) {
+		fprintf(stderr, "Error writing '%s'\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool has_extension(const std::string &filename, const char *ext) {
+	auto len = strlen(ext);
+	return filename.size() >= len && filename.compare(filename.size() - len, len, ext) == 0;
+}
+
+template <typename T>
+int64_t elapsed_ms(T start, T finish) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+}
+
+} // namespace rtiow
+
+int main(int argc, char *argv[]) {
+
+	// parameter parsing
+	argh::parser cmd_line;
+	rtiow::options_add_params(cmd_line);
+	cmd_line.add_params(ARG_OUTPUT);
+	cmd_line.add_params(ARG_STATS);
+	cmd_line.parse(argc, argv);
+
+	if (rtiow::options_help_requested(cmd_line)) {
+		rtiow::print_help();
+		exit(EXIT_SUCCESS);
+	}
+
+	if (!rtiow::options_parse(cmd_line, options)) {
+		exit(EXIT_FAILURE);
+	}
+
+	cmd_line(ARG_OUTPUT, output_filename) >> output_filename;
+	cmd_line(ARG_STATS, stats_filename) >> stats_filename;
+
+	if (!rtiow::RENDER_STATS_ENABLED && !stats_filename.empty()) {
+		fprintf(stderr, "Statistics are not available in this build (RTIOW_RENDER_STATS is off)\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const auto &raytracer_config = options.m_raytracer;
+
+	// create scene (meshes are loaded on the thread pool of the ray tracer)
+	rtiow::Scene scene;
+	rtiow::RayTracer ray_tracer(raytracer_config);
+
+	auto scene_start = std::chrono::steady_clock::now();
+
+	auto aspect_ratio = float(raytracer_config.m_render_resolution_x) / float(raytracer_config.m_render_resolution_y);
+	if (!options.m_scene_file.empty()) {
+		if (!rtiow::load_scene_file(scene, options.m_scene_file.c_str(), aspect_ratio, raytracer_config.m_acceleration,
+									raytracer_config.m_bvh_builder, ray_tracer.thread_pool(), options.m_scene_cache)) {
+			exit(EXIT_FAILURE);
+		}
+	} else if (!options.m_mesh_file.empty()) {
+		if (!rtiow::construct_scene_mesh(scene, aspect_ratio, options.m_mesh_file.c_str(), ray_tracer.thread_pool())) {
+			exit(EXIT_FAILURE);
+		}
+	} else if (!rtiow::construct_scene(scene, options.m_scene, aspect_ratio, options.m_scene_size)) {
+		fprintf(stderr, "Unknown scene %d\n", options.m_scene);
+		exit(EXIT_FAILURE);
+	}
+
+	auto build_start = std::chrono::steady_clock::now();
+	if (!scene.is_finalized()) {
+		scene.finalize(raytracer_config.m_acceleration, raytracer_config.m_bvh_builder, &ray_tracer.thread_pool());
+	}
+
+	// render
+	auto render_start = std::chrono::steady_clock::now();
+	ray_tracer.render(scene);
+	auto render_finish = std::chrono::steady_clock::now();
+
+	bool written = false;
+	if (rtiow::has_extension(output_filename, ".pfm")) {
+		written = rtiow::write_pfm(output_filename.c_str(), ray_tracer.accumulation());
+	} else {
+		written = rtiow::write_ppm(output_filename.c_str(), ray_tracer.output_ptr(),
+								   raytracer_config.m_render_resolution_x, raytracer_config.m_render_resolution_y);
+	}
+
+	if (!written) {
+		exit(EXIT_FAILURE);
+	}
+
+	if (!stats_filename.empty() && !rtiow::write_stats(stats_filename.c_str(), ray_tracer.render_stats())) {
+		exit(EXIT_FAILURE);
+	}
+
+	// timing statistics
+	auto primary_rays = ray_tracer.samples_taken();
+	auto render_ms = rtiow::elapsed_ms(render_start, render_finish);
+
+	printf("Scene:        %zu spheres, %zu triangles\n", scene.spheres().size(), scene.triangles().size());
+	printf("Memory:       spheres %.1f KiB (%zu bytes each), triangles %.1f KiB (%zu bytes each), %zu materials %.1f KiB\n",
+			double(scene.spheres().memory_usage()) / 1024.0, sizeof(rtiow::Sphere),
+			double(scene.triangles().memory_usage()) / 1024.0, sizeof(rtiow::Triangle),
+			scene.material_table().size(), double(scene.material_table().memory_usage()) / 1024.0);
+	printf("Construction: %" PRId64 "ms\n", rtiow::elapsed_ms(scene_start, build_start));
+	printf("Finalize:     %" PRId64 "ms\n", rtiow::elapsed_ms(build_start, render_start));
+	if (!scene.spheres().bvh().empty() || !scene.triangles().bvh().empty()) {
+		printf("BVH:          spheres %zu nodes (SAH cost %.2f), triangles %zu nodes (SAH cost %.2f)\n",
+				scene.spheres().bvh().node_count(), double(scene.spheres().bvh().sah_cost()),
+				scene.triangles().bvh().node_count(), double(scene.triangles().bvh().sah_cost()));
+	}
+	if (scene.spheres().bvh().width() > 2 || scene.triangles().bvh().width() > 2) {
+		printf("Wide BVH:     %u children per node, spheres %zu nodes, triangles %zu nodes\n",
+				std::max(scene.spheres().bvh().width(), scene.triangles().bvh().width()),
+				scene.spheres().bvh().wide_node_count(), scene.triangles().bvh().wide_node_count());
+	}
+	printf("Render:       %" PRId64 "ms (%.1f spp, %.2f M primary rays/s)\n", render_ms, double(ray_tracer.average_samples_per_pixel()),
+			double(primary_rays) / (1000.0 * double(std::max<int64_t>(render_ms, 1))));
+	printf("Output:       %s\n", output_filename.c_str());
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+// common/image_io.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "image_io.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace rtiow {
+
+bool write_ppm(const char *filename, const uint8_t *img_data, uint32_t width, uint32_t height) {
+
+	auto *fp = fopen(filename, "wb");
+	if (fp == nullptr) {
+		fprintf(stderr, "Unable to open '%s' for writing\n", filename);
+		return false;
+	}
+
+	fprintf(fp, "P6\n%u %u\n255\n", width, height);
+
+	// PPM stores the top row first
+	const size_t row_size = size_t(width) * 3;
+	bool ok = true;
+
+	for (uint32_t y = height; ok && y > 0; --y) {
+		ok = fwrite(img_data + (y - 1) * row_size, 1, row_size, fp) == row_size;
+	}
+
+	if (fclose(fp) != 0 || !ok) {
+		fprintf(stderr, "Error writing '%s'\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool write_pfm(const char *filename, const HDRBuffer &img) {
+
+	auto *fp = fopen(filename, "wb");
+	if (fp == nullptr) {
+		fprintf(stderr, "Unable to open '%s' for writing\n", filename);
+		return false;
+	}
+
+	// a negative scale means little-endian data
+	fprintf(fp, "PF\n%u %u\n-1.0\n", img.width(), img.height());
+
+	// PFM stores the bottom row first, just like the render output
+	std::vector<float> row(size_t(img.width()) * 3);
+	bool ok = true;
+
+	for (uint32_t y = 0; ok && y < img.height(); ++y) {
+		const size_t offset = size_t(y) * img.width();
+		const color_t *src = img.data() + offset;
+		const uint32_t *count = img.sample_count() + offset;
+
+		for (uint32_t x = 0; x < img.width(); ++x) {
+			const float scale = (count[x] > 0) ? 1.0f / float(count[x]) : 0.0f;
+			row[3 * x + 0] = src[x].r * scale;
+			row[3 * x + 1] = src[x].g * scale;
+			row[3 * x + 2] = src[x].b * scale;
+		}
+		ok = fwrite(row.data(), sizeof(float), row.size(), fp) == row.size();
+	}
+
+	if (fclose(fp) != 0 || !ok) {
+		fprintf(stderr, "Error writing '%s'\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace rtiow
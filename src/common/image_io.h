@@ -0,0 +1,18 @@
+// common/image_io.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// writing rendered images to disk
+
+#pragma once
+
+#include <raytrace/hdr_buffer.h>
+#include <raytrace/types.h>
+
+namespace rtiow {
+
+// write a 24-bit RGB image as a binary PPM (the first row of img_data is the bottom row of the image)
+bool write_ppm(const char *filename, const uint8_t *img_data, uint32_t width, uint32_t height);
+
+// write the average of the accumulated samples as a floating point RGB image (PFM)
+bool write_pfm(const char *filename, const HDRBuffer &img);
+
+} // namespace rtiow
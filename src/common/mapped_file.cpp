@@ -0,0 +1,133 @@
+// common/mapped_file.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "mapped_file.h"
+
+#include <cstdio>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace rtiow {
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const char *filename) {
+	close();
+
+	m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		fprintf(stderr, "Unable to open '%s'\n", filename);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) {
+		fprintf(stderr, "Unable to determine the size of '%s'\n", filename);
+		close();
+		return false;
+	}
+	m_size = size_t(size.QuadPart);
+
+	// an empty file can't be mapped
+	if (m_size == 0) {
+		return true;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping != nullptr) {
+		m_data = static_cast<const uint8_t *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+
+	if (m_data == nullptr) {
+		fprintf(stderr, "Unable to map '%s' into memory\n", filename);
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file != nullptr) {
+		CloseHandle(m_file);
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_mapping = nullptr;
+	m_file = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char *filename) {
+	close();
+
+	auto fd = ::open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open '%s'\n", filename);
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		fprintf(stderr, "Unable to determine the size of '%s'\n", filename);
+		::close(fd);
+		return false;
+	}
+	m_size = size_t(info.st_size);
+
+	// an empty file can't be mapped
+	if (m_size == 0) {
+		::close(fd);
+		return true;
+	}
+
+	// the mapping stays valid after closing the file descriptor
+	auto *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Unable to map '%s' into memory\n", filename);
+		m_size = 0;
+		return false;
+	}
+
+	// the loaders mostly read the file front to back
+	madvise(data, m_size, MADV_SEQUENTIAL);
+
+	m_data = static_cast<const uint8_t *>(data);
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr) {
+		munmap(const_cast<uint8_t *>(m_data), m_size);
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
+
+} // namespace rtiow
@@ -0,0 +1,36 @@
+// common/mapped_file.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// read-only memory mapped file
+
+#pragma once
+
+#include <raytrace/types.h>
+
+namespace rtiow {
+
+class MappedFile {
+public:
+	// construction
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	~MappedFile();
+
+	// map the entire file into memory, returns false (after printing an error) on failure
+	bool open(const char *filename);
+	void close();
+
+	// data access
+	const uint8_t *data() const {return m_data;}
+	size_t size() const {return m_size;}
+
+private:
+	const uint8_t *	m_data = nullptr;
+	size_t			m_size = 0;
+#if defined(_WIN32)
+	void *			m_file = nullptr;
+	void *			m_mapping = nullptr;
+#endif
+};
+
+} // namespace rtiow
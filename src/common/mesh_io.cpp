@@ -0,0 +1,835 @@
+// common/mesh_io.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "mesh_io.h"
+#include "mapped_file.h"
+
+#include <raytrace/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace rtiow {
+
+namespace {
+
+// number of vertices/faces (PLY) or bytes (OBJ) parsed by a single task
+static constexpr size_t PLY_CHUNK_ELEMENTS = 1 << 18;
+static constexpr size_t OBJ_CHUNK_BYTES = 1 << 22;
+
+bool has_extension(const char *filename, const char *ext) {
+	auto len = strlen(filename);
+	auto ext_len = strlen(ext);
+	if (len < ext_len) {
+		return false;
+	}
+
+	for (size_t i = 0; i < ext_len; ++i) {
+		if (tolower(filename[len - ext_len + i]) != ext[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// run func(first, count) for consecutive ranges of [0, total) on the thread pool
+template <typename Func>
+void parallel_ranges(ThreadPool &pool, size_t total, size_t chunk_size, Func &&func) {
+	TaskGroup tasks;
+
+	for (size_t first = 0; first < total; first += chunk_size) {
+		auto count = std::min(chunk_size, total - first);
+		pool.add_task(tasks, [&func, first, count]() {func(first, count);});
+	}
+
+	pool.wait(tasks);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// PLY
+//
+
+enum class PlyType {
+	INVALID, INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64
+};
+
+struct PlyProperty {
+	std::string	m_name;
+	PlyType		m_type = PlyType::INVALID;
+	PlyType		m_count_type = PlyType::INVALID;		// only valid for list properties
+	size_t		m_offset = 0;							// offset in the record (only for elements without lists)
+};
+
+struct PlyElement {
+	std::string					m_name;
+	size_t						m_count = 0;
+	std::vector<PlyProperty>	m_properties;
+	size_t						m_record_size = 0;		// 0 when the element contains lists
+
+	const PlyProperty *property(const char *name) const {
+		for (const auto &prop : m_properties) {
+			if (prop.m_name == name) {
+				return &prop;
+			}
+		}
+		return nullptr;
+	}
+};
+
+struct PlyHeader {
+	bool					m_swap_bytes = false;
+	size_t					m_data_offset = 0;
+	std::vector<PlyElement>	m_elements;
+};
+
+PlyType ply_type(const std::string &name) {
+	if (name == "char" || name == "int8") return PlyType::INT8;
+	if (name == "uchar" || name == "uint8") return PlyType::UINT8;
+	if (name == "short" || name == "int16") return PlyType::INT16;
+	if (name == "ushort" || name == "uint16") return PlyType::UINT16;
+	if (name == "int" || name == "int32") return PlyType::INT32;
+	if (name == "uint" || name == "uint32") return PlyType::UINT32;
+	if (name == "float" || name == "float32") return PlyType::FLOAT32;
+	if (name == "double" || name == "float64") return PlyType::FLOAT64;
+	return PlyType::INVALID;
+}
+
+size_t ply_type_size(PlyType type) {
+	switch (type) {
+		case PlyType::INT8:
+		case PlyType::UINT8:
+			return 1;
+		case PlyType::INT16:
+		case PlyType::UINT16:
+			return 2;
+		case PlyType::INT32:
+		case PlyType::UINT32:
+		case PlyType::FLOAT32:
+			return 4;
+		case PlyType::FLOAT64:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+template <typename T>
+inline T ply_load(const uint8_t *data, bool swap_bytes) {
+	uint8_t bytes[sizeof(T)];
+	memcpy(bytes, data, sizeof(T));
+	if (swap_bytes) {
+		std::reverse(bytes, bytes + sizeof(T));
+	}
+
+	T result;
+	memcpy(&result, bytes, sizeof(T));
+	return result;
+}
+
+template <typename T>
+inline T ply_read(const uint8_t *data, PlyType type, bool swap_bytes) {
+	switch (type) {
+		case PlyType::INT8:		return static_cast<T>(ply_load<int8_t>(data, swap_bytes));
+		case PlyType::UINT8:	return static_cast<T>(ply_load<uint8_t>(data, swap_bytes));
+		case PlyType::INT16:	return static_cast<T>(ply_load<int16_t>(data, swap_bytes));
+		case PlyType::UINT16:	return static_cast<T>(ply_load<uint16_t>(data, swap_bytes));
+		case PlyType::INT32:	return static_cast<T>(ply_load<int32_t>(data, swap_bytes));
+		case PlyType::UINT32:	return static_cast<T>(ply_load<uint32_t>(data, swap_bytes));
+		case PlyType::FLOAT32:	return static_cast<T>(ply_load<float>(data, swap_bytes));
+		case PlyType::FLOAT64:	return static_cast<T>(ply_load<double>(data, swap_bytes));
+		default:				return T(0);
+	}
+}
+
+bool ply_parse_header(const MappedFile &file, const char *filename, PlyHeader &header) {
+
+	const auto *text = reinterpret_cast<const char *>(file.data());
+	const auto *end = text + file.size();
+	const auto *pos = text;
+
+	auto next_line = [&pos, end](std::string &line) {
+		const auto *eol = static_cast<const char *>(memchr(pos, '\n', size_t(end - pos)));
+		if (eol == nullptr) {
+			return false;
+		}
+		line.assign(pos, eol);
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		pos = eol + 1;
+		return true;
+	};
+
+	std::string line;
+	if (!next_line(line) || line != "ply") {
+		fprintf(stderr, "'%s' is not a PLY file\n", filename);
+		return false;
+	}
+
+	bool format_ok = false;
+
+	while (next_line(line)) {
+		char word[3][64] = {};
+		auto num_words = sscanf(line.c_str(), "%63s %63s %63s", word[0], word[1], word[2]);
+		if (num_words <= 0) {
+			continue;
+		}
+
+		std::string keyword = word[0];
+
+		if (keyword == "end_header") {
+			header.m_data_offset = size_t(pos - text);
+			break;
+		} else if (keyword == "format") {
+			std::string format = (num_words > 1) ? word[1] : "";
+			if (format == "binary_little_endian" || format == "binary_big_endian") {
+				const uint16_t probe = 1;
+				const bool host_little_endian = *reinterpret_cast<const uint8_t *>(&probe) == 1;
+				header.m_swap_bytes = (format == "binary_little_endian") != host_little_endian;
+				format_ok = true;
+			} else {
+				fprintf(stderr, "'%s': unsupported PLY format '%s' (only binary PLY files are supported)\n", filename, format.c_str());
+				return false;
+			}
+		} else if (keyword == "element" && num_words == 3) {
+			auto &element = header.m_elements.emplace_back();
+			element.m_name = word[1];
+			element.m_count = std::strtoull(word[2], nullptr, 10);
+		} else if (keyword == "property" && !header.m_elements.empty()) {
+			auto &element = header.m_elements.back();
+			PlyProperty prop;
+
+			if (std::string(word[1]) == "list") {
+				char type[64] = {}, count_type[64] = {}, name[64] = {};
+				if (sscanf(line.c_str(), "%*s %*s %63s %63s %63s", count_type, type, name) != 3) {
+					fprintf(stderr, "'%s': invalid property '%s'\n", filename, line.c_str());
+					return false;
+				}
+				prop.m_count_type = ply_type(count_type);
+				prop.m_type = ply_type(type);
+				prop.m_name = name;
+				if (prop.m_count_type == PlyType::INVALID) {
+					prop.m_type = PlyType::INVALID;
+				}
+			} else {
+				prop.m_type = ply_type(word[1]);
+				prop.m_name = word[2];
+			}
+
+			if (prop.m_type == PlyType::INVALID) {
+				fprintf(stderr, "'%s': invalid property '%s'\n", filename, line.c_str());
+				return false;
+			}
+
+			element.m_properties.push_back(prop);
+		}
+	}
+
+	if (!format_ok || header.m_data_offset == 0) {
+		fprintf(stderr, "'%s': invalid PLY header\n", filename);
+		return false;
+	}
+
+	// record layout of elements without lists
+	for (auto &element : header.m_elements) {
+		size_t offset = 0;
+		for (auto &prop : element.m_properties) {
+			if (prop.m_count_type != PlyType::INVALID) {
+				offset = 0;
+				break;
+			}
+			prop.m_offset = offset;
+			offset += ply_type_size(prop.m_type);
+		}
+		element.m_record_size = offset;
+	}
+
+	return true;
+}
+
+// size of a (variable sized) record, returns 0 if the record doesn't fit in the data
+size_t ply_record_size(const PlyElement &element, const uint8_t *record, const uint8_t *end, bool swap_bytes) {
+	const uint8_t *pos = record;
+
+	for (const auto &prop : element.m_properties) {
+		if (prop.m_count_type == PlyType::INVALID) {
+			pos += ply_type_size(prop.m_type);
+		} else {
+			if (pos + ply_type_size(prop.m_count_type) > end) {
+				return 0;
+			}
+			auto count = ply_read<size_t>(pos, prop.m_count_type, swap_bytes);
+			pos += ply_type_size(prop.m_count_type) + count * ply_type_size(prop.m_type);
+		}
+
+		if (pos > end) {
+			return 0;
+		}
+	}
+
+	return size_t(pos - record);
+}
+
+class PlyLoader {
+public:
+	PlyLoader(const MappedFile &file, const char *filename, ThreadPool &pool, GeometryTriangles &geometry, material_id_t material) :
+		m_file(file), m_filename(filename), m_pool(pool), m_geometry(geometry), m_material(material) {
+	}
+
+	bool load(MeshInfo &info) {
+		if (!ply_parse_header(m_file, m_filename, m_header)) {
+			return false;
+		}
+
+		const auto *data = m_file.data() + m_header.m_data_offset;
+		const auto *end = m_file.data() + m_file.size();
+
+		info.m_first_vertex = static_cast<uint32_t>(m_geometry.vertex_count());
+		info.m_first_triangle = static_cast<uint32_t>(m_geometry.size());
+
+		for (const auto &element : m_header.m_elements) {
+			bool ok = true;
+
+			if (element.m_name == "vertex") {
+				ok = load_vertices(element, data, end, info);
+			} else if (element.m_name == "face") {
+				ok = load_faces(element, data, end, info);
+			} else {
+				ok = skip_element(element, data, end);
+			}
+
+			if (!ok) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	bool truncated() const {
+		fprintf(stderr, "'%s': unexpected end of file\n", m_filename);
+		return false;
+	}
+
+	bool load_vertices(const PlyElement &element, const uint8_t *&data, const uint8_t *end, MeshInfo &info) {
+		const auto *prop_x = element.property("x");
+		const auto *prop_y = element.property("y");
+		const auto *prop_z = element.property("z");
+
+		if (element.m_record_size == 0 || !prop_x || !prop_y || !prop_z) {
+			fprintf(stderr, "'%s': unsupported vertex layout\n", m_filename);
+			return false;
+		}
+
+		if (size_t(end - data) / element.m_record_size < element.m_count) {
+			return truncated();
+		}
+
+		auto first = m_geometry.append_vertices(element.m_count);
+		info.m_vertex_count = static_cast<uint32_t>(element.m_count);
+		m_vertex_base = first;
+		m_vertex_count = element.m_count;
+
+		parallel_ranges(m_pool, element.m_count, PLY_CHUNK_ELEMENTS, [&](size_t begin, size_t count) {
+			const auto *record = data + begin * element.m_record_size;
+			for (size_t i = begin; i < begin + count; ++i, record += element.m_record_size) {
+				m_geometry.set_vertex(static_cast<uint32_t>(first + i), {
+					ply_read<float>(record + prop_x->m_offset, prop_x->m_type, m_header.m_swap_bytes),
+					ply_read<float>(record + prop_y->m_offset, prop_y->m_type, m_header.m_swap_bytes),
+					ply_read<float>(record + prop_z->m_offset, prop_z->m_type, m_header.m_swap_bytes)
+				});
+			}
+		});
+
+		data += element.m_count * element.m_record_size;
+		return true;
+	}
+
+	bool load_faces(const PlyElement &element, const uint8_t *&data, const uint8_t *end, MeshInfo &info) {
+		const PlyProperty *indices = nullptr;
+		size_t offset = 0;
+		size_t num_lists = 0;
+
+		for (const auto &prop : element.m_properties) {
+			if (prop.m_count_type != PlyType::INVALID) {
+				++num_lists;
+				if (prop.m_name == "vertex_indices" || prop.m_name == "vertex_index") {
+					indices = &prop;
+				}
+			}
+			if (num_lists == 0) {
+				offset += ply_type_size(prop.m_type);
+			}
+		}
+
+		if (indices == nullptr || indices->m_type == PlyType::FLOAT32 || indices->m_type == PlyType::FLOAT64) {
+			fprintf(stderr, "'%s': unsupported face layout\n", m_filename);
+			return false;
+		}
+
+		info.m_first_triangle = static_cast<uint32_t>(m_geometry.size());
+
+		// fast path: when every face is a triangle all records have the same size and can be parsed in parallel
+		if (num_lists == 1 && &element.m_properties.back() == indices) {
+			auto record_size = offset + ply_type_size(indices->m_count_type) + 3 * ply_type_size(indices->m_type);
+			if (size_t(end - data) / record_size >= element.m_count && load_triangles(element, data, offset, record_size, info)) {
+				data += element.m_count * record_size;
+				return true;
+			}
+		}
+
+		return !m_bad_index && load_polygons(element, *indices, data, end, info);
+	}
+
+	// returns false if not all faces are triangles
+	bool load_triangles(const PlyElement &element, const uint8_t *data, size_t list_offset, size_t record_size,
+						MeshInfo &info) {
+		const auto &prop = element.m_properties.back();
+		const auto count_size = ply_type_size(prop.m_count_type);
+		const auto index_size = ply_type_size(prop.m_type);
+		const bool swap_bytes = m_header.m_swap_bytes;
+
+		auto first = m_geometry.append_triangles(element.m_count);
+		info.m_triangle_count = static_cast<uint32_t>(element.m_count);
+
+		std::atomic<bool> not_triangles = false;
+		std::atomic<bool> bad_index = false;
+
+		// when a face isn't a triangle the chunks after it don't start at a record boundary and read garbage,
+		//	so invalid indices are only reported when all faces turned out to be triangles
+		parallel_ranges(m_pool, element.m_count, PLY_CHUNK_ELEMENTS, [&](size_t begin, size_t count) {
+			const auto *record = data + begin * record_size + list_offset;
+
+			for (size_t i = begin; i < begin + count; ++i, record += record_size) {
+				if (ply_read<uint32_t>(record, prop.m_count_type, swap_bytes) != 3) {
+					not_triangles = true;
+					return;
+				}
+
+				uint32_t v[3];
+				for (int j = 0; j < 3; ++j) {
+					v[j] = ply_read<uint32_t>(record + count_size + size_t(j) * index_size, prop.m_type, swap_bytes);
+				}
+
+				if (!store_triangle(static_cast<uint32_t>(first + i), v[0], v[1], v[2])) {
+					bad_index = true;
+					return;
+				}
+			}
+		});
+
+		if (not_triangles) {
+			// the triangles that were already allocated are reused by load_polygons
+			m_first_triangle = first;
+			return false;
+		}
+
+		if (bad_index) {
+			fprintf(stderr, "'%s': invalid vertex index in face\n", m_filename);
+			m_bad_index = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool load_polygons(const PlyElement &element, const PlyProperty &indices, const uint8_t *&data, const uint8_t *end,
+					   MeshInfo &info) {
+		const auto *start = data;
+		const bool swap_bytes = m_header.m_swap_bytes;
+		const auto count_size = ply_type_size(indices.m_count_type);
+		const auto index_size = ply_type_size(indices.m_type);
+
+		// first pass: find the size of the records and count the number of triangles
+		size_t num_triangles = 0;
+
+		for (size_t i = 0; i < element.m_count; ++i) {
+			auto record_size = ply_record_size(element, data, end, swap_bytes);
+			if (record_size == 0) {
+				return truncated();
+			}
+
+			auto num_indices = face_indices(element, data, nullptr);
+			if (num_indices < 3) {
+				fprintf(stderr, "'%s': face %zu has less than 3 vertices\n", m_filename, i);
+				return false;
+			}
+
+			num_triangles += num_indices - 2;
+			data += record_size;
+		}
+
+		// second pass: triangulate (the fast path might already have allocated part of the triangles)
+		auto first = m_first_triangle;
+		if (first == UINT32_MAX) {
+			first = m_geometry.append_triangles(num_triangles);
+		} else {
+			m_geometry.append_triangles(num_triangles - element.m_count);
+		}
+		info.m_first_triangle = first;
+		info.m_triangle_count = static_cast<uint32_t>(num_triangles);
+
+		auto index = first;
+		data = start;
+
+		for (size_t i = 0; i < element.m_count; ++i) {
+			const uint8_t *list = nullptr;
+			auto num_indices = face_indices(element, data, &list);
+
+			auto read_index = [&](size_t j) {
+				return ply_read<uint32_t>(list + count_size + j * index_size, indices.m_type, swap_bytes);
+			};
+
+			auto v0 = read_index(0);
+			for (size_t j = 1; j + 1 < num_indices; ++j) {
+				if (!set_triangle(index++, v0, read_index(j), read_index(j + 1))) {
+					return false;
+				}
+			}
+
+			data += ply_record_size(element, data, end, swap_bytes);
+		}
+
+		return true;
+	}
+
+	// number of vertex indices of the face record (optionally returns the start of the list)
+	size_t face_indices(const PlyElement &element, const uint8_t *record, const uint8_t **list) const {
+		for (const auto &prop : element.m_properties) {
+			if (prop.m_count_type == PlyType::INVALID) {
+				record += ply_type_size(prop.m_type);
+				continue;
+			}
+
+			auto count = ply_read<size_t>(record, prop.m_count_type, m_header.m_swap_bytes);
+			if (prop.m_name == "vertex_indices" || prop.m_name == "vertex_index") {
+				if (list) {
+					*list = record;
+				}
+				return count;
+			}
+			record += ply_type_size(prop.m_count_type) + count * ply_type_size(prop.m_type);
+		}
+
+		return 0;
+	}
+
+	bool set_triangle(uint32_t index, uint32_t v0, uint32_t v1, uint32_t v2) {
+		if (!store_triangle(index, v0, v1, v2)) {
+			if (!m_bad_index.exchange(true)) {
+				fprintf(stderr, "'%s': invalid vertex index in face\n", m_filename);
+			}
+			return false;
+		}
+		return true;
+	}
+
+	// returns false (without reporting it) when an index is out of range
+	bool store_triangle(uint32_t index, uint32_t v0, uint32_t v1, uint32_t v2) {
+		if (v0 >= m_vertex_count || v1 >= m_vertex_count || v2 >= m_vertex_count) {
+			return false;
+		}
+
+		// the indices in the file are relative to the vertices of this mesh
+		const auto base = m_vertex_base;
+		m_geometry.set_triangle(index, base + v0, base + v1, base + v2, m_material);
+		return true;
+	}
+
+	bool skip_element(const PlyElement &element, const uint8_t *&data, const uint8_t *end) {
+		if (element.m_record_size > 0) {
+			if (size_t(end - data) / element.m_record_size < element.m_count) {
+				return truncated();
+			}
+			data += element.m_count * element.m_record_size;
+			return true;
+		}
+
+		for (size_t i = 0; i < element.m_count; ++i) {
+			auto record_size = ply_record_size(element, data, end, m_header.m_swap_bytes);
+			if (record_size == 0) {
+				return truncated();
+			}
+			data += record_size;
+		}
+
+		return true;
+	}
+
+private:
+	const MappedFile &		m_file;
+	const char *			m_filename;
+	ThreadPool &			m_pool;
+	GeometryTriangles &		m_geometry;
+	material_id_t			m_material;
+	PlyHeader				m_header;
+
+	uint32_t				m_vertex_base = 0;
+	size_t					m_vertex_count = 0;
+	uint32_t				m_first_triangle = UINT32_MAX;
+	std::atomic<bool>		m_bad_index = false;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Wavefront OBJ
+//
+
+struct ObjChunk {
+	const char *	m_begin;
+	const char *	m_end;
+	size_t			m_first_vertex = 0;		// number of vertices in the file before this chunk
+	size_t			m_num_vertices = 0;
+	size_t			m_first_triangle = 0;	// number of triangles in the file before this chunk
+	size_t			m_num_triangles = 0;
+};
+
+inline bool obj_is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *obj_skip_space(const char *pos, const char *end) {
+	while (pos < end && obj_is_space(*pos)) {
+		++pos;
+	}
+	return pos;
+}
+
+inline const char *obj_skip_token(const char *pos, const char *end) {
+	while (pos < end && !obj_is_space(*pos) && *pos != '\n') {
+		++pos;
+	}
+	return pos;
+}
+
+inline const char *obj_line_end(const char *pos, const char *end) {
+	const auto *eol = static_cast<const char *>(memchr(pos, '\n', size_t(end - pos)));
+	return (eol != nullptr) ? eol : end;
+}
+
+// end of the statement on a line, without a trailing comment
+inline const char *obj_strip_comment(const char *pos, const char *eol) {
+	const auto *comment = static_cast<const char *>(memchr(pos, '#', size_t(eol - pos)));
+	return (comment != nullptr) ? comment : eol;
+}
+
+// type of the line that starts at pos ('v' for a vertex position, 'f' for a face, 0 for anything else)
+inline char obj_line_type(const char *pos, const char *end) {
+	if (end - pos >= 2 && (pos[0] == 'v' || pos[0] == 'f') && obj_is_space(pos[1])) {
+		return pos[0];
+	}
+	return 0;
+}
+
+inline size_t obj_count_tokens(const char *pos, const char *end) {
+	size_t count = 0;
+	for (pos = obj_skip_space(pos, end); pos < end; pos = obj_skip_space(obj_skip_token(pos, end), end)) {
+		++count;
+	}
+	return count;
+}
+
+class ObjLoader {
+public:
+	ObjLoader(const MappedFile &file, const char *filename, ThreadPool &pool, GeometryTriangles &geometry, material_id_t material) :
+		m_file(file), m_filename(filename), m_pool(pool), m_geometry(geometry), m_material(material) {
+	}
+
+	bool load(MeshInfo &info) {
+		const auto *text = reinterpret_cast<const char *>(m_file.data());
+		const auto *end = text + m_file.size();
+
+		// split into chunks at line boundaries
+		std::vector<ObjChunk> chunks;
+
+		for (const char *begin = text; begin < end; ) {
+			const char *chunk_end = begin + std::min(OBJ_CHUNK_BYTES, size_t(end - begin));
+			if (chunk_end < end) {
+				chunk_end = obj_line_end(chunk_end, end);
+				chunk_end += (chunk_end < end) ? 1 : 0;
+			}
+			chunks.push_back({begin, chunk_end});
+			begin = chunk_end;
+		}
+
+		// first pass: count the vertices and triangles in each chunk
+		parallel_ranges(m_pool, chunks.size(), 1, [&chunks](size_t c, size_t) {
+			count_chunk(chunks[c]);
+		});
+
+		size_t num_vertices = 0, num_triangles = 0;
+		for (auto &chunk : chunks) {
+			chunk.m_first_vertex = num_vertices;
+			chunk.m_first_triangle = num_triangles;
+			num_vertices += chunk.m_num_vertices;
+			num_triangles += chunk.m_num_triangles;
+		}
+
+		m_vertex_count = num_vertices;
+		m_vertex_base = m_geometry.append_vertices(num_vertices);
+		m_triangle_base = m_geometry.append_triangles(num_triangles);
+
+		info.m_first_vertex = m_vertex_base;
+		info.m_vertex_count = static_cast<uint32_t>(num_vertices);
+		info.m_first_triangle = m_triangle_base;
+		info.m_triangle_count = static_cast<uint32_t>(num_triangles);
+
+		// second pass: parse straight into the geometry
+		parallel_ranges(m_pool, chunks.size(), 1, [this, &chunks](size_t c, size_t) {
+			parse_chunk(chunks[c]);
+		});
+
+		return !m_error;
+	}
+
+private:
+	static void count_chunk(ObjChunk &chunk) {
+		for (const char *line = chunk.m_begin; line < chunk.m_end; ) {
+			const char *eol = obj_line_end(line, chunk.m_end);
+
+			switch (obj_line_type(line, eol)) {
+				case 'v':
+					++chunk.m_num_vertices;
+					break;
+				case 'f': {
+					auto num_indices = obj_count_tokens(line + 1, obj_strip_comment(line + 1, eol));
+					chunk.m_num_triangles += (num_indices >= 3) ? num_indices - 2 : 0;
+					break;
+				}
+				default:
+					break;
+			}
+
+			line = eol + 1;
+		}
+	}
+
+	void parse_chunk(const ObjChunk &chunk) {
+		auto vertex_index = chunk.m_first_vertex;
+		auto triangle_index = m_triangle_base + chunk.m_first_triangle;
+		for (const char *line = chunk.m_begin; line < chunk.m_end && !m_error; ) {
+			const char *eol = obj_line_end(line, chunk.m_end);
+
+			switch (obj_line_type(line, eol)) {
+				case 'v': {
+					float coord[3];
+					const char *pos = line + 1;
+
+					for (auto &c : coord) {
+						pos = obj_skip_space(pos, eol);
+						auto result = std::from_chars(pos, eol, c);
+						if (result.ec != std::errc()) {
+							error("invalid vertex", line, eol);
+							return;
+						}
+						pos = result.ptr;
+					}
+
+					m_geometry.set_vertex(static_cast<uint32_t>(m_vertex_base + vertex_index), {coord[0], coord[1], coord[2]});
+					++vertex_index;
+					break;
+				}
+
+				case 'f': {
+					// triangulate as a fan around the first vertex
+					uint32_t first = 0, previous = 0;
+					size_t count = 0;
+					const char *face_end = obj_strip_comment(line + 1, eol);
+
+					for (const char *pos = obj_skip_space(line + 1, face_end); pos < face_end; pos = obj_skip_space(obj_skip_token(pos, face_end), face_end)) {
+						int64_t index = 0;
+						auto result = std::from_chars(pos, face_end, index);
+
+						// relative indices refer to the vertices defined before this line
+						if (index < 0) {
+							index += int64_t(vertex_index) + 1;
+						}
+
+						if (result.ec != std::errc() || index <= 0 || size_t(index) > m_vertex_count) {
+							error("invalid face", line, eol);
+							return;
+						}
+
+						auto current = static_cast<uint32_t>(m_vertex_base + size_t(index) - 1);
+
+						if (count == 0) {
+							first = current;
+						} else if (count >= 2) {
+							m_geometry.set_triangle(static_cast<uint32_t>(triangle_index++), first, previous, current, m_material);
+						}
+
+						previous = current;
+						++count;
+					}
+					break;
+				}
+
+				default:
+					break;
+			}
+
+			line = eol + 1;
+		}
+	}
+
+	void error(const char *message, const char *line, const char *eol) {
+		if (!m_error.exchange(true)) {
+			fprintf(stderr, "'%s': %s '%.*s'\n", m_filename, message, int(std::min<ptrdiff_t>(eol - line, 80)), line);
+		}
+	}
+
+private:
+	const MappedFile &		m_file;
+	const char *			m_filename;
+	ThreadPool &			m_pool;
+	GeometryTriangles &		m_geometry;
+	material_id_t			m_material;
+
+	uint32_t				m_vertex_base = 0;
+	size_t					m_vertex_count = 0;
+	uint32_t				m_triangle_base = 0;
+	std::atomic<bool>		m_error = false;
+};
+
+} // unnamed namespace
+
+bool load_mesh(Scene &scene, const char *filename, material_id_t material, ThreadPool &pool, MeshInfo *info) {
+
+	const bool is_ply = has_extension(filename, ".ply");
+	if (!is_ply && !has_extension(filename, ".obj")) {
+		fprintf(stderr, "'%s': unknown mesh format (supported: .ply, .obj)\n", filename);
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(filename)) {
+		return false;
+	}
+
+	MeshInfo mesh_info;
+	bool ok = false;
+
+	if (is_ply) {
+		PlyLoader loader(file, filename, pool, scene.triangles_modify(), material);
+		ok = loader.load(mesh_info);
+	} else {
+		ObjLoader loader(file, filename, pool, scene.triangles_modify(), material);
+		ok = loader.load(mesh_info);
+	}
+
+	if (info != nullptr) {
+		*info = mesh_info;
+	}
+
+	return ok;
+}
+
+} // namespace rtiow
@@ -0,0 +1,28 @@
+// common/mesh_io.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// loading triangle meshes from disk
+//	The file is memory mapped and parsed straight into the triangle storage of the scene, large files are split into
+//	chunks that are parsed in parallel on the thread pool.
+
+#pragma once
+
+#include <raytrace/scene.h>
+
+namespace rtiow {
+
+class ThreadPool;
+
+// part of the scene geometry that was created by the loader
+struct MeshInfo {
+	uint32_t	m_first_vertex = 0;
+	uint32_t	m_vertex_count = 0;
+	uint32_t	m_first_triangle = 0;
+	uint32_t	m_triangle_count = 0;
+};
+
+// load a mesh, the format is derived from the extension: binary PLY (.ply) or Wavefront OBJ (.obj)
+//	All triangles get the same material, polygons are triangulated as a fan. Returns false (after printing an error)
+//	when the file can't be loaded, the scene might contain part of the mesh in that case.
+bool load_mesh(Scene &scene, const char *filename, material_id_t material, ThreadPool &pool, MeshInfo *info = nullptr);
+
+} // namespace rtiow
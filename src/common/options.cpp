@@ -0,0 +1,313 @@
+// common/options.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "options.h"
+
+#include <charconv>
+#include <cstdio>
+
+namespace rtiow {
+
+namespace {
+
+// command line arguments
+static constexpr argh_list_t ARG_RESOLUTION_X = {"-x", "--resolution-x"};
+static constexpr argh_list_t ARG_RESOLUTION_Y = {"-y", "--resolution-y"};
+static constexpr argh_list_t ARG_SAMPLES_PER_PIXEL = {"-s", "--samples-per-pixel"};
+static constexpr argh_list_t ARG_SAMPLER = {"--sampler"};
+static constexpr argh_list_t ARG_MAX_RAY_BOUNCES = {"-b", "--max-ray-bounces"};
+static constexpr argh_list_t ARG_RUSSIAN_ROULETTE = {"--russian-roulette"};
+static constexpr argh_list_t ARG_SAMPLES_PER_PASS = {"--pass-samples"};
+static constexpr argh_list_t ARG_TIME_BUDGET = {"--time-budget"};
+static constexpr argh_list_t ARG_ADAPTIVE_THRESHOLD = {"--adaptive-threshold"};
+static constexpr argh_list_t ARG_ADAPTIVE_MIN_SAMPLES = {"--adaptive-min-samples"};
+static constexpr argh_list_t ARG_ADAPTIVE_MAX_SAMPLES = {"--adaptive-max-samples"};
+static constexpr argh_list_t ARG_TILE_SIZE = {"--tile-size"};
+static constexpr argh_list_t ARG_TILE_ORDER = {"--tile-order"};
+static constexpr argh_list_t ARG_NO_TILE_SPLIT = {"--no-tile-split"};
+static constexpr argh_list_t ARG_NO_LIGHT_SAMPLING = {"--no-light-sampling"};
+static constexpr argh_list_t ARG_NO_PACKETS = {"--no-packets"};
+static constexpr argh_list_t ARG_INTEGRATOR = {"--integrator"};
+static constexpr argh_list_t ARG_WAVEFRONT_BATCH = {"--wavefront-batch"};
+static constexpr argh_list_t ARG_RENDER_WORKERS = {"-w", "--render-workers"};
+static constexpr argh_list_t ARG_THREADS_IGNORE = {"--threads-ignore"};
+static constexpr argh_list_t ARG_THREADS_PERCENT = {"--threads-percentage"};
+static constexpr argh_list_t ARG_SCENE = {"--scene"};
+static constexpr argh_list_t ARG_SCENE_SIZE = {"--scene-size"};
+static constexpr argh_list_t ARG_NO_SCENE_CACHE = {"--no-scene-cache"};
+static constexpr argh_list_t ARG_MESH = {"--mesh"};
+static constexpr argh_list_t ARG_ACCELERATION = {"--acceleration"};
+static constexpr argh_list_t ARG_BVH_BUILDER = {"--bvh-builder"};
+static constexpr argh_list_t ARG_HELP = {"-h", "--help"};
+
+bool parse_acceleration(const std::string &name, AccelerationStructure &acceleration) {
+	if (name == "none") {
+		acceleration = AccelerationStructure::NONE;
+	} else if (name == "bvh") {
+		acceleration = AccelerationStructure::BVH;
+	} else if (name == "bvh4") {
+		acceleration = AccelerationStructure::BVH4;
+	} else if (name == "bvh8") {
+		acceleration = AccelerationStructure::BVH8;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+bool parse_bvh_builder(const std::string &name, BVHBuilder &builder) {
+	if (name == "sweep") {
+		builder = BVHBuilder::SWEEP;
+	} else if (name == "binned") {
+		builder = BVHBuilder::BINNED;
+	} else if (name == "lbvh") {
+		builder = BVHBuilder::LBVH;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+bool parse_tile_order(const std::string &name, TileOrder &order) {
+	if (name == "rows") {
+		order = TileOrder::ROWS;
+	} else if (name == "center") {
+		order = TileOrder::CENTER;
+	} else if (name == "hilbert") {
+		order = TileOrder::HILBERT;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+bool parse_sampler(const std::string &name, SamplerType &sampler) {
+	if (name == "random") {
+		sampler = SamplerType::RANDOM;
+	} else if (name == "stratified") {
+		sampler = SamplerType::STRATIFIED;
+	} else if (name == "sobol") {
+		sampler = SamplerType::SOBOL;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+bool parse_integrator(const std::string &name, Integrator &integrator) {
+	if (name == "megakernel") {
+		integrator = Integrator::MEGAKERNEL;
+	} else if (name == "wavefront") {
+		integrator = Integrator::WAVEFRONT;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+} // unnamed namespace
+
+void options_add_params(argh::parser &cmd_line) {
+	cmd_line.add_params(ARG_RESOLUTION_X);
+	cmd_line.add_params(ARG_RESOLUTION_Y);
+	cmd_line.add_params(ARG_SAMPLES_PER_PIXEL);
+	cmd_line.add_params(ARG_SAMPLER);
+	cmd_line.add_params(ARG_MAX_RAY_BOUNCES);
+	cmd_line.add_params(ARG_RUSSIAN_ROULETTE);
+	cmd_line.add_params(ARG_SAMPLES_PER_PASS);
+	cmd_line.add_params(ARG_TIME_BUDGET);
+	cmd_line.add_params(ARG_ADAPTIVE_THRESHOLD);
+	cmd_line.add_params(ARG_ADAPTIVE_MIN_SAMPLES);
+	cmd_line.add_params(ARG_ADAPTIVE_MAX_SAMPLES);
+	cmd_line.add_params(ARG_TILE_SIZE);
+	cmd_line.add_params(ARG_TILE_ORDER);
+	cmd_line.add_params(ARG_INTEGRATOR);
+	cmd_line.add_params(ARG_WAVEFRONT_BATCH);
+	cmd_line.add_params(ARG_RENDER_WORKERS);
+	cmd_line.add_params(ARG_THREADS_IGNORE);
+	cmd_line.add_params(ARG_THREADS_PERCENT);
+	cmd_line.add_params(ARG_SCENE);
+	cmd_line.add_params(ARG_SCENE_SIZE);
+	cmd_line.add_params(ARG_MESH);
+	cmd_line.add_params(ARG_ACCELERATION);
+	cmd_line.add_params(ARG_BVH_BUILDER);
+	cmd_line.add_params(ARG_HELP);
+}
+
+bool options_parse(const argh::parser &cmd_line, Options &options) {
+
+	auto &config = options.m_raytracer;
+
+	cmd_line(ARG_RESOLUTION_X, config.m_render_resolution_x) >> config.m_render_resolution_x;
+	cmd_line(ARG_RESOLUTION_Y, config.m_render_resolution_y) >> config.m_render_resolution_y;
+	cmd_line(ARG_SAMPLES_PER_PIXEL, config.m_samples_per_pixel) >> config.m_samples_per_pixel;
+	cmd_line(ARG_MAX_RAY_BOUNCES, config.m_max_ray_bounces) >> config.m_max_ray_bounces;
+	cmd_line(ARG_RUSSIAN_ROULETTE, config.m_russian_roulette_depth) >> config.m_russian_roulette_depth;
+	cmd_line(ARG_SAMPLES_PER_PASS, config.m_samples_per_pass) >> config.m_samples_per_pass;
+	cmd_line(ARG_TIME_BUDGET, config.m_time_budget_ms) >> config.m_time_budget_ms;
+	cmd_line(ARG_ADAPTIVE_THRESHOLD, config.m_adaptive_threshold) >> config.m_adaptive_threshold;
+	cmd_line(ARG_ADAPTIVE_MIN_SAMPLES, config.m_adaptive_min_samples) >> config.m_adaptive_min_samples;
+	cmd_line(ARG_ADAPTIVE_MAX_SAMPLES, config.m_adaptive_max_samples) >> config.m_adaptive_max_samples;
+	cmd_line(ARG_TILE_SIZE, config.m_tile_size) >> config.m_tile_size;
+	config.m_tile_split = config.m_tile_split && !cmd_line[ARG_NO_TILE_SPLIT];
+	config.m_light_sampling = config.m_light_sampling && !cmd_line[ARG_NO_LIGHT_SAMPLING];
+	config.m_packet_tracing = config.m_packet_tracing && !cmd_line[ARG_NO_PACKETS];
+	cmd_line(ARG_WAVEFRONT_BATCH, config.m_wavefront_batch_size) >> config.m_wavefront_batch_size;
+	cmd_line(ARG_RENDER_WORKERS, config.m_num_render_workers) >> config.m_num_render_workers;
+	cmd_line(ARG_THREADS_IGNORE, config.m_threads_ignore) >> config.m_threads_ignore;
+	cmd_line(ARG_THREADS_PERCENT, config.m_threads_use_percent) >> config.m_threads_use_percent;
+
+	std::string acceleration;
+	cmd_line(ARG_ACCELERATION, "bvh") >> acceleration;
+	if (!parse_acceleration(acceleration, config.m_acceleration)) {
+		fprintf(stderr, "Unknown acceleration structure '%s'\n", acceleration.c_str());
+		return false;
+	}
+
+	std::string bvh_builder;
+	cmd_line(ARG_BVH_BUILDER) >> bvh_builder;
+	if (!bvh_builder.empty() && !parse_bvh_builder(bvh_builder, config.m_bvh_builder)) {
+		fprintf(stderr, "Unknown BVH builder '%s'\n", bvh_builder.c_str());
+		return false;
+	}
+
+	std::string sampler;
+	cmd_line(ARG_SAMPLER) >> sampler;
+	if (!sampler.empty() && !parse_sampler(sampler, config.m_sampler)) {
+		fprintf(stderr, "Unknown sampler '%s'\n", sampler.c_str());
+		return false;
+	}
+
+	std::string tile_order;
+	cmd_line(ARG_TILE_ORDER) >> tile_order;
+	if (!tile_order.empty() && !parse_tile_order(tile_order, config.m_tile_order)) {
+		fprintf(stderr, "Unknown tile order '%s'\n", tile_order.c_str());
+		return false;
+	}
+
+	std::string integrator;
+	cmd_line(ARG_INTEGRATOR) >> integrator;
+	if (!integrator.empty() && !parse_integrator(integrator, config.m_integrator)) {
+		fprintf(stderr, "Unknown integrator '%s'\n", integrator.c_str());
+		return false;
+	}
+
+	// the scene is either the id of a built-in scene or the path of a scene description
+	std::string scene;
+	cmd_line(ARG_SCENE) >> scene;
+	if (!scene.empty() && scene.find_first_not_of("0123456789") == std::string::npos) {
+		auto result = std::from_chars(scene.data(), scene.data() + scene.size(), options.m_scene);
+		if (result.ec != std::errc()) {
+			fprintf(stderr, "Invalid scene id '%s'\n", scene.c_str());
+			return false;
+		}
+	} else if (!scene.empty()) {
+		options.m_scene_file = scene;
+	}
+
+	options.m_scene_cache = !cmd_line[ARG_NO_SCENE_CACHE];
+	cmd_line(ARG_SCENE_SIZE, options.m_scene_size) >> options.m_scene_size;
+	cmd_line(ARG_MESH, options.m_mesh_file) >> options.m_mesh_file;
+
+	if (config.m_adaptive_threshold < 0.0f) {
+		fprintf(stderr, "Invalid adaptive sampling threshold %f\n", double(config.m_adaptive_threshold));
+		return false;
+	}
+
+	if (config.m_tile_size == 0) {
+		fprintf(stderr, "Invalid tile size %u\n", config.m_tile_size);
+		return false;
+	}
+
+	if (config.m_wavefront_batch_size == 0) {
+		fprintf(stderr, "Invalid wavefront batch size %u\n", config.m_wavefront_batch_size);
+		return false;
+	}
+
+	if (config.m_render_resolution_x == 0 || config.m_render_resolution_y == 0) {
+		fprintf(stderr, "Invalid output resolution %dx%d\n", config.m_render_resolution_x, config.m_render_resolution_y);
+		return false;
+	}
+
+	return true;
+}
+
+void options_print_help(const Options &defaults) {
+	const auto &config = defaults.m_raytracer;
+
+	printf(" %-25s set horizontal resolution in pixels of output (%d)\n",
+			format_argh_list(ARG_RESOLUTION_X).c_str(), config.m_render_resolution_x);
+	printf(" %-25s set vertical resolution in pixels of output (%d)\n",
+			format_argh_list(ARG_RESOLUTION_Y).c_str(), config.m_render_resolution_y);
+	printf(" %-25s number of sample points per pixel (%d)\n",
+			format_argh_list(ARG_SAMPLES_PER_PIXEL).c_str(), config.m_samples_per_pixel);
+	printf(" %-25s distribution of the samples of a pixel [random,stratified,sobol] (%s)\n", format_argh_list(ARG_SAMPLER).c_str(),
+			config.m_sampler == SamplerType::RANDOM ? "random" : (config.m_sampler == SamplerType::STRATIFIED ? "stratified" : "sobol"));
+	printf(" %-25s maximum number of ray-bounces (%d)\n",
+			format_argh_list(ARG_MAX_RAY_BOUNCES).c_str(), config.m_max_ray_bounces);
+	printf(" %-25s number of ray-bounces before russian roulette path termination starts (%d, 0 = disabled)\n",
+			format_argh_list(ARG_RUSSIAN_ROULETTE).c_str(), config.m_russian_roulette_depth);
+	printf(" %-25s progressive rendering: samples per pixel in each pass (%u, 0 = single pass)\n",
+			format_argh_list(ARG_SAMPLES_PER_PASS).c_str(), config.m_samples_per_pass);
+	printf(" %-25s progressive rendering: stop after the pass that exceeds this time in ms (%u, 0 = no limit)\n",
+			format_argh_list(ARG_TIME_BUDGET).c_str(), config.m_time_budget_ms);
+	printf(" %-25s adaptive sampling: relative error at which a pixel has converged (%.3f, 0 = disabled)\n",
+			format_argh_list(ARG_ADAPTIVE_THRESHOLD).c_str(), double(config.m_adaptive_threshold));
+	printf(" %-25s adaptive sampling: minimum samples per pixel (%u)\n",
+			format_argh_list(ARG_ADAPTIVE_MIN_SAMPLES).c_str(), config.m_adaptive_min_samples);
+	printf(" %-25s adaptive sampling: maximum samples per pixel (%u, 0 = 4x samples-per-pixel)\n",
+			format_argh_list(ARG_ADAPTIVE_MAX_SAMPLES).c_str(), config.m_adaptive_max_samples);
+	printf(" %-25s size of the square tiles the image is divided in (%u)\n",
+			format_argh_list(ARG_TILE_SIZE).c_str(), config.m_tile_size);
+	printf(" %-25s order in which the tiles are rendered [rows,center,hilbert] (%s)\n", format_argh_list(ARG_TILE_ORDER).c_str(),
+			config.m_tile_order == TileOrder::ROWS ? "rows" : (config.m_tile_order == TileOrder::CENTER ? "center" : "hilbert"));
+	printf(" %-25s progressive rendering: don't split tiles that took much longer than average in the previous pass\n",
+			format_argh_list(ARG_NO_TILE_SPLIT).c_str());
+	printf(" %-25s don't sample the emissive spheres directly, lights are only found by the scattered rays\n",
+			format_argh_list(ARG_NO_LIGHT_SAMPLING).c_str());
+	printf(" %-25s trace the primary rays one by one instead of in packets\n", format_argh_list(ARG_NO_PACKETS).c_str());
+	printf(" %-25s integrator [megakernel,wavefront] (%s)\n", format_argh_list(ARG_INTEGRATOR).c_str(),
+			config.m_integrator == Integrator::MEGAKERNEL ? "megakernel" : "wavefront");
+	printf(" %-25s wavefront integrator: number of paths traced together (%u)\n",
+			format_argh_list(ARG_WAVEFRONT_BATCH).c_str(), config.m_wavefront_batch_size);
+	printf(" %-25s id of the scene to render [(1),2,3 (scene 2 with triangle meshes),4 (room lit by a small light)] or the path of a scene description\n",
+			format_argh_list(ARG_SCENE).c_str());
+	printf(" %-25s don't use (or write) the binary cache of a scene description\n", format_argh_list(ARG_NO_SCENE_CACHE).c_str());
+	printf(" %-25s size of the grid of random spheres in scene 2 and 3 (%d => %dx%d spheres)\n", format_argh_list(ARG_SCENE_SIZE).c_str(),
+			defaults.m_scene_size, 2 * defaults.m_scene_size, 2 * defaults.m_scene_size);
+	printf(" %-25s render a triangle mesh (binary .ply or .obj file) instead of a built-in scene\n",
+			format_argh_list(ARG_MESH).c_str());
+	printf(" %-25s acceleration structure [none,(bvh),bvh4,bvh8] (bvh4/8: wide BVH with 4/8 children per node)\n", format_argh_list(ARG_ACCELERATION).c_str());
+	printf(" %-25s BVH builder [sweep,binned,lbvh] (%s)\n", format_argh_list(ARG_BVH_BUILDER).c_str(),
+			config.m_bvh_builder == BVHBuilder::SWEEP ? "sweep" : (config.m_bvh_builder == BVHBuilder::BINNED ? "binned" : "lbvh"));
+	printf(" %-25s manually set number of render threads (0 = use available hardware threads)\n",
+			format_argh_list(ARG_RENDER_WORKERS).c_str());
+	printf(" %-25s number of hardware threads to ignore and leave available for others (%d)\n",
+			format_argh_list(ARG_THREADS_IGNORE).c_str(), config.m_threads_ignore);
+	printf(" %-25s percentage of available (non-ignored) hardware threads to use (%d)\n",
+			format_argh_list(ARG_THREADS_PERCENT).c_str(), config.m_threads_use_percent);
+	printf(" %-25s show this help text\n", format_argh_list(ARG_HELP).c_str());
+}
+
+std::string format_argh_list(const argh_list_t &args) {
+	std::string result;
+	const char *sepa = "";
+
+	for (const auto &a : args) {
+		result.append(sepa);
+		result.append(a);
+		sepa = ", ";
+	}
+
+	return result;
+}
+
+bool options_help_requested(const argh::parser &cmd_line) {
+	return cmd_line[ARG_HELP];
+}
+
+} // namespace rtiow
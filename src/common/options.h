@@ -0,0 +1,39 @@
+// common/options.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// command line options shared by all front-ends
+
+#pragma once
+
+#include <raytrace/config.h>
+#include <argh/argh.h>
+
+#include <initializer_list>
+#include <string>
+
+namespace rtiow {
+
+using argh_list_t = std::initializer_list<const char *const>;
+
+struct Options {
+	RayTracerConfig	m_raytracer;
+	int				m_scene = 1;				// id of the built-in scene to render
+	std::string		m_scene_file;				// render this scene description instead of a built-in scene (when not empty)
+	bool			m_scene_cache = true;		// use the binary cache of a scene description
+	int				m_scene_size = 11;			// size of the grid of random spheres in scene 2
+	std::string		m_mesh_file;				// render this mesh instead of a built-in scene (when not empty)
+};
+
+// register the shared options with the parser
+void options_add_params(argh::parser &cmd_line);
+
+// fill out the options from the parsed command line, returns false (after printing an error) on invalid input
+bool options_parse(const argh::parser &cmd_line, Options &options);
+
+// print the help text of the shared options
+void options_print_help(const Options &defaults);
+
+// helpers for front-end specific options
+std::string format_argh_list(const argh_list_t &args);
+bool options_help_requested(const argh::parser &cmd_line);
+
+} // namespace rtiow
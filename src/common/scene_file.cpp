@@ -0,0 +1,656 @@
+// common/scene_file.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "scene_file.h"
+#include "mapped_file.h"
+#include "mesh_io.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace rtiow {
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// description
+//
+
+enum class MaterialKind {
+	DIFFUSE, SPECULAR, GENERIC, EMISSIVE
+};
+
+struct MaterialDesc {
+	std::string		m_name;
+	MaterialKind	m_kind;
+	Material		m_params;
+};
+
+struct SphereDesc {
+	point_t			m_center;
+	float			m_radius;
+	uint32_t		m_material;		// index into the materials of the description
+};
+
+struct MeshDesc {
+	std::string		m_filename;
+	uint32_t		m_material;
+};
+
+struct CameraDesc {
+	float			m_vertical_fov = 90.0f;
+	point_t			m_look_from = {0.0f, 0.0f, 0.0f};
+	point_t			m_look_at = {0.0f, 0.0f, -1.0f};
+	vector_t		m_up = {0.0f, 1.0f, 0.0f};
+	float			m_aperture = 0.0f;
+	float			m_focus_distance = 0.0f;
+};
+
+struct SceneDescription {
+	std::vector<MaterialDesc>	m_materials;
+	std::vector<SphereDesc>		m_spheres;
+	std::vector<MeshDesc>		m_meshes;
+	CameraDesc					m_camera;
+	BVHBuilder					m_bvh_builder = BVHBuilder::BINNED;
+	uint64_t					m_key = 0;		// identifies the description and the files it depends on
+};
+
+// FNV-1a
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+	const auto *bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+template <typename T>
+uint64_t hash_value(uint64_t hash, const T &value) {
+	return hash_bytes(hash, &value, sizeof(value));
+}
+
+class SceneParser {
+public:
+	SceneParser(const char *filename, SceneDescription &desc) :
+		m_filename(filename),
+		m_desc(desc) {
+	}
+
+	bool parse(std::string_view text) {
+		while (!text.empty()) {
+			auto eol = text.find('\n');
+			auto line = text.substr(0, eol);
+			text = (eol == std::string_view::npos) ? std::string_view() : text.substr(eol + 1);
+			++m_line_number;
+
+			if (!parse_line(line)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	bool parse_line(std::string_view line) {
+		line = line.substr(0, line.find('#'));
+
+		// split into tokens
+		m_tokens.clear();
+		size_t pos = 0;
+		while (true) {
+			pos = line.find_first_not_of(" \t\r", pos);
+			if (pos == std::string_view::npos) {
+				break;
+			}
+			auto end = line.find_first_of(" \t\r", pos);
+			m_tokens.push_back(line.substr(pos, end - pos));
+			pos = end;
+		}
+
+		if (m_tokens.empty()) {
+			return true;
+		}
+
+		if (m_tokens[0] == "material") {
+			return parse_material();
+		} else if (m_tokens[0] == "sphere") {
+			return parse_sphere();
+		} else if (m_tokens[0] == "mesh") {
+			return parse_mesh();
+		} else if (m_tokens[0] == "camera") {
+			return parse_camera();
+		} else if (m_tokens[0] == "bvh") {
+			return parse_bvh();
+		}
+
+		return error("unknown statement");
+	}
+
+	bool parse_material() {
+		if (m_tokens.size() < 3) {
+			return error("expected: material <name> <type> <parameters>");
+		}
+
+		uint32_t existing;
+		if (find_material(m_tokens[1], existing)) {
+			return error("duplicate material name");
+		}
+
+		MaterialDesc mat = {std::string(m_tokens[1]), MaterialKind::DIFFUSE, {}};
+		auto &p = mat.m_params;
+		p.m_index_of_refraction = 1.0f;
+
+		float values[14];
+
+		if (m_tokens[2] == "diffuse") {
+			if (!parse_floats(3, values, 3)) {
+				return false;
+			}
+			p.m_albedo = {values[0], values[1], values[2]};
+		} else if (m_tokens[2] == "specular") {
+			if (!parse_floats(3, values, 8)) {
+				return false;
+			}
+			mat.m_kind = MaterialKind::SPECULAR;
+			p.m_albedo = {values[0], values[1], values[2]};
+			p.m_specular_chance = values[3];
+			p.m_specular_color = {values[4], values[5], values[6]};
+			p.m_specular_roughness = values[7];
+		} else if (m_tokens[2] == "generic") {
+			if (!parse_floats(3, values, 14)) {
+				return false;
+			}
+			mat.m_kind = MaterialKind::GENERIC;
+			p.m_albedo = {values[0], values[1], values[2]};
+			p.m_specular_chance = values[3];
+			p.m_specular_color = {values[4], values[5], values[6]};
+			p.m_specular_roughness = values[7];
+			p.m_index_of_refraction = values[8];
+			p.m_refraction_chance = values[9];
+			p.m_refraction_color = {values[10], values[11], values[12]};
+			p.m_refraction_roughness = values[13];
+		} else if (m_tokens[2] == "emissive") {
+			if (!parse_floats(3, values, 3)) {
+				return false;
+			}
+			mat.m_kind = MaterialKind::EMISSIVE;
+			p.m_emission = {values[0], values[1], values[2]};
+		} else {
+			return error("unknown material type (expected diffuse, specular, generic or emissive)");
+		}
+
+		m_desc.m_materials.push_back(std::move(mat));
+		return true;
+	}
+
+	bool parse_sphere() {
+		float values[4];
+		SphereDesc sphere;
+
+		if (m_tokens.size() != 6) {
+			return error("expected: sphere <x> <y> <z> <radius> <material>");
+		}
+
+		if (!parse_floats(1, values, 4) || !material_reference(m_tokens[5], sphere.m_material)) {
+			return false;
+		}
+
+		sphere.m_center = {values[0], values[1], values[2]};
+		sphere.m_radius = values[3];
+		m_desc.m_spheres.push_back(sphere);
+		return true;
+	}
+
+	bool parse_mesh() {
+		MeshDesc mesh;
+
+		if (m_tokens.size() != 3) {
+			return error("expected: mesh <filename> <material>");
+		}
+
+		if (!material_reference(m_tokens[2], mesh.m_material)) {
+			return false;
+		}
+
+		// relative paths start from the directory of the scene file
+		std::filesystem::path path(m_tokens[1]);
+		if (path.is_relative()) {
+			path = std::filesystem::path(m_filename).parent_path() / path;
+		}
+
+		mesh.m_filename = path.string();
+		m_desc.m_meshes.push_back(std::move(mesh));
+		return true;
+	}
+
+	bool parse_camera() {
+		float values[12];
+		auto count = m_tokens.size() - 1;
+
+		if (count != 7 && count != 10 && count != 11 && count != 12) {
+			return error("expected: camera <fov> <look-from> <look-at> [<up> [<aperture> [<focus-distance>]]]");
+		}
+
+		if (!parse_floats(1, values, count)) {
+			return false;
+		}
+
+		auto &camera = m_desc.m_camera;
+		camera = CameraDesc();
+		camera.m_vertical_fov = values[0];
+		camera.m_look_from = {values[1], values[2], values[3]};
+		camera.m_look_at = {values[4], values[5], values[6]};
+
+		if (count >= 10) {
+			camera.m_up = {values[7], values[8], values[9]};
+		}
+		if (count >= 11) {
+			camera.m_aperture = values[10];
+		}
+		if (count >= 12) {
+			camera.m_focus_distance = values[11];
+		}
+
+		return true;
+	}
+
+	bool parse_bvh() {
+		if (m_tokens.size() != 2) {
+			return error("expected: bvh <sweep|binned|lbvh>");
+		}
+
+		if (m_tokens[1] == "sweep") {
+			m_desc.m_bvh_builder = BVHBuilder::SWEEP;
+		} else if (m_tokens[1] == "binned") {
+			m_desc.m_bvh_builder = BVHBuilder::BINNED;
+		} else if (m_tokens[1] == "lbvh") {
+			m_desc.m_bvh_builder = BVHBuilder::LBVH;
+		} else {
+			return error("unknown BVH builder", m_tokens[1]);
+		}
+
+		return true;
+	}
+
+	bool parse_floats(size_t first, float *values, size_t count) {
+		if (m_tokens.size() < first + count) {
+			return error("not enough parameters");
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			auto token = m_tokens[first + i];
+			auto result = std::from_chars(token.data(), token.data() + token.size(), values[i]);
+			if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+				return error("invalid number", token);
+			}
+		}
+
+		return true;
+	}
+
+	bool find_material(std::string_view name, uint32_t &index) const {
+		for (size_t i = 0; i < m_desc.m_materials.size(); ++i) {
+			if (m_desc.m_materials[i].m_name == name) {
+				index = static_cast<uint32_t>(i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool material_reference(std::string_view name, uint32_t &index) {
+		if (!find_material(name, index)) {
+			return error("unknown material", name);
+		}
+		return true;
+	}
+
+	bool error(const char *message, std::string_view token = {}) const {
+		if (token.empty()) {
+			fprintf(stderr, "'%s' (line %d): %s\n", m_filename, m_line_number, message);
+		} else {
+			fprintf(stderr, "'%s' (line %d): %s '%.*s'\n", m_filename, m_line_number, message, int(token.size()), token.data());
+		}
+		return false;
+	}
+
+private:
+	const char *					m_filename;
+	SceneDescription &				m_desc;
+	int								m_line_number = 0;
+	std::vector<std::string_view>	m_tokens;
+};
+
+bool parse_description(const char *filename, AccelerationStructure acceleration, BVHBuilder builder, SceneDescription &desc) {
+
+	MappedFile file;
+	if (!file.open(filename)) {
+		return false;
+	}
+
+	std::string_view text(reinterpret_cast<const char *>(file.data()), file.size());
+	desc.m_bvh_builder = builder;
+	SceneParser parser(filename, desc);
+	if (!parser.parse(text)) {
+		return false;
+	}
+
+	// the cache is valid as long as the description, the meshes it refers to and the acceleration structure don't change
+	auto key = hash_bytes(0xcbf29ce484222325ull, text.data(), text.size());
+	key = hash_value(key, acceleration);
+	key = hash_value(key, desc.m_bvh_builder);
+
+	for (const auto &mesh : desc.m_meshes) {
+		std::error_code ec;
+		auto size = std::filesystem::file_size(mesh.m_filename, ec);
+		auto time = std::filesystem::last_write_time(mesh.m_filename, ec).time_since_epoch().count();
+		key = hash_bytes(key, mesh.m_filename.data(), mesh.m_filename.size());
+		key = hash_value(key, size);
+		key = hash_value(key, time);
+	}
+
+	desc.m_key = key;
+	return true;
+}
+
+bool build_scene(Scene &scene, const SceneDescription &desc, AccelerationStructure acceleration, ThreadPool &pool) {
+
+	std::vector<material_id_t> materials;
+	materials.reserve(desc.m_materials.size());
+
+	for (const auto &mat : desc.m_materials) {
+		const auto &p = mat.m_params;
+
+		switch (mat.m_kind) {
+			case MaterialKind::DIFFUSE:
+				materials.push_back(scene.material_create_diffuse(p.m_albedo));
+				break;
+			case MaterialKind::SPECULAR:
+				materials.push_back(scene.material_create_specular(p.m_albedo, p.m_specular_chance, p.m_specular_color,
+																   p.m_specular_roughness));
+				break;
+			case MaterialKind::GENERIC:
+				materials.push_back(scene.material_create(p.m_albedo, p.m_specular_chance, p.m_specular_color, p.m_specular_roughness,
+														  p.m_index_of_refraction,
+														  p.m_refraction_chance, p.m_refraction_color, p.m_refraction_roughness));
+				break;
+			case MaterialKind::EMISSIVE:
+				materials.push_back(scene.material_create_emissive(p.m_emission));
+				break;
+		}
+	}
+
+	for (const auto &sphere : desc.m_spheres) {
+		scene.sphere_add(sphere.m_center, sphere.m_radius, materials[sphere.m_material]);
+	}
+
+	for (const auto &mesh : desc.m_meshes) {
+		if (!load_mesh(scene, mesh.m_filename.c_str(), materials[mesh.m_material], pool)) {
+			return false;
+		}
+	}
+
+	scene.finalize(acceleration, desc.m_bvh_builder, &pool);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// binary cache
+//	A header followed by the flat arrays of the finalized scene, each array starts at a multiple of CACHE_ALIGNMENT
+//	so it can be used straight from the memory mapped file.
+//
+
+static constexpr uint32_t CACHE_MAGIC = 0x43535452;		// "RTSC" (little endian)
+static constexpr uint32_t CACHE_VERSION = 4;
+static constexpr size_t CACHE_ALIGNMENT = 64;
+
+enum CacheSection {
+	SECTION_MATERIALS = 0,
+	SECTION_SPHERES,
+	SECTION_SPHERE_MATERIALS,
+	SECTION_SPHERE_NODES,
+	SECTION_VERTEX_X,
+	SECTION_VERTEX_Y,
+	SECTION_VERTEX_Z,
+	SECTION_TRIANGLES,
+	SECTION_TRIANGLE_NODES,
+	SECTION_COUNT
+};
+
+static constexpr size_t SECTION_ELEMENT_SIZE[SECTION_COUNT] = {
+	sizeof(Material), sizeof(Sphere), sizeof(material_id_t), sizeof(BVHNode), sizeof(float), sizeof(float), sizeof(float), sizeof(Triangle), sizeof(BVHNode)
+};
+
+struct CacheHeader {
+	uint32_t	m_magic;
+	uint32_t	m_version;
+	uint64_t	m_key;
+	uint64_t	m_element_size[SECTION_COUNT];		// rejects caches written by a build with a different memory layout
+	uint64_t	m_offset[SECTION_COUNT];
+	uint64_t	m_count[SECTION_COUNT];
+};
+
+std::string cache_filename(const char *filename) {
+	return std::string(filename) + ".cache";
+}
+
+bool write_cache(const char *filename, const Scene &scene, uint64_t key) {
+
+	const void *data[SECTION_COUNT] = {
+		scene.materials().data(),
+		scene.spheres().sphere_data(),
+		scene.spheres().material_data(),
+		scene.spheres().bvh().nodes().data(),
+		scene.triangles().vertex_coordinates(0).data(),
+		scene.triangles().vertex_coordinates(1).data(),
+		scene.triangles().vertex_coordinates(2).data(),
+		scene.triangles().triangles().data(),
+		scene.triangles().bvh().nodes().data()
+	};
+
+	CacheHeader header = {};
+	header.m_magic = CACHE_MAGIC;
+	header.m_version = CACHE_VERSION;
+	header.m_key = key;
+	header.m_count[SECTION_MATERIALS] = scene.materials().size();
+	header.m_count[SECTION_SPHERES] = scene.spheres().size();
+	header.m_count[SECTION_SPHERE_MATERIALS] = scene.spheres().size();
+	header.m_count[SECTION_SPHERE_NODES] = scene.spheres().bvh().node_count();
+	header.m_count[SECTION_VERTEX_X] = scene.triangles().vertex_count();
+	header.m_count[SECTION_VERTEX_Y] = scene.triangles().vertex_count();
+	header.m_count[SECTION_VERTEX_Z] = scene.triangles().vertex_count();
+	header.m_count[SECTION_TRIANGLES] = scene.triangles().size();
+	header.m_count[SECTION_TRIANGLE_NODES] = scene.triangles().bvh().node_count();
+
+	uint64_t offset = sizeof(CacheHeader);
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		offset = (offset + CACHE_ALIGNMENT - 1) & ~uint64_t(CACHE_ALIGNMENT - 1);
+		header.m_element_size[s] = SECTION_ELEMENT_SIZE[s];
+		header.m_offset[s] = offset;
+		offset += header.m_count[s] * SECTION_ELEMENT_SIZE[s];
+	}
+
+	// write to a temporary file first, a partially written cache should never be picked up
+	auto final_name = cache_filename(filename);
+	auto temp_name = final_name + ".tmp";
+
+	auto *fp = fopen(temp_name.c_str(), "wb");
+	if (fp == nullptr) {
+		return false;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	uint64_t written = sizeof(CacheHeader);
+	static const uint8_t padding[CACHE_ALIGNMENT] = {};
+
+	for (int s = 0; s < SECTION_COUNT && ok; ++s) {
+		auto bytes = header.m_count[s] * SECTION_ELEMENT_SIZE[s];
+		ok = fwrite(padding, 1, header.m_offset[s] - written, fp) == header.m_offset[s] - written;
+		ok = ok && (bytes == 0 || fwrite(data[s], 1, bytes, fp) == bytes);
+		written = header.m_offset[s] + bytes;
+	}
+
+	ok = (fclose(fp) == 0) && ok;
+
+	std::error_code ec;
+	if (ok) {
+		std::filesystem::rename(temp_name, final_name, ec);
+		ok = !ec;
+	}
+
+	if (!ok) {
+		std::filesystem::remove(temp_name, ec);
+	}
+
+	return ok;
+}
+
+// the geometry and the BVH nodes in the cache are used for rendering: make sure a damaged file can't cause out-of-bounds accesses
+//	The builders always store children after their parent, this rules out cycles. Each node should have one parent and
+//	the tree can't be deeper than the traversal stack.
+bool validate_nodes(const BVHNode *nodes, uint64_t node_count, uint64_t primitive_count) {
+	std::vector<uint32_t> depth(node_count, 0);
+	std::vector<uint8_t> has_parent(node_count, 0);
+
+	for (uint64_t n = 0; n < node_count; ++n) {
+		const auto &node = nodes[n];
+
+		if (node.is_leaf()) {
+			if (uint64_t(node.m_first) + node.m_count > primitive_count) {
+				return false;
+			}
+			continue;
+		}
+
+		if (node.m_first <= n || uint64_t(node.m_first) + 1 >= node_count ||
+			has_parent[node.m_first] || has_parent[node.m_first + 1] || depth[n] + 1 >= BVH::STACK_SIZE) {
+			return false;
+		}
+
+		for (uint32_t child = node.m_first; child <= node.m_first + 1; ++child) {
+			has_parent[child] = 1;
+			depth[child] = depth[n] + 1;
+		}
+	}
+	return true;
+}
+
+bool load_cache(Scene &scene, const char *filename, uint64_t key, AccelerationStructure acceleration) {
+
+	auto cache_name = cache_filename(filename);
+
+	std::error_code ec;
+	if (!std::filesystem::exists(cache_name, ec)) {
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(cache_name.c_str()) || file.size() < sizeof(CacheHeader)) {
+		return false;
+	}
+
+	const auto *header = reinterpret_cast<const CacheHeader *>(file.data());
+	if (header->m_magic != CACHE_MAGIC || header->m_version != CACHE_VERSION || header->m_key != key) {
+		return false;
+	}
+
+	const uint8_t *section[SECTION_COUNT];
+
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		if (header->m_element_size[s] != SECTION_ELEMENT_SIZE[s] ||
+			header->m_offset[s] % CACHE_ALIGNMENT != 0 ||
+			header->m_offset[s] > file.size() ||
+			header->m_count[s] > (file.size() - header->m_offset[s]) / SECTION_ELEMENT_SIZE[s]) {
+			return false;
+		}
+		section[s] = file.data() + header->m_offset[s];
+	}
+
+	const auto *materials = reinterpret_cast<const Material *>(section[SECTION_MATERIALS]);
+	const auto *spheres = reinterpret_cast<const Sphere *>(section[SECTION_SPHERES]);
+	const auto *sphere_materials = reinterpret_cast<const material_id_t *>(section[SECTION_SPHERE_MATERIALS]);
+	const auto *sphere_nodes = reinterpret_cast<const BVHNode *>(section[SECTION_SPHERE_NODES]);
+	const auto *vertex_x = reinterpret_cast<const float *>(section[SECTION_VERTEX_X]);
+	const auto *vertex_y = reinterpret_cast<const float *>(section[SECTION_VERTEX_Y]);
+	const auto *vertex_z = reinterpret_cast<const float *>(section[SECTION_VERTEX_Z]);
+	const auto *triangles = reinterpret_cast<const Triangle *>(section[SECTION_TRIANGLES]);
+	const auto *triangle_nodes = reinterpret_cast<const BVHNode *>(section[SECTION_TRIANGLE_NODES]);
+
+	auto material_count = header->m_count[SECTION_MATERIALS];
+	auto vertex_count = header->m_count[SECTION_VERTEX_X];
+
+	if (header->m_count[SECTION_VERTEX_Y] != vertex_count || header->m_count[SECTION_VERTEX_Z] != vertex_count ||
+		header->m_count[SECTION_SPHERE_MATERIALS] != header->m_count[SECTION_SPHERES]) {
+		return false;
+	}
+
+	for (uint64_t i = 0; i < header->m_count[SECTION_SPHERES]; ++i) {
+		if (sphere_materials[i] >= material_count) {
+			return false;
+		}
+	}
+
+	for (uint64_t i = 0; i < header->m_count[SECTION_TRIANGLES]; ++i) {
+		const auto &tri = triangles[i];
+		if (tri.m_material >= material_count ||
+			tri.m_vertex[0] >= vertex_count || tri.m_vertex[1] >= vertex_count || tri.m_vertex[2] >= vertex_count) {
+			return false;
+		}
+	}
+
+	if (!validate_nodes(sphere_nodes, header->m_count[SECTION_SPHERE_NODES], header->m_count[SECTION_SPHERES]) ||
+		!validate_nodes(triangle_nodes, header->m_count[SECTION_TRIANGLE_NODES], header->m_count[SECTION_TRIANGLES])) {
+		return false;
+	}
+
+	// restore the scene
+	for (uint64_t i = 0; i < material_count; ++i) {
+		scene.material_add(materials[i]);
+	}
+
+	scene.spheres_modify().restore(spheres, sphere_materials, header->m_count[SECTION_SPHERES],
+								   sphere_nodes, header->m_count[SECTION_SPHERE_NODES], acceleration);
+	scene.triangles_modify().restore(vertex_x, vertex_y, vertex_z, vertex_count,
+									 triangles, header->m_count[SECTION_TRIANGLES],
+									 triangle_nodes, header->m_count[SECTION_TRIANGLE_NODES], acceleration);
+	scene.finalize_restored();
+
+	return true;
+}
+
+} // unnamed namespace
+
+bool load_scene_file(Scene &scene, const char *filename, float aspect_ratio, AccelerationStructure acceleration,
+					 BVHBuilder builder, ThreadPool &pool, bool use_cache) {
+
+	SceneDescription desc;
+	if (!parse_description(filename, acceleration, builder, desc)) {
+		return false;
+	}
+
+	if (!use_cache || !load_cache(scene, filename, desc.m_key, acceleration)) {
+		if (!build_scene(scene, desc, acceleration, pool)) {
+			return false;
+		}
+
+		if (use_cache && !write_cache(filename, scene, desc.m_key)) {
+			fprintf(stderr, "Warning: unable to write scene cache '%s'\n", cache_filename(filename).c_str());
+		}
+	}
+
+	const auto &camera = desc.m_camera;
+	scene.setup_camera(aspect_ratio, camera.m_vertical_fov, camera.m_look_from, camera.m_look_at, camera.m_up,
+					   camera.m_aperture, camera.m_focus_distance);
+
+	return true;
+}
+
+} // namespace rtiow
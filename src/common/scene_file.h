@@ -0,0 +1,32 @@
+// common/scene_file.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// loading scenes from a text description
+//	One statement per line, '#' starts a comment. Colors are three floats (r g b), positions and vectors three floats (x y z).
+//
+//	material <name> diffuse <albedo>
+//	material <name> specular <albedo> <specular-chance> <specular-color> <specular-roughness>
+//	material <name> generic <albedo> <specular-chance> <specular-color> <specular-roughness> <index-of-refraction>
+//	                        <refraction-chance> <refraction-color> <refraction-roughness>
+//	material <name> emissive <emission>                (a light, spheres with this material are sampled directly)
+//	sphere <center> <radius> <material-name>
+//	mesh <filename> <material-name>                    (binary .ply or .obj, relative to the scene file)
+//	camera <vertical-fov> <look-from> <look-at> [<up> [<aperture> [<focus-distance>]]]
+//	bvh <sweep|binned|lbvh>                            (builder of the BVH, overrides the one requested by the application)
+//
+//	Loading meshes and building the acceleration structures of large scenes takes time. The finalized scene is
+//	therefore written to a binary cache (<filename>.cache) that is reused, with a single memory mapping, until the
+//	description, one of its meshes or the requested acceleration structure (or its builder) changes.
+
+#pragma once
+
+#include <raytrace/scene.h>
+
+namespace rtiow {
+
+class ThreadPool;
+
+// load a scene description into an empty scene and finalize it, returns false (after printing an error) on failure
+bool load_scene_file(Scene &scene, const char *filename, float aspect_ratio, AccelerationStructure acceleration,
+					 BVHBuilder builder, ThreadPool &pool, bool use_cache = true);
+
+} // namespace rtiow
@@ -0,0 +1,316 @@
+// common/scenes.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "scenes.h"
+#include "mesh_io.h"
+
+#include <raytrace/aabb.h>
+#include <raytrace/utils.h>
+
+#include <map>
+#include <vector>
+
+namespace rtiow {
+
+static constexpr uint64_t SCENE_02_SEED = 2021;
+static constexpr uint64_t SCENE_03_SEED = 2022;
+
+// triangle mesh approximating a unit sphere (subdivided icosahedron)
+static void create_icosphere(int subdivisions, std::vector<point_t> &vertices, std::vector<uint32_t> &indices) {
+
+	const float t = (1.0f + glm::sqrt(5.0f)) / 2.0f;
+
+	vertices = {
+		{-1.0f,  t, 0.0f}, { 1.0f,  t, 0.0f}, {-1.0f, -t, 0.0f}, { 1.0f, -t, 0.0f},
+		{0.0f, -1.0f,  t}, {0.0f,  1.0f,  t}, {0.0f, -1.0f, -t}, {0.0f,  1.0f, -t},
+		{ t, 0.0f, -1.0f}, { t, 0.0f,  1.0f}, {-t, 0.0f, -1.0f}, {-t, 0.0f,  1.0f}
+	};
+	for (auto &v : vertices) {
+		v = glm::normalize(v);
+	}
+
+	indices = {
+		0, 11, 5,	0, 5, 1,	0, 1, 7,	0, 7, 10,	0, 10, 11,
+		1, 5, 9,	5, 11, 4,	11, 10, 2,	10, 7, 6,	7, 1, 8,
+		3, 9, 4,	3, 4, 2,	3, 2, 6,	3, 6, 8,	3, 8, 9,
+		4, 9, 5,	2, 4, 11,	6, 2, 10,	8, 6, 7,	9, 8, 1
+	};
+
+	for (int level = 0; level < subdivisions; ++level) {
+		// split each triangle in four, the vertices on shared edges are only created once
+		std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+		std::vector<uint32_t> refined;
+		refined.reserve(indices.size() * 4);
+
+		auto midpoint = [&](uint32_t a, uint32_t b) {
+			auto key = std::make_pair(std::min(a, b), std::max(a, b));
+			auto found = midpoints.find(key);
+			if (found != midpoints.end()) {
+				return found->second;
+			}
+			vertices.push_back(glm::normalize(vertices[a] + vertices[b]));
+			auto index = static_cast<uint32_t>(vertices.size() - 1);
+			midpoints.emplace(key, index);
+			return index;
+		};
+
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			auto a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			auto ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+			refined.insert(refined.end(), {a, ab, ca,	b, bc, ab,	c, ca, bc,	ab, bc, ca});
+		}
+
+		indices = std::move(refined);
+	}
+}
+
+static void mesh_add_sphere(Scene &scene, const std::vector<point_t> &unit_sphere, const std::vector<uint32_t> &indices,
+							const point_t &center, float radius, material_id_t material) {
+	std::vector<point_t> vertices;
+	vertices.reserve(unit_sphere.size());
+	for (const auto &v : unit_sphere) {
+		vertices.push_back(center + radius * v);
+	}
+	scene.mesh_add(vertices, indices, material);
+}
+
+void construct_scene_01(Scene &scene, float aspect_ratio) {
+
+	auto material_ground = scene.material_create_diffuse({0.8f, 0.8f, 0.0f});
+	auto material_center = scene.material_create_diffuse({0.7f, 0.3f, 0.3f});
+	auto material_left   = scene.material_create(	{0.8f, 0.8f, 0.8f},							// albedo
+													0.0f, {1.0f, 1.0f, 1.0f}, 0.01f,			// specular
+													1.5f, 1.00f, {1.0f, 1.0f, 1.0f}, 0.01f);	// refraction
+	auto material_right  = scene.material_create_specular({0.8f, 0.6f, 0.2f}, 1.00f, {0.8f, 0.6f, 0.2f}, 0.20f);
+
+	scene.sphere_add({ 0.0f, -100.5f, -1.0f}, 100.0f, material_ground);
+	scene.sphere_add({ 0.0f,    0.0f, -1.0f},   0.5f, material_center);
+	scene.sphere_add({-1.0f,    0.0f, -1.0f},   0.5f, material_left);
+	scene.sphere_add({-1.0f,    0.0f, -1.0f},  -0.45f, material_left);
+	scene.sphere_add({ 1.0f,    0.0f, -1.0f},   0.5f, material_right);
+
+	scene.setup_camera( aspect_ratio,
+						20.0f,
+						{3.0f, 3.0f, 2.0f},
+						{0.0f, 0.0f, -1.0f},
+						{0.0f, 1.0f, 0.0f},
+						1.0f
+	);
+}
+
+void construct_scene_02(Scene &scene, float aspect_ratio, int scene_size) {
+
+	// fixed seed: the scene is the same for every run
+	RandomGenerator rng(SCENE_02_SEED);
+
+	auto mat_ground = scene.material_create_diffuse({0.5f, 0.5f, 0.5f});
+    scene.sphere_add({0.0f, -1000.0f, 0.0f}, 1000.0f, mat_ground);
+
+	auto extent = static_cast<float>(scene_size);
+
+    for (float a = -extent; a < extent; a++) {
+        for (float b = -extent; b < extent; b++) {
+            auto choose_mat = random_float(rng);
+            point_t center(a + 0.9f*random_float(rng), 0.2f, b + 0.9f * random_float(rng));
+
+            if ((center - point_t(4, 0.2, 0)).length() > 0.9) {
+                if (choose_mat < 0.8f) {
+                    // diffuse
+                    auto albedo = random_vector(rng) * random_vector(rng);
+					auto mat_sphere = scene.material_create_diffuse(albedo);
+					scene.sphere_add(center, 0.2f, mat_sphere);
+                } else if (choose_mat < 0.95f) {
+                    // metal
+                    auto albedo = random_vector(rng, 0.5f, 1.0f);
+                    auto fuzz = random_float(rng, 0.0f, 0.5f);
+					auto mat_sphere = scene.material_create_specular(albedo, 1.0f, {1.0f, 1.0f, 1.0f}, fuzz);
+					scene.sphere_add(center, 0.2f, mat_sphere);
+                } else {
+                    // glass
+					auto mat_sphere = scene.material_create({0.0f, 0.0, 0.0f},							// albedo,
+															0.0f, {1.0f, 1.0f, 1.0f}, 0.00f,			// specular
+															1.5f, 1.0f, {1.0f, 1.0f, 1.0f}, 0.00f);		// refraction
+					scene.sphere_add(center, 0.2f, mat_sphere);
+                }
+            }
+        }
+    }
+
+	auto material_1 = scene.material_create({0.0f, 0.0, 0.0f},							// albedo,
+										   0.0f, {1.0f, 1.0f, 1.0f}, 0.00f,				// specular
+										   1.5f, 1.0f, {1.0f, 1.0f, 1.0f}, 0.00f);		// refraction
+    scene.sphere_add({0.0f, 1.0f, 0.0f}, 1.0f, material_1);
+
+	auto material_2 = scene.material_create_diffuse({0.4f, 0.2f, 0.1f});
+    scene.sphere_add({-4.0f, 1.0f, 0.0f}, 1.0f, material_2);
+
+	auto material_3 = scene.material_create_specular({0.7f, 0.6f, 0.5f}, 1.0f, {0.7f, 0.6f, 0.5f}, 0.0f);
+    scene.sphere_add({4.0f, 1.0f, 0.0f}, 1.0f, material_3);
+
+	scene.setup_camera( aspect_ratio,
+						20.0f,
+						{13.0f, 2.0f, 3.0f},
+						{0.0f, 0.0f, 0.0f},
+						{0.0f, 1.0f, 0.0f},
+						0.1f
+	);
+}
+
+void construct_scene_03(Scene &scene, float aspect_ratio, int scene_size) {
+
+	// the layout of scene 2, but the spheres are made out of triangles (except the ground)
+	RandomGenerator rng(SCENE_03_SEED);
+
+	std::vector<point_t> small_sphere, large_sphere;
+	std::vector<uint32_t> small_indices, large_indices;
+	create_icosphere(2, small_sphere, small_indices);
+	create_icosphere(5, large_sphere, large_indices);
+
+	auto mat_ground = scene.material_create_diffuse({0.5f, 0.5f, 0.5f});
+	scene.sphere_add({0.0f, -1000.0f, 0.0f}, 1000.0f, mat_ground);
+
+	auto extent = static_cast<float>(scene_size);
+
+	for (float a = -extent; a < extent; a++) {
+		for (float b = -extent; b < extent; b++) {
+			auto choose_mat = random_float(rng);
+			point_t center(a + 0.9f * random_float(rng), 0.2f, b + 0.9f * random_float(rng));
+
+			if (glm::length(center - point_t(4, 0.2, 0)) <= 0.9f) {
+				continue;
+			}
+
+			material_id_t mat_sphere;
+
+			if (choose_mat < 0.8f) {
+				// diffuse
+				mat_sphere = scene.material_create_diffuse(random_vector(rng) * random_vector(rng));
+			} else if (choose_mat < 0.95f) {
+				// metal
+				auto albedo = random_vector(rng, 0.5f, 1.0f);
+				auto fuzz = random_float(rng, 0.0f, 0.5f);
+				mat_sphere = scene.material_create_specular(albedo, 1.0f, {1.0f, 1.0f, 1.0f}, fuzz);
+			} else {
+				// glass
+				mat_sphere = scene.material_create({0.0f, 0.0, 0.0f},							// albedo,
+												   0.0f, {1.0f, 1.0f, 1.0f}, 0.00f,			// specular
+												   1.5f, 1.0f, {1.0f, 1.0f, 1.0f}, 0.00f);		// refraction
+			}
+
+			mesh_add_sphere(scene, small_sphere, small_indices, center, 0.2f, mat_sphere);
+		}
+	}
+
+	auto material_1 = scene.material_create({0.0f, 0.0, 0.0f},							// albedo,
+										   0.0f, {1.0f, 1.0f, 1.0f}, 0.00f,				// specular
+										   1.5f, 1.0f, {1.0f, 1.0f, 1.0f}, 0.00f);		// refraction
+	mesh_add_sphere(scene, large_sphere, large_indices, {0.0f, 1.0f, 0.0f}, 1.0f, material_1);
+
+	auto material_2 = scene.material_create_diffuse({0.4f, 0.2f, 0.1f});
+	mesh_add_sphere(scene, large_sphere, large_indices, {-4.0f, 1.0f, 0.0f}, 1.0f, material_2);
+
+	auto material_3 = scene.material_create_specular({0.7f, 0.6f, 0.5f}, 1.0f, {0.7f, 0.6f, 0.5f}, 0.0f);
+	mesh_add_sphere(scene, large_sphere, large_indices, {4.0f, 1.0f, 0.0f}, 1.0f, material_3);
+
+	scene.setup_camera( aspect_ratio,
+						20.0f,
+						{13.0f, 2.0f, 3.0f},
+						{0.0f, 0.0f, 0.0f},
+						{0.0f, 1.0f, 0.0f},
+						0.1f
+	);
+}
+
+void construct_scene_04(Scene &scene, float aspect_ratio) {
+
+	// closed room lit by a small emissive sphere below the ceiling: the sky is never visible
+	auto material_white = scene.material_create_diffuse({0.73f, 0.73f, 0.73f});
+	auto material_red   = scene.material_create_diffuse({0.65f, 0.05f, 0.05f});
+	auto material_green = scene.material_create_diffuse({0.12f, 0.45f, 0.15f});
+	auto material_light = scene.material_create_emissive({40.0f, 36.0f, 30.0f});
+	auto material_glass = scene.material_create({0.0f, 0.0f, 0.0f},							// albedo
+												0.0f, {1.0f, 1.0f, 1.0f}, 0.00f,			// specular
+												1.5f, 1.0f, {1.0f, 1.0f, 1.0f}, 0.00f);		// refraction
+	auto material_metal = scene.material_create_specular({0.8f, 0.8f, 0.8f}, 1.0f, {0.8f, 0.8f, 0.8f}, 0.05f);
+
+	auto add_quad = [&scene](const point_t &p0, const point_t &p1, const point_t &p2, const point_t &p3, material_id_t material) {
+		scene.mesh_add({p0, p1, p2, p3}, {0, 1, 2, 0, 2, 3}, material);
+	};
+
+	const float x0 = -1.0f, x1 = 1.0f, y0 = 0.0f, y1 = 2.0f, z0 = -1.0f, z1 = 4.0f;
+	add_quad({x0, y0, z0}, {x1, y0, z0}, {x1, y0, z1}, {x0, y0, z1}, material_white);		// floor
+	add_quad({x0, y1, z0}, {x1, y1, z0}, {x1, y1, z1}, {x0, y1, z1}, material_white);		// ceiling
+	add_quad({x0, y0, z0}, {x1, y0, z0}, {x1, y1, z0}, {x0, y1, z0}, material_white);		// back
+	add_quad({x0, y0, z1}, {x1, y0, z1}, {x1, y1, z1}, {x0, y1, z1}, material_white);		// front (behind the camera)
+	add_quad({x0, y0, z0}, {x0, y0, z1}, {x0, y1, z1}, {x0, y1, z0}, material_red);		// left
+	add_quad({x1, y0, z0}, {x1, y0, z1}, {x1, y1, z1}, {x1, y1, z0}, material_green);		// right
+
+	scene.sphere_add({ 0.0f,  1.75f, -0.2f}, 0.12f, material_light);
+	scene.sphere_add({-0.45f, 0.35f, -0.4f}, 0.35f, material_white);
+	scene.sphere_add({ 0.45f, 0.35f,  0.1f}, 0.35f, material_glass);
+	scene.sphere_add({ 0.35f, 0.25f, -0.7f}, 0.25f, material_metal);
+
+	scene.setup_camera( aspect_ratio,
+						40.0f,
+						{0.0f, 1.0f, 3.8f},
+						{0.0f, 0.9f, 0.0f},
+						{0.0f, 1.0f, 0.0f}
+	);
+}
+
+bool construct_scene_mesh(Scene &scene, float aspect_ratio, const char *filename, ThreadPool &pool) {
+
+	auto material_mesh = scene.material_create_diffuse({0.7f, 0.7f, 0.7f});
+
+	MeshInfo info;
+	if (!load_mesh(scene, filename, material_mesh, pool, &info)) {
+		return false;
+	}
+
+	AABB bounds;
+	const auto &triangles = scene.triangles();
+	for (uint32_t v = info.m_first_vertex; v < info.m_first_vertex + info.m_vertex_count; ++v) {
+		bounds.grow(triangles.vertex(v));
+	}
+
+	if (bounds.is_empty()) {
+		bounds.grow(point_t(0.0f, 0.0f, 0.0f));
+	}
+
+	// a large sphere acts as the ground plane just below the mesh
+	auto size = glm::max(glm::length(bounds.m_max - bounds.m_min), 0.001f);
+	auto ground_radius = 1000.0f * size;
+	auto material_ground = scene.material_create_diffuse({0.5f, 0.5f, 0.5f});
+	auto center = bounds.centroid();
+	scene.sphere_add({center.x, bounds.m_min.y - ground_radius, center.z}, ground_radius, material_ground);
+
+	// look at the center of the mesh from the front, slightly above it
+	scene.setup_camera( aspect_ratio,
+						30.0f,
+						center + size * vector_t(0.4f, 0.5f, 1.6f),
+						center,
+						{0.0f, 1.0f, 0.0f}
+	);
+
+	return true;
+}
+
+bool construct_scene(Scene &scene, int scene_id, float aspect_ratio, int scene_size) {
+	switch (scene_id) {
+		case 1:
+			construct_scene_01(scene, aspect_ratio);
+			return true;
+		case 2:
+			construct_scene_02(scene, aspect_ratio, scene_size);
+			return true;
+		case 3:
+			construct_scene_03(scene, aspect_ratio, scene_size);
+			return true;
+		case 4:
+			construct_scene_04(scene, aspect_ratio);
+			return true;
+		default:
+			return false;
+	}
+}
+
+} // namespace rtiow
@@ -0,0 +1,22 @@
+// common/scenes.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// built-in scenes, shared by all front-ends
+
+#pragma once
+
+#include <raytrace/scene.h>
+
+namespace rtiow {
+
+void construct_scene_01(Scene &scene, float aspect_ratio);
+void construct_scene_02(Scene &scene, float aspect_ratio, int scene_size);
+void construct_scene_03(Scene &scene, float aspect_ratio, int scene_size);
+void construct_scene_04(Scene &scene, float aspect_ratio);
+
+// construct the scene with the given id, returns false if the id is unknown
+bool construct_scene(Scene &scene, int scene_id, float aspect_ratio, int scene_size);
+
+// a single mesh loaded from disk on a ground plane, with the camera looking at the mesh
+bool construct_scene_mesh(Scene &scene, float aspect_ratio, const char *filename, class ThreadPool &pool);
+
+} // namespace rtiow
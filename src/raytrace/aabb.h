@@ -0,0 +1,64 @@
+// raytrace/aabb.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// axis aligned bounding box
+
+#pragma once
+
+#include "types.h"
+#include "ray.h"
+
+namespace rtiow {
+
+struct AABB {
+	point_t		m_min = point_t(std::numeric_limits<float>::infinity());
+	point_t		m_max = point_t(-std::numeric_limits<float>::infinity());
+
+	// construction
+	AABB() = default;
+	AABB(const point_t &min, const point_t &max) : m_min(min), m_max(max) {
+	}
+
+	// growing
+	void grow(const point_t &p) {
+		m_min = glm::min(m_min, p);
+		m_max = glm::max(m_max, p);
+	}
+
+	void grow(const AABB &other) {
+		m_min = glm::min(m_min, other.m_min);
+		m_max = glm::max(m_max, other.m_max);
+	}
+
+	// properties
+	bool is_empty() const {
+		return m_min.x > m_max.x || m_min.y > m_max.y || m_min.z > m_max.z;
+	}
+
+	point_t centroid() const {
+		return 0.5f * (m_min + m_max);
+	}
+
+	float surface_area() const {
+		if (is_empty()) {
+			return 0.0f;
+		}
+		auto e = m_max - m_min;
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	// hit detection: returns the distance at which the ray enters the box or infinity if it misses
+	//	(inv_direction is the component-wise reciprocal of the ray direction)
+	float hit(const point_t &origin, const vector_t &inv_direction, float t_min, float t_max) const {
+		auto t0 = (m_min - origin) * inv_direction;
+		auto t1 = (m_max - origin) * inv_direction;
+		auto t_near = glm::min(t0, t1);
+		auto t_far = glm::max(t0, t1);
+
+		auto t_enter = glm::max(glm::max(t_near.x, t_near.y), glm::max(t_near.z, t_min));
+		auto t_exit = glm::min(glm::min(t_far.x, t_far.y), glm::min(t_far.z, t_max));
+
+		return (t_enter <= t_exit) ? t_enter : std::numeric_limits<float>::infinity();
+	}
+};
+
+} // namespace rtiow
@@ -0,0 +1,1019 @@
+// raytrace/bvh.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "bvh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <numeric>
+
+namespace rtiow {
+
+namespace {
+
+// relative cost of traversing an interior node vs. intersecting a primitive
+static constexpr float SAH_COST_TRAVERSAL = 1.0f;
+static constexpr float SAH_COST_INTERSECT = 1.0f;
+
+// binned and linear builders
+static constexpr uint32_t BIN_COUNT = 32;						// number of bins along each axis
+static constexpr uint32_t MORTON_63_BIT_SIZE = 1u << 22;		// more primitives use 63-bit Morton codes (21 bits per axis) instead of 30-bit
+static constexpr uint32_t RADIX_BITS = 8;						// bits of the Morton codes sorted per pass
+static constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+static constexpr uint32_t PARALLEL_NODE_SIZE = 1u << 16;		// nodes with more primitives are binned and partitioned by several tasks
+static constexpr uint32_t PARALLEL_CHUNK_SIZE = 1u << 14;		// number of primitives handled by each of those tasks
+static constexpr uint32_t PARALLEL_SUBTREE_SIZE = 1u << 12;		// subtrees with more primitives are built by a separate task
+
+struct BuildTask {
+	uint32_t	m_node;
+	uint32_t	m_begin;
+	uint32_t	m_end;
+	uint32_t	m_depth;
+};
+
+struct SplitCandidate {
+	float		m_cost = std::numeric_limits<float>::infinity();
+	int			m_axis = -1;
+	uint32_t	m_position = 0;			// sweep: number of primitives on the left side of the split, binned: first bin on the right side
+};
+
+// full sweep: sort the primitives by centroid along each axis and evaluate every possible split position
+void build_sweep(const std::vector<AABB> &primitive_bounds, std::vector<uint32_t> &primitive_order, std::vector<BVHNode> &nodes) {
+
+	std::vector<point_t> centroids;
+	centroids.reserve(primitive_bounds.size());
+	for (const auto &bounds : primitive_bounds) {
+		centroids.push_back(bounds.centroid());
+	}
+
+	// scratch buffers for the sweep, reused for every node
+	std::vector<uint32_t> sorted[3];
+	std::vector<float> right_area(primitive_bounds.size());
+
+	nodes.reserve(2 * primitive_bounds.size() - 1);
+	nodes.emplace_back();
+
+	std::vector<BuildTask> tasks;
+	tasks.push_back({0, 0, static_cast<uint32_t>(primitive_bounds.size()), 0});
+
+	while (!tasks.empty()) {
+		auto task = tasks.back();
+		tasks.pop_back();
+
+		const auto count = task.m_end - task.m_begin;
+		auto begin_it = primitive_order.begin() + task.m_begin;
+		auto end_it = primitive_order.begin() + task.m_end;
+
+		// bounds of the node
+		AABB node_bounds;
+		for (auto it = begin_it; it != end_it; ++it) {
+			node_bounds.grow(primitive_bounds[*it]);
+		}
+		nodes[task.m_node].m_bounds = node_bounds;
+
+		auto make_leaf = [&]() {
+			nodes[task.m_node].m_first = task.m_begin;
+			nodes[task.m_node].m_count = count;
+		};
+
+		if (count == 1) {
+			make_leaf();
+			continue;
+		}
+
+		SplitCandidate best;
+
+		if (task.m_depth < BVH::MAX_SAH_DEPTH) {
+			// full sweep along each axis: sort the primitives by centroid and evaluate every possible split position
+			const auto inv_parent_area = 1.0f / std::max(node_bounds.surface_area(), std::numeric_limits<float>::min());
+
+			for (int axis = 0; axis < 3; ++axis) {
+				auto &order = sorted[axis];
+				order.assign(begin_it, end_it);
+				std::sort(order.begin(), order.end(), [&centroids, axis](uint32_t a, uint32_t b) {
+					return centroids[a][axis] < centroids[b][axis];
+				});
+
+				AABB accum;
+				for (uint32_t i = count - 1; i > 0; --i) {
+					accum.grow(primitive_bounds[order[i]]);
+					right_area[i] = accum.surface_area();
+				}
+
+				accum = AABB();
+				for (uint32_t i = 1; i < count; ++i) {
+					accum.grow(primitive_bounds[order[i - 1]]);
+					auto cost = SAH_COST_TRAVERSAL + SAH_COST_INTERSECT * inv_parent_area *
+								(accum.surface_area() * float(i) + right_area[i] * float(count - i));
+					if (cost < best.m_cost) {
+						best = {cost, axis, i};
+					}
+				}
+			}
+
+			// don't split when intersecting all primitives is cheaper
+			if (count <= BVH::MAX_LEAF_SIZE && best.m_cost >= SAH_COST_INTERSECT * float(count)) {
+				make_leaf();
+				continue;
+			}
+
+			std::copy(sorted[best.m_axis].begin(), sorted[best.m_axis].end(), begin_it);
+		} else {
+			// too deep: split at the median of the largest axis to guarantee a bounded depth
+			auto extent = node_bounds.m_max - node_bounds.m_min;
+			auto axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+			best = {0.0f, axis, count / 2};
+			std::nth_element(begin_it, begin_it + best.m_position, end_it, [&centroids, axis](uint32_t a, uint32_t b) {
+				return centroids[a][axis] < centroids[b][axis];
+			});
+		}
+
+		// create child nodes (always allocated as a pair)
+		auto left = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+		nodes.emplace_back();
+		nodes[task.m_node].m_first = left;
+		nodes[task.m_node].m_count = 0;
+
+		auto middle = task.m_begin + best.m_position;
+		tasks.push_back({left + 1, middle, task.m_end, task.m_depth + 1});
+		tasks.push_back({left, task.m_begin, middle, task.m_depth + 1});
+	}
+}
+
+// shared by the parallel builders: a thread pool (optional) to split large ranges over and the node arena
+class ParallelBuilder {
+protected:
+	explicit ParallelBuilder(ThreadPool *pool) : m_pool(pool) {
+	}
+
+	// run func(chunk_index, begin, end) for consecutive chunks of the range, on the thread pool when the range is large enough
+	template <typename Func>
+	void parallel_chunks(uint32_t begin, uint32_t end, Func &&func) {
+		if (!is_parallel(end - begin)) {
+			for (uint32_t chunk = 0, b = begin; b < end; b += PARALLEL_CHUNK_SIZE, ++chunk) {
+				func(chunk, b, std::min(end, b + PARALLEL_CHUNK_SIZE));
+			}
+			return;
+		}
+
+		TaskGroup group;
+		for (uint32_t chunk = 0, b = begin; b < end; b += PARALLEL_CHUNK_SIZE, ++chunk) {
+			m_pool->add_task(group, [&func, chunk, b, e = std::min(end, b + PARALLEL_CHUNK_SIZE)]() {
+				func(chunk, b, e);
+			});
+		}
+		m_pool->wait(group);
+	}
+
+	bool is_parallel(uint32_t count) const {
+		return m_pool != nullptr && count >= PARALLEL_NODE_SIZE;
+	}
+
+	static uint32_t chunk_count(uint32_t begin, uint32_t end) {
+		return (end - begin + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+	}
+
+	// the arena is sized for one primitive per leaf, release the part the tree doesn't use
+	void trim_arena(std::vector<BVHNode> &nodes) const {
+		nodes.resize(m_node_count.load());
+		nodes.shrink_to_fit();
+	}
+
+protected:
+	ThreadPool *				m_pool;
+	std::atomic<uint32_t>		m_node_count = 0;		// used part of the node arena
+	TaskGroup					m_subtrees;
+};
+
+struct Bin {
+	AABB		m_bounds;
+	uint32_t	m_count = 0;
+};
+
+// the bins along each axis (small nodes use less than BIN_COUNT bins)
+struct BinArray {
+	Bin			m_bins[3][BIN_COUNT];
+	uint32_t	m_count = BIN_COUNT;
+
+	void reset(uint32_t count) {
+		m_count = count;
+		for (auto &axis : m_bins) {
+			std::fill_n(axis, count, Bin());
+		}
+	}
+
+	Bin *operator[](int axis) {return m_bins[axis];}
+	const Bin *operator[](int axis) const {return m_bins[axis];}
+};
+
+// the primitives are moved around during the build instead of their indices: the bounds are read sequentially
+struct PrimitiveRef {
+	AABB		m_bounds;
+	uint32_t	m_index;
+};
+
+struct BinnedTask {
+	uint32_t	m_node;
+	uint32_t	m_begin;
+	uint32_t	m_end;
+	uint32_t	m_depth;
+	AABB		m_bounds;				// bounds of the primitives
+	AABB		m_centroid_bounds;		// bounds of the centroids of the primitives, determines the bins
+};
+
+// binned SAH: the centroids are assigned to (at most) BIN_COUNT bins along each axis, only the bin boundaries are evaluated
+//	as split positions. Nodes with many primitives (near the root) are binned and partitioned by several tasks, the
+//	subtrees below them are built by separate tasks. All nodes are allocated from a single arena that's large enough
+//	for the worst case (one primitive per leaf).
+//	The partitions are stable so the result doesn't depend on the number of threads, except for the position of the
+//	nodes in the arena. The builder needs about 60 bytes per primitive next to the arena (32 bytes per node).
+class BinnedBuilder : public ParallelBuilder {
+public:
+	BinnedBuilder(const std::vector<AABB> &primitive_bounds, std::vector<uint32_t> &primitive_order,
+				  std::vector<BVHNode> &nodes, ThreadPool *pool) :
+		ParallelBuilder(pool),
+		m_primitive_bounds(primitive_bounds),
+		m_primitive_order(primitive_order),
+		m_nodes(nodes) {
+	}
+
+	void build() {
+		const auto count = static_cast<uint32_t>(m_primitive_bounds.size());
+
+		m_nodes.resize(2 * size_t(count) - 1);
+		m_node_count = 1;
+		m_refs.resize(count);
+		m_scratch.resize(count);
+
+		parallel_chunks(0, count, [this](uint32_t, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				m_refs[i] = {m_primitive_bounds[i], i};
+			}
+		});
+
+		BinnedTask root = {0, 0, count, 0, {}, {}};
+		range_bounds(root.m_begin, root.m_end, root.m_bounds, root.m_centroid_bounds);
+
+		if (m_pool == nullptr) {
+			build_subtree(root);
+		} else {
+			m_pool->add_task(m_subtrees, [this, root]() {build_subtree(root);});
+			m_pool->wait(m_subtrees);
+		}
+
+		trim_arena(m_nodes);
+
+		parallel_chunks(0, count, [this](uint32_t, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				m_primitive_order[i] = m_refs[i].m_index;
+			}
+		});
+	}
+
+private:
+	void build_subtree(const BinnedTask &subtree) {
+		std::vector<BinnedTask> stack;
+		stack.push_back(subtree);
+		BinArray bins;
+
+		while (!stack.empty()) {
+			auto task = stack.back();
+			stack.pop_back();
+
+			BinnedTask left, right;
+			if (!split(task, bins, left, right)) {
+				continue;
+			}
+
+			// hand large subtrees to another worker, continue with the other child on this thread
+			if (m_pool != nullptr && right.m_end - right.m_begin >= PARALLEL_SUBTREE_SIZE) {
+				m_pool->add_task(m_subtrees, [this, right]() {build_subtree(right);});
+			} else {
+				stack.push_back(right);
+			}
+			stack.push_back(left);
+		}
+	}
+
+	// initializes the node of the task, returns false when it's a leaf
+	bool split(const BinnedTask &task, BinArray &bins, BinnedTask &left, BinnedTask &right) {
+		auto &node = m_nodes[task.m_node];
+		node.m_bounds = task.m_bounds;
+
+		const auto count = task.m_end - task.m_begin;
+		const auto extent = task.m_centroid_bounds.m_max - task.m_centroid_bounds.m_min;
+		const auto max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+
+		auto make_leaf = [&]() {
+			node.m_first = task.m_begin;
+			node.m_count = count;
+			return false;
+		};
+
+		if (count == 1 || (count <= BVH::MAX_LEAF_SIZE && max_extent <= 0.0f)) {
+			return make_leaf();
+		}
+
+		uint32_t middle;
+		SplitCandidate best;
+
+		if (task.m_depth < BVH::MAX_SAH_DEPTH && max_extent > 0.0f) {
+			bin_primitives(task, bins);
+			best = find_split(task, bins);
+
+			// don't split when intersecting all primitives is cheaper
+			if (count <= BVH::MAX_LEAF_SIZE && best.m_cost >= SAH_COST_INTERSECT * float(count)) {
+				return make_leaf();
+			}
+		}
+
+		if (best.m_axis >= 0) {
+			const auto axis = best.m_axis;
+			const auto min = task.m_centroid_bounds.m_min[axis];
+			const auto bin_count = bins.m_count;
+			const auto scale = bin_scale(extent[axis], bin_count);
+
+			middle = partition(task.m_begin, task.m_end, [&](const point_t &centroid) {
+				return bin_index(centroid[axis], min, scale, bin_count) < best.m_position;
+			}, left.m_centroid_bounds, right.m_centroid_bounds);
+
+			// the bounds of the children follow from the bins
+			left.m_bounds = right.m_bounds = AABB();
+			for (uint32_t b = 0; b < bin_count; ++b) {
+				((b < best.m_position) ? left : right).m_bounds.grow(bins[axis][b].m_bounds);
+			}
+		} else {
+			// too deep or the centroids can't be binned: split at the median of the largest axis
+			const auto axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+			middle = task.m_begin + count / 2;
+
+			auto begin_it = m_refs.begin() + task.m_begin;
+			std::nth_element(begin_it, begin_it + (middle - task.m_begin), begin_it + count,
+							 [axis](const PrimitiveRef &a, const PrimitiveRef &b) {
+				return a.m_bounds.centroid()[axis] < b.m_bounds.centroid()[axis];
+			});
+
+			range_bounds(task.m_begin, middle, left.m_bounds, left.m_centroid_bounds);
+			range_bounds(middle, task.m_end, right.m_bounds, right.m_centroid_bounds);
+		}
+
+		// create child nodes (always allocated as a pair)
+		auto first = m_node_count.fetch_add(2);
+		node.m_first = first;
+		node.m_count = 0;
+
+		left.m_node = first;
+		left.m_begin = task.m_begin;
+		left.m_end = middle;
+		left.m_depth = task.m_depth + 1;
+
+		right.m_node = first + 1;
+		right.m_begin = middle;
+		right.m_end = task.m_end;
+		right.m_depth = task.m_depth + 1;
+
+		return true;
+	}
+
+	void bin_primitives(const BinnedTask &task, BinArray &bins) {
+		const auto count = task.m_end - task.m_begin;
+		const auto bin_count = std::min(count, BIN_COUNT);
+		const auto &min = task.m_centroid_bounds.m_min;
+		const auto extent = task.m_centroid_bounds.m_max - min;
+		const float scale[3] = {bin_scale(extent.x, bin_count), bin_scale(extent.y, bin_count), bin_scale(extent.z, bin_count)};
+
+		auto bin_range = [&](uint32_t begin, uint32_t end, BinArray &result) {
+			for (uint32_t i = begin; i < end; ++i) {
+				const auto &bounds = m_refs[i].m_bounds;
+				const auto c = bounds.centroid();
+
+				for (int axis = 0; axis < 3; ++axis) {
+					if (scale[axis] > 0.0f) {
+						auto &bin = result[axis][bin_index(c[axis], min[axis], scale[axis], bin_count)];
+						bin.m_bounds.grow(bounds);
+						bin.m_count += 1;
+					}
+				}
+			}
+		};
+
+		bins.reset(bin_count);
+
+		if (!is_parallel(count)) {
+			bin_range(task.m_begin, task.m_end, bins);
+			return;
+		}
+
+		std::vector<BinArray> partial(chunk_count(task.m_begin, task.m_end));
+		parallel_chunks(task.m_begin, task.m_end, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+			bin_range(begin, end, partial[chunk]);
+		});
+
+		for (const auto &chunk_bins : partial) {
+			for (int axis = 0; axis < 3; ++axis) {
+				for (uint32_t b = 0; b < bin_count; ++b) {
+					bins[axis][b].m_bounds.grow(chunk_bins[axis][b].m_bounds);
+					bins[axis][b].m_count += chunk_bins[axis][b].m_count;
+				}
+			}
+		}
+	}
+
+	SplitCandidate find_split(const BinnedTask &task, const BinArray &bins) const {
+		const auto inv_parent_area = 1.0f / std::max(task.m_bounds.surface_area(), std::numeric_limits<float>::min());
+
+		SplitCandidate best;
+		float right_area[BIN_COUNT];
+		uint32_t right_count[BIN_COUNT];
+
+		for (int axis = 0; axis < 3; ++axis) {
+			AABB accum;
+			uint32_t accum_count = 0;
+			for (uint32_t b = bins.m_count - 1; b > 0; --b) {
+				accum.grow(bins[axis][b].m_bounds);
+				accum_count += bins[axis][b].m_count;
+				right_area[b] = accum.surface_area();
+				right_count[b] = accum_count;
+			}
+
+			accum = AABB();
+			accum_count = 0;
+			for (uint32_t b = 1; b < bins.m_count; ++b) {
+				accum.grow(bins[axis][b - 1].m_bounds);
+				accum_count += bins[axis][b - 1].m_count;
+				if (accum_count == 0 || right_count[b] == 0) {
+					continue;
+				}
+
+				auto cost = SAH_COST_TRAVERSAL + SAH_COST_INTERSECT * inv_parent_area *
+							(accum.surface_area() * float(accum_count) + right_area[b] * float(right_count[b]));
+				if (cost < best.m_cost) {
+					best = {cost, axis, b};
+				}
+			}
+		}
+
+		return best;
+	}
+
+	// stable partition of the range on the centroids of the primitives, returns the index of the first primitive for
+	//	which the predicate is false. Also determines the bounds of the centroids on both sides.
+	template <typename Pred>
+	uint32_t partition(uint32_t begin, uint32_t end, Pred &&pred, AABB &left_centroids, AABB &right_centroids) {
+		left_centroids = right_centroids = AABB();
+
+		if (!is_parallel(end - begin)) {
+			// keep the left side in place, move the right side out of the way
+			auto left = begin;
+			auto right = begin;
+			for (uint32_t i = begin; i < end; ++i) {
+				auto c = m_refs[i].m_bounds.centroid();
+				if (pred(c)) {
+					m_refs[left++] = m_refs[i];
+					left_centroids.grow(c);
+				} else {
+					m_scratch[right++] = m_refs[i];
+					right_centroids.grow(c);
+				}
+			}
+			std::copy(m_scratch.begin() + begin, m_scratch.begin() + right, m_refs.begin() + left);
+			return left;
+		}
+
+		const auto num_chunks = chunk_count(begin, end);
+		std::vector<uint32_t> left_count(num_chunks);
+
+		parallel_chunks(begin, end, [&](uint32_t chunk, uint32_t chunk_begin, uint32_t chunk_end) {
+			left_count[chunk] = static_cast<uint32_t>(std::count_if(m_refs.begin() + chunk_begin, m_refs.begin() + chunk_end,
+																	[&pred](const PrimitiveRef &ref) {return pred(ref.m_bounds.centroid());}));
+		});
+
+		// destination of the first primitive of each chunk on both sides of the split
+		const auto total_left = std::accumulate(left_count.begin(), left_count.end(), 0u);
+		std::vector<uint32_t> left_offset(num_chunks);
+		std::vector<uint32_t> right_offset(num_chunks);
+		uint32_t left_next = begin;
+		uint32_t right_next = begin + total_left;
+
+		for (uint32_t chunk = 0; chunk < num_chunks; ++chunk) {
+			left_offset[chunk] = left_next;
+			right_offset[chunk] = right_next;
+			left_next += left_count[chunk];
+			right_next += std::min(PARALLEL_CHUNK_SIZE, end - begin - chunk * PARALLEL_CHUNK_SIZE) - left_count[chunk];
+		}
+
+		std::vector<AABB> centroids(2 * size_t(num_chunks));
+		parallel_chunks(begin, end, [&](uint32_t chunk, uint32_t chunk_begin, uint32_t chunk_end) {
+			auto left = left_offset[chunk];
+			auto right = right_offset[chunk];
+			for (uint32_t i = chunk_begin; i < chunk_end; ++i) {
+				auto c = m_refs[i].m_bounds.centroid();
+				if (pred(c)) {
+					m_scratch[left++] = m_refs[i];
+					centroids[2 * chunk].grow(c);
+				} else {
+					m_scratch[right++] = m_refs[i];
+					centroids[2 * chunk + 1].grow(c);
+				}
+			}
+		});
+
+		parallel_chunks(begin, end, [&](uint32_t, uint32_t chunk_begin, uint32_t chunk_end) {
+			std::copy(m_scratch.begin() + chunk_begin, m_scratch.begin() + chunk_end, m_refs.begin() + chunk_begin);
+		});
+
+		for (size_t chunk = 0; chunk < centroids.size(); chunk += 2) {
+			left_centroids.grow(centroids[chunk]);
+			right_centroids.grow(centroids[chunk + 1]);
+		}
+
+		return begin + total_left;
+	}
+
+	void range_bounds(uint32_t begin, uint32_t end, AABB &bounds, AABB &centroid_bounds) {
+		bounds = centroid_bounds = AABB();
+
+		if (!is_parallel(end - begin)) {
+			for (uint32_t i = begin; i < end; ++i) {
+				const auto &prim_bounds = m_refs[i].m_bounds;
+				bounds.grow(prim_bounds);
+				centroid_bounds.grow(prim_bounds.centroid());
+			}
+			return;
+		}
+
+		std::vector<AABB> partial(2 * chunk_count(begin, end));
+
+		parallel_chunks(begin, end, [&](uint32_t chunk, uint32_t chunk_begin, uint32_t chunk_end) {
+			for (uint32_t i = chunk_begin; i < chunk_end; ++i) {
+				const auto &prim_bounds = m_refs[i].m_bounds;
+				partial[2 * chunk].grow(prim_bounds);
+				partial[2 * chunk + 1].grow(prim_bounds.centroid());
+			}
+		});
+
+		for (size_t chunk = 0; chunk < partial.size(); chunk += 2) {
+			bounds.grow(partial[chunk]);
+			centroid_bounds.grow(partial[chunk + 1]);
+		}
+	}
+
+	// scale from the centroid extent along an axis to bins (0 = can't split along the axis)
+	static float bin_scale(float extent, uint32_t bin_count) {
+		auto scale = float(bin_count) / extent;
+		return (extent > 0.0f && scale < std::numeric_limits<float>::infinity()) ? scale : 0.0f;
+	}
+
+	static uint32_t bin_index(float centroid, float min, float scale, uint32_t bin_count) {
+		return std::min(static_cast<uint32_t>((centroid - min) * scale), bin_count - 1);
+	}
+
+private:
+	const std::vector<AABB> &	m_primitive_bounds;
+	std::vector<uint32_t> &		m_primitive_order;
+	std::vector<BVHNode> &		m_nodes;
+
+	std::vector<PrimitiveRef>	m_refs;
+	std::vector<PrimitiveRef>	m_scratch;				// destination of the partitions
+};
+
+// spread the lower 21 bits of the value so there are two zero bits between each of them
+uint64_t expand_bits(uint64_t v) {
+	v &= 0x1fffffull;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+// index of the highest set bit of a (non-zero) value
+int highest_bit(uint64_t v) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return static_cast<int>(index);
+#else
+	return 63 - __builtin_clzll(v);
+#endif
+}
+
+struct MortonRef {
+	uint64_t	m_code;
+	uint32_t	m_index;
+};
+
+struct LinearTask {
+	uint32_t	m_node;
+	uint32_t	m_begin;
+	uint32_t	m_end;
+};
+
+// linear BVH (Lauterbach 2009, Karras 2012): the centroids are quantized on a grid over the centroid bounds and sorted
+//	along the Morton curve through that grid with a stable radix sort. A node is split at the highest bit in which the
+//	codes of its first and last primitive differ, which only needs a binary search. Each split consumes at least one bit
+//	of the codes (identical codes are split at the median), so the depth stays below 63 + 32 levels.
+//	Only small nodes (up to MAX_LEAF_SIZE primitives) use the surface area heuristic to decide if they should become a
+//	leaf, the bounds of the other nodes are computed bottom-up after the topology is known. The tree doesn't depend
+//	on the number of threads, except for the position of the nodes in the arena.
+class LinearBuilder : public ParallelBuilder {
+public:
+	LinearBuilder(const std::vector<AABB> &primitive_bounds, std::vector<uint32_t> &primitive_order,
+				  std::vector<BVHNode> &nodes, ThreadPool *pool) :
+		ParallelBuilder(pool),
+		m_primitive_bounds(primitive_bounds),
+		m_primitive_order(primitive_order),
+		m_nodes(nodes) {
+	}
+
+	void build() {
+		const auto count = static_cast<uint32_t>(m_primitive_bounds.size());
+
+		m_nodes.resize(2 * size_t(count) - 1);
+		m_node_count = 1;
+		m_refs.resize(count);
+		m_scratch.resize(count);
+
+		const auto bits_per_axis = (count > MORTON_63_BIT_SIZE) ? 21 : 10;
+		compute_codes(bits_per_axis);
+		radix_sort(3 * bits_per_axis);
+
+		// the bounds are read many times while building the topology, store them in the sorted order
+		m_sorted_bounds.resize(count);
+		parallel_chunks(0, count, [this](uint32_t, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				m_sorted_bounds[i] = m_primitive_bounds[m_refs[i].m_index];
+			}
+		});
+
+		LinearTask root = {0, 0, count};
+		if (m_pool == nullptr) {
+			build_subtree(root);
+		} else {
+			m_pool->add_task(m_subtrees, [this, root]() {build_subtree(root);});
+			m_pool->wait(m_subtrees);
+		}
+
+		trim_arena(m_nodes);
+
+		// children are allocated after their parent: a reverse pass over the arena visits them first
+		for (size_t i = m_nodes.size(); i-- > 0; ) {
+			auto &node = m_nodes[i];
+			if (!node.is_leaf()) {
+				node.m_bounds = m_nodes[node.m_first].m_bounds;
+				node.m_bounds.grow(m_nodes[node.m_first + 1].m_bounds);
+			}
+		}
+
+		parallel_chunks(0, count, [this](uint32_t, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				m_primitive_order[i] = m_refs[i].m_index;
+			}
+		});
+	}
+
+private:
+	void compute_codes(int bits_per_axis) {
+		const auto count = static_cast<uint32_t>(m_primitive_bounds.size());
+
+		std::vector<AABB> partial(chunk_count(0, count));
+		parallel_chunks(0, count, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				partial[chunk].grow(m_primitive_bounds[i].centroid());
+			}
+		});
+
+		AABB centroid_bounds;
+		for (const auto &bounds : partial) {
+			centroid_bounds.grow(bounds);
+		}
+
+		const auto max_cell = (1u << bits_per_axis) - 1;
+		const auto &min = centroid_bounds.m_min;
+		const auto extent = centroid_bounds.m_max - min;
+		auto cell_scale = [max_cell](float e) {return (e > 0.0f) ? float(max_cell) / e : 0.0f;};
+		const float scale[3] = {cell_scale(extent.x), cell_scale(extent.y), cell_scale(extent.z)};
+
+		parallel_chunks(0, count, [&](uint32_t, uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				const auto c = m_primitive_bounds[i].centroid();
+				uint64_t code = 0;
+				for (int axis = 0; axis < 3; ++axis) {
+					auto cell = std::min(static_cast<uint32_t>((c[axis] - min[axis]) * scale[axis]), max_cell);
+					code = (code << 1) | expand_bits(cell);
+				}
+				m_refs[i] = {code, i};
+			}
+		});
+	}
+
+	// least significant digit first: each pass is a stable counting sort on RADIX_BITS bits of the codes
+	void radix_sort(int key_bits) {
+		const auto count = static_cast<uint32_t>(m_refs.size());
+		const auto num_chunks = chunk_count(0, count);
+		std::vector<uint32_t> offsets(size_t(num_chunks) * RADIX_SIZE);
+
+		for (int shift = 0; shift < key_bits; shift += int(RADIX_BITS)) {
+			std::fill(offsets.begin(), offsets.end(), 0u);
+
+			parallel_chunks(0, count, [&, shift](uint32_t chunk, uint32_t begin, uint32_t end) {
+				const auto *refs = m_refs.data();
+				auto *histogram = &offsets[size_t(chunk) * RADIX_SIZE];
+				for (uint32_t i = begin; i < end; ++i) {
+					++histogram[(refs[i].m_code >> shift) & (RADIX_SIZE - 1)];
+				}
+			});
+
+			// destination of the first code of each chunk for each digit (all chunks of a digit precede the next digit)
+			uint32_t next = 0;
+			bool single_digit = false;
+			for (uint32_t digit = 0; digit < RADIX_SIZE; ++digit) {
+				const auto digit_begin = next;
+				for (uint32_t chunk = 0; chunk < num_chunks; ++chunk) {
+					auto &offset = offsets[size_t(chunk) * RADIX_SIZE + digit];
+					auto digit_count = offset;
+					offset = next;
+					next += digit_count;
+				}
+				single_digit = single_digit || (next - digit_begin == count);
+			}
+
+			// all codes have the same digit: the pass wouldn't change the order
+			if (single_digit) {
+				continue;
+			}
+
+			parallel_chunks(0, count, [&, shift](uint32_t chunk, uint32_t begin, uint32_t end) {
+				const auto *refs = m_refs.data();
+				auto *scratch = m_scratch.data();
+				auto *offset = &offsets[size_t(chunk) * RADIX_SIZE];
+				for (uint32_t i = begin; i < end; ++i) {
+					scratch[offset[(refs[i].m_code >> shift) & (RADIX_SIZE - 1)]++] = refs[i];
+				}
+			});
+
+			std::swap(m_refs, m_scratch);
+		}
+	}
+
+	void build_subtree(const LinearTask &subtree) {
+		std::vector<LinearTask> stack;
+		stack.push_back(subtree);
+
+		while (!stack.empty()) {
+			auto task = stack.back();
+			stack.pop_back();
+
+			LinearTask left, right;
+			if (!split(task, left, right)) {
+				continue;
+			}
+
+			// hand large subtrees to another worker, continue with the other child on this thread
+			if (m_pool != nullptr && right.m_end - right.m_begin >= PARALLEL_SUBTREE_SIZE) {
+				m_pool->add_task(m_subtrees, [this, right]() {build_subtree(right);});
+			} else {
+				stack.push_back(right);
+			}
+			stack.push_back(left);
+		}
+	}
+
+	// initializes the node of the task, returns false when it's a leaf
+	bool split(const LinearTask &task, LinearTask &left, LinearTask &right) {
+		auto &node = m_nodes[task.m_node];
+		const auto count = task.m_end - task.m_begin;
+
+		auto make_leaf = [&]() {
+			node.m_bounds = range_bounds(task.m_begin, task.m_end);
+			node.m_first = task.m_begin;
+			node.m_count = count;
+			return false;
+		};
+
+		if (count == 1) {
+			return make_leaf();
+		}
+
+		const auto middle = split_position(task.m_begin, task.m_end);
+
+		// don't split small nodes when intersecting all primitives is cheaper
+		if (count <= BVH::MAX_LEAF_SIZE) {
+			const auto left_bounds = range_bounds(task.m_begin, middle);
+			const auto right_bounds = range_bounds(middle, task.m_end);
+			auto bounds = left_bounds;
+			bounds.grow(right_bounds);
+
+			const auto inv_area = 1.0f / std::max(bounds.surface_area(), std::numeric_limits<float>::min());
+			const auto cost = SAH_COST_TRAVERSAL + SAH_COST_INTERSECT * inv_area *
+							  (left_bounds.surface_area() * float(middle - task.m_begin) + right_bounds.surface_area() * float(task.m_end - middle));
+			if (cost >= SAH_COST_INTERSECT * float(count)) {
+				return make_leaf();
+			}
+		}
+
+		// create child nodes (always allocated as a pair)
+		auto first = m_node_count.fetch_add(2);
+		node.m_first = first;
+		node.m_count = 0;
+
+		left = {first, task.m_begin, middle};
+		right = {first + 1, middle, task.m_end};
+		return true;
+	}
+
+	// the codes in the range share their bits above the highest bit in which the first and last code differ, the
+	//	primitives without that bit come first
+	uint32_t split_position(uint32_t begin, uint32_t end) const {
+		const auto first_code = m_refs[begin].m_code;
+		const auto last_code = m_refs[end - 1].m_code;
+
+		if (first_code == last_code) {
+			return begin + (end - begin) / 2;
+		}
+
+		const auto bit = uint64_t(1) << highest_bit(first_code ^ last_code);
+		auto it = std::partition_point(m_refs.begin() + begin, m_refs.begin() + end, [bit](const MortonRef &ref) {
+			return (ref.m_code & bit) == 0;
+		});
+		return static_cast<uint32_t>(it - m_refs.begin());
+	}
+
+	AABB range_bounds(uint32_t begin, uint32_t end) const {
+		AABB result;
+		for (uint32_t i = begin; i < end; ++i) {
+			result.grow(m_sorted_bounds[i]);
+		}
+		return result;
+	}
+
+private:
+	const std::vector<AABB> &	m_primitive_bounds;
+	std::vector<uint32_t> &		m_primitive_order;
+	std::vector<BVHNode> &		m_nodes;
+
+	std::vector<MortonRef>		m_refs;
+	std::vector<MortonRef>		m_scratch;				// destination of the radix sort passes
+	std::vector<AABB>			m_sorted_bounds;
+};
+
+} // unnamed namespace
+
+void BVH::clear() {
+	m_nodes.clear();
+	m_nodes_4.clear();
+	m_nodes_8.clear();
+}
+
+void BVH::assign(const BVHNode *nodes, size_t count) {
+	clear();
+	m_nodes.assign(nodes, nodes + count);
+}
+
+void BVH::build(const std::vector<AABB> &primitive_bounds, std::vector<uint32_t> &primitive_order, BVHBuilder builder, ThreadPool *pool) {
+
+	clear();
+	primitive_order.resize(primitive_bounds.size());
+	std::iota(primitive_order.begin(), primitive_order.end(), 0u);
+
+	if (primitive_bounds.empty()) {
+		return;
+	}
+
+	assert(primitive_bounds.size() < std::numeric_limits<uint32_t>::max() / 2);
+
+	switch (builder) {
+		case BVHBuilder::SWEEP:
+			build_sweep(primitive_bounds, primitive_order, m_nodes);
+			break;
+		case BVHBuilder::BINNED:
+			BinnedBuilder(primitive_bounds, primitive_order, m_nodes, pool).build();
+			break;
+		case BVHBuilder::LBVH:
+			LinearBuilder(primitive_bounds, primitive_order, m_nodes, pool).build();
+			break;
+	}
+}
+
+void BVH::collapse(uint32_t width) {
+	m_nodes_4.clear();
+	m_nodes_8.clear();
+
+	if (width == 4) {
+		collapse(m_nodes_4);
+	} else if (width == 8) {
+		collapse(m_nodes_8);
+	}
+}
+
+template <uint32_t WIDTH>
+void BVH::collapse(std::vector<WideBVHNode<WIDTH>> &wide_nodes) {
+
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	// each binary interior node has two children, the children are wide nodes that still need to be filled in
+	struct CollapseTask {
+		uint32_t	m_wide;
+		uint32_t	m_binary;
+	};
+
+	std::vector<CollapseTask> tasks;
+	wide_nodes.emplace_back();
+	tasks.push_back({0, 0});
+
+	while (!tasks.empty()) {
+		auto task = tasks.back();
+		tasks.pop_back();
+
+		// start with the children of the binary node, replace the interior child with the largest surface area by its
+		//	own children until the node is full (a binary leaf at the root becomes the only child)
+		uint32_t children[WIDTH];
+		uint32_t count = 0;
+
+		if (m_nodes[task.m_binary].is_leaf()) {
+			children[count++] = task.m_binary;
+		} else {
+			children[count++] = m_nodes[task.m_binary].m_first;
+			children[count++] = m_nodes[task.m_binary].m_first + 1;
+		}
+
+		while (count < WIDTH) {
+			int largest = -1;
+			float largest_area = -1.0f;
+			for (uint32_t c = 0; c < count; ++c) {
+				const auto &child = m_nodes[children[c]];
+				if (!child.is_leaf() && child.m_bounds.surface_area() > largest_area) {
+					largest = int(c);
+					largest_area = child.m_bounds.surface_area();
+				}
+			}
+
+			if (largest < 0) {
+				break;
+			}
+
+			const auto first = m_nodes[children[largest]].m_first;
+			children[largest] = first;
+			children[count++] = first + 1;
+		}
+
+		WideBVHNode<WIDTH> node;
+		for (uint32_t c = 0; c < WIDTH; ++c) {
+			if (c >= count) {
+				for (int axis = 0; axis < 3; ++axis) {
+					node.m_min[axis][c] = std::numeric_limits<float>::infinity();
+					node.m_max[axis][c] = -std::numeric_limits<float>::infinity();
+				}
+				node.m_first[c] = 0;
+				node.m_count[c] = 0;
+				continue;
+			}
+
+			const auto &child = m_nodes[children[c]];
+			for (int axis = 0; axis < 3; ++axis) {
+				node.m_min[axis][c] = child.m_bounds.m_min[axis];
+				node.m_max[axis][c] = child.m_bounds.m_max[axis];
+			}
+
+			if (child.is_leaf()) {
+				node.m_first[c] = child.m_first;
+				node.m_count[c] = child.m_count;
+			} else {
+				node.m_first[c] = static_cast<uint32_t>(wide_nodes.size());
+				node.m_count[c] = 0;
+				wide_nodes.emplace_back();
+				tasks.push_back({node.m_first[c], children[c]});
+			}
+		}
+
+		wide_nodes[task.m_wide] = node;
+	}
+
+	wide_nodes.shrink_to_fit();
+}
+
+float BVH::sah_cost() const {
+	if (m_nodes.empty()) {
+		return 0.0f;
+	}
+
+	// probability that a ray that hits the root also hits a node = ratio of the surface areas
+	double cost = 0.0;
+	for (const auto &node : m_nodes) {
+		auto area = double(node.m_bounds.surface_area());
+		cost += area * (node.is_leaf() ? SAH_COST_INTERSECT * double(node.m_count) : SAH_COST_TRAVERSAL);
+	}
+
+	return float(cost / std::max(double(m_nodes[0].m_bounds.surface_area()), double(std::numeric_limits<float>::min())));
+}
+
+size_t BVH::memory_usage() const {
+	return m_nodes.size() * sizeof(BVHNode) + m_nodes_4.size() * sizeof(WideBVHNode<4>) + m_nodes_8.size() * sizeof(WideBVHNode<8>);
+}
+
+} // namespace rtiow
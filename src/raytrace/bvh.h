@@ -0,0 +1,468 @@
+// raytrace/bvh.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// bounding volume hierarchy over an arbitrary set of primitives.
+//	The BVH only knows about the bounding boxes of the primitives, the owner of the primitives reorders them
+//	after the build so that each leaf references a contiguous range and supplies the intersection test
+//	for the leaves during traversal.
+//	The binary hierarchy can be collapsed into a wide one (4 or 8 children per node) after the build. The wide nodes
+//	store the bounds of their children together so a single SIMD test checks a ray against all of them, which
+//	halves (or more) the number of dependent steps to reach a leaf. The leaves and the primitive order don't change.
+
+#pragma once
+
+#include "aabb.h"
+#include "config.h"
+#include "geometry_base.h"
+#include "ray_packet.h"
+#include "render_stats.h"
+
+#include <vector>
+
+namespace rtiow {
+
+class ThreadPool;
+
+struct BVHNode {
+	AABB		m_bounds;
+	uint32_t	m_first = 0;	// interior node: index of the left child (right child = m_first + 1)
+								// leaf node: index of the first primitive
+	uint32_t	m_count = 0;	// number of primitives in the leaf (0 == interior node)
+
+	bool is_leaf() const {return m_count > 0;}
+};
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode should fit in half a cache line");
+
+// node of a collapsed BVH: the bounds of the children are stored per axis (structure-of-arrays)
+template <uint32_t WIDTH>
+struct alignas(64) WideBVHNode {
+	using float_type = typename simd::lanes<WIDTH>::float_type;
+	using mask_type = typename simd::lanes<WIDTH>::mask_type;
+
+	float		m_min[3][WIDTH];		// unused children have empty bounds (min > max)
+	float		m_max[3][WIDTH];
+	uint32_t	m_first[WIDTH];			// interior child: index of its node, leaf: index of the first primitive
+	uint32_t	m_count[WIDTH];			// number of primitives in the leaf (0 == interior node)
+
+	// test the ray against the bounds of all children: returns the children that are hit within [t_min, t_max] and
+	//	the distance at which the ray enters each of them (the same test as AABB::hit for each child)
+	mask_type hit(const float_type *origin, const float_type *inv_direction, float_type t_min, float_type t_max,
+				  float_type &t_enter) const {
+		using simd::min;
+		using simd::max;
+
+		float_type near[3], far[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			auto t0 = (float_type::load(m_min[axis]) - origin[axis]) * inv_direction[axis];
+			auto t1 = (float_type::load(m_max[axis]) - origin[axis]) * inv_direction[axis];
+			near[axis] = min(t1, t0);
+			far[axis] = max(t1, t0);
+		}
+
+		t_enter = max(max(t_min, near[2]), max(near[1], near[0]));
+		auto t_exit = min(min(t_max, far[2]), min(far[1], far[0]));
+
+		return (t_enter <= t_exit) & (float_type::load(m_min[0]) <= float_type::load(m_max[0]));
+	}
+};
+
+static_assert(sizeof(WideBVHNode<4>) == 128, "WideBVHNode<4> should fit in two cache lines");
+static_assert(sizeof(WideBVHNode<8>) == 256, "WideBVHNode<8> should fit in four cache lines");
+
+// number of children per node of the BVH for an acceleration structure
+inline uint32_t bvh_width(AccelerationStructure acceleration) {
+	switch (acceleration) {
+		case AccelerationStructure::BVH4:
+			return 4;
+		case AccelerationStructure::BVH8:
+			return 8;
+		default:
+			return 2;
+	}
+}
+
+class BVH {
+public:
+	static constexpr uint32_t MAX_LEAF_SIZE = 8;		// only create leaves with more primitives when they can't be split
+	static constexpr uint32_t MAX_SAH_DEPTH = 64;		// switch to median splits below this depth to bound the tree depth
+	static constexpr uint32_t STACK_SIZE = 128;			// traversal stack size, large enough for the maximum possible depth
+
+public:
+	// construction
+	BVH() = default;
+	BVH(const BVH &other) = delete;
+	BVH &operator=(const BVH &other) = delete;
+
+	void clear();
+
+	// build the hierarchy using the surface area heuristic (or along a Morton curve with BVHBuilder::LBVH)
+	//	on return 'primitive_order' contains the order in which the primitives should be stored by the owner
+	//	The binned and linear builders use the thread pool when one is given. The primitive order and the shape of the tree don't
+	//	depend on the number of threads, the order of the nodes in memory does.
+	void build(const std::vector<AABB> &primitive_bounds, std::vector<uint32_t> &primitive_order,
+			   BVHBuilder builder = BVHBuilder::BINNED, ThreadPool *pool = nullptr);
+
+	// restore a hierarchy that was built earlier (e.g. loaded from a cache), the owner should store the primitives
+	//	in the same order as when the nodes were built
+	void assign(const BVHNode *nodes, size_t count);
+
+	// collapse the binary hierarchy into one with 4 or 8 children per node (2 = only use the binary hierarchy)
+	//	hit and occluded traverse the wide hierarchy, hit_packet keeps using the binary one
+	void collapse(uint32_t width);
+
+	// information
+	bool empty() const {return m_nodes.empty();}
+	size_t node_count() const {return m_nodes.size();}			// nodes of the binary hierarchy
+	size_t wide_node_count() const {return m_nodes_4.size() + m_nodes_8.size();}
+	uint32_t width() const {return !m_nodes_8.empty() ? 8 : (!m_nodes_4.empty() ? 4 : 2);}
+	const std::vector<BVHNode> &nodes() const {return m_nodes;}
+	float sah_cost() const;		// expected cost of a ray that hits the root, relative to intersecting one primitive
+	size_t memory_usage() const;
+
+	// hit detection
+	//	leaf_hit should have the signature: bool (uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record)
+	template <typename LeafFunc>
+	bool hit(const Ray &ray, float t_min, HitRecord &hit_record, LeafFunc &&leaf_hit) const;
+
+	// any hit between t_min and t_max: stops at the first leaf that reports a hit, children are not visited in order
+	//	leaf_occluded should have the signature: bool (uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max)
+	template <typename LeafFunc>
+	bool occluded(const Ray &ray, float t_min, float t_max, LeafFunc &&leaf_occluded) const;
+
+	// hit detection for a packet of rays, 'best_t' is the distance to the closest hit so far for each lane
+	//	leaf_hit should have the signature: void (uint32_t first, uint32_t count, const RayPacket &packet, simd::mask8 active,
+	//																	  float t_min, simd::float8 &best_t)
+	template <typename LeafFunc>
+	void hit_packet(const RayPacket &packet, float t_min, simd::float8 &best_t, LeafFunc &&leaf_hit) const;
+
+private:
+	template <uint32_t WIDTH>
+	void collapse(std::vector<WideBVHNode<WIDTH>> &wide_nodes);
+
+	template <uint32_t WIDTH, typename LeafFunc>
+	static bool hit_wide(const std::vector<WideBVHNode<WIDTH>> &nodes, const Ray &ray, float t_min, HitRecord &hit_record,
+						 LeafFunc &&leaf_hit);
+
+	template <uint32_t WIDTH, typename LeafFunc>
+	static bool occluded_wide(const std::vector<WideBVHNode<WIDTH>> &nodes, const Ray &ray, float t_min, float t_max,
+							  LeafFunc &&leaf_occluded);
+
+private:
+	std::vector<BVHNode>			m_nodes;
+	std::vector<WideBVHNode<4>>		m_nodes_4;		// collapsed hierarchy (when requested, only one of both is used)
+	std::vector<WideBVHNode<8>>		m_nodes_8;
+};
+
+template <typename LeafFunc>
+inline bool BVH::hit(const Ray &ray, float t_min, HitRecord &hit_record, LeafFunc &&leaf_hit) const {
+
+	struct StackEntry {
+		uint32_t	m_node;
+		float		m_t_enter;
+	};
+
+	if (!m_nodes_8.empty()) {
+		return hit_wide(m_nodes_8, ray, t_min, hit_record, leaf_hit);
+	}
+
+	if (!m_nodes_4.empty()) {
+		return hit_wide(m_nodes_4, ray, t_min, hit_record, leaf_hit);
+	}
+
+	if (m_nodes.empty()) {
+		return false;
+	}
+
+	const auto origin = ray.origin();
+	const auto inv_direction = 1.0f / ray.direction();
+
+	StackEntry stack[STACK_SIZE];
+	uint32_t stack_top = 0;
+	bool hit_anything = false;
+
+	RTIOW_STATS(m_node_tests++);
+	if (m_nodes[0].m_bounds.hit(origin, inv_direction, t_min, hit_record.m_at_t) < std::numeric_limits<float>::infinity()) {
+		stack[stack_top++] = {0, t_min};
+	}
+
+	while (stack_top > 0) {
+		const auto entry = stack[--stack_top];
+
+		// skip nodes that are further away than the closest hit found so far
+		if (entry.m_t_enter > hit_record.m_at_t) {
+			continue;
+		}
+
+		const auto *node = &m_nodes[entry.m_node];
+
+		while (!node->is_leaf()) {
+			const auto *left = &m_nodes[node->m_first];
+			const auto *right = left + 1;
+			auto t_left = left->m_bounds.hit(origin, inv_direction, t_min, hit_record.m_at_t);
+			auto t_right = right->m_bounds.hit(origin, inv_direction, t_min, hit_record.m_at_t);
+			RTIOW_STATS(m_node_tests += 2);
+
+			// visit the nearest child first, push the other one on the stack (if it's hit at all)
+			if (t_left > t_right) {
+				std::swap(t_left, t_right);
+				std::swap(left, right);
+			}
+
+			if (t_left == std::numeric_limits<float>::infinity()) {
+				node = nullptr;
+				break;
+			}
+
+			if (t_right < std::numeric_limits<float>::infinity()) {
+				stack[stack_top++] = {static_cast<uint32_t>(right - m_nodes.data()), t_right};
+			}
+
+			node = left;
+		}
+
+		if (node != nullptr && leaf_hit(node->m_first, node->m_count, ray, t_min, hit_record)) {
+			hit_anything = true;
+		}
+	}
+
+	return hit_anything;
+}
+
+template <typename LeafFunc>
+inline bool BVH::occluded(const Ray &ray, float t_min, float t_max, LeafFunc &&leaf_occluded) const {
+
+	if (!m_nodes_8.empty()) {
+		return occluded_wide(m_nodes_8, ray, t_min, t_max, leaf_occluded);
+	}
+
+	if (!m_nodes_4.empty()) {
+		return occluded_wide(m_nodes_4, ray, t_min, t_max, leaf_occluded);
+	}
+
+	if (m_nodes.empty()) {
+		return false;
+	}
+
+	const auto origin = ray.origin();
+	const auto inv_direction = 1.0f / ray.direction();
+	constexpr auto MISS = std::numeric_limits<float>::infinity();
+
+	uint32_t stack[STACK_SIZE];
+	uint32_t stack_top = 0;
+
+	RTIOW_STATS(m_node_tests++);
+	if (m_nodes[0].m_bounds.hit(origin, inv_direction, t_min, t_max) == MISS) {
+		return false;
+	}
+	stack[stack_top++] = 0;
+
+	while (stack_top > 0) {
+		const auto *node = &m_nodes[stack[--stack_top]];
+
+		while (!node->is_leaf()) {
+			const auto *left = &m_nodes[node->m_first];
+			const auto hit_left = left->m_bounds.hit(origin, inv_direction, t_min, t_max) != MISS;
+			const auto hit_right = left[1].m_bounds.hit(origin, inv_direction, t_min, t_max) != MISS;
+			RTIOW_STATS(m_node_tests += 2);
+
+			if (!hit_left && !hit_right) {
+				node = nullptr;
+				break;
+			}
+
+			if (hit_left && hit_right) {
+				stack[stack_top++] = node->m_first + 1;
+			}
+
+			node = hit_left ? left : left + 1;
+		}
+
+		if (node != nullptr && leaf_occluded(node->m_first, node->m_count, ray, t_min, t_max)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+template <typename LeafFunc>
+inline void BVH::hit_packet(const RayPacket &packet, float t_min, simd::float8 &best_t, LeafFunc &&leaf_hit) const {
+
+	using namespace simd;
+
+	struct StackEntry {
+		uint32_t	m_node;
+		int			m_active;		// lanes that hit the node when it was pushed
+	};
+
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	const float8 infinity(std::numeric_limits<float>::infinity());
+
+	// the farthest hit distance over the active lanes bounds the conservative interval test for the entire packet
+	auto t_max_upper = [&](mask8 active) {return horizontal_max(select(active, best_t, -infinity));};
+
+	StackEntry stack[STACK_SIZE];
+	uint32_t stack_top = 0;
+	stack[stack_top++] = {0, packet.valid()};
+
+	while (stack_top > 0) {
+		const auto entry = stack[--stack_top];
+		const auto *node = &m_nodes[entry.m_node];
+		float8 t_enter;
+
+		// retest the node: lanes that found a closer hit since the node was pushed might not need it anymore
+		RTIOW_STATS(m_node_tests++);
+		auto active = packet.hit(node->m_bounds, t_min, best_t, t_max_upper(mask8::from_bits(entry.m_active)),
+								 mask8::from_bits(entry.m_active), t_enter);
+
+		while (active.any() && !node->is_leaf()) {
+			const auto *left = &m_nodes[node->m_first];
+			const auto *right = left + 1;
+			const auto t_upper = t_max_upper(active);
+
+			float8 t_left, t_right;
+			auto active_left = packet.hit(left->m_bounds, t_min, best_t, t_upper, active, t_left);
+			auto active_right = packet.hit(right->m_bounds, t_min, best_t, t_upper, active, t_right);
+			RTIOW_STATS(m_node_tests += 2);
+
+			if (!active_left.any()) {
+				std::swap(left, right);
+				std::swap(active_left, active_right);
+			} else if (active_right.any() &&
+					   horizontal_min(select(active_right, t_right, infinity)) < horizontal_min(select(active_left, t_left, infinity))) {
+				// visit the child that is nearest for the packet first
+				std::swap(left, right);
+				std::swap(active_left, active_right);
+			}
+
+			if (active_right.any()) {
+				stack[stack_top++] = {static_cast<uint32_t>(right - m_nodes.data()), active_right.bits()};
+			}
+
+			node = left;
+			active = active_left;
+		}
+
+		if (active.any()) {
+			leaf_hit(node->m_first, node->m_count, packet, active, t_min, best_t);
+		}
+	}
+}
+
+template <uint32_t WIDTH, typename LeafFunc>
+inline bool BVH::hit_wide(const std::vector<WideBVHNode<WIDTH>> &nodes, const Ray &ray, float t_min, HitRecord &hit_record,
+						  LeafFunc &&leaf_hit) {
+
+	using float_type = typename WideBVHNode<WIDTH>::float_type;
+
+	// the children of a node are pushed at once, in the worst case every level leaves all but one of them on the stack
+	struct StackEntry {
+		uint32_t	m_first;
+		uint32_t	m_count;
+		float		m_t_enter;
+	};
+
+	const auto origin = ray.origin();
+	const auto inv_direction = 1.0f / ray.direction();
+	const float_type v_origin[3] = {float_type(origin.x), float_type(origin.y), float_type(origin.z)};
+	const float_type v_inv_direction[3] = {float_type(inv_direction.x), float_type(inv_direction.y), float_type(inv_direction.z)};
+	const float_type v_t_min(t_min);
+
+	StackEntry stack[STACK_SIZE * (WIDTH - 1)];
+	uint32_t stack_top = 0;
+	bool hit_anything = false;
+
+	stack[stack_top++] = {0, 0, t_min};
+
+	while (stack_top > 0) {
+		const auto entry = stack[--stack_top];
+
+		// skip children that are further away than the closest hit found so far
+		if (entry.m_t_enter > hit_record.m_at_t) {
+			continue;
+		}
+
+		if (entry.m_count > 0) {
+			if (leaf_hit(entry.m_first, entry.m_count, ray, t_min, hit_record)) {
+				hit_anything = true;
+			}
+			continue;
+		}
+
+		const auto &node = nodes[entry.m_first];
+		float_type t_enter;
+		auto bits = node.hit(v_origin, v_inv_direction, v_t_min, float_type(hit_record.m_at_t), t_enter).bits();
+		RTIOW_STATS(m_node_tests += WIDTH);
+
+		float t_child[WIDTH];
+		t_enter.store(t_child);
+
+		// push the children that were hit ordered by distance: the nearest one ends up on top of the stack
+		const auto first_pushed = stack_top;
+		for (; bits != 0; bits &= bits - 1) {
+			const auto child = simd::first_lane(bits);
+			const StackEntry pushed = {node.m_first[child], node.m_count[child], t_child[child]};
+
+			auto pos = stack_top++;
+			for (; pos > first_pushed && stack[pos - 1].m_t_enter < pushed.m_t_enter; --pos) {
+				stack[pos] = stack[pos - 1];
+			}
+			stack[pos] = pushed;
+		}
+	}
+
+	return hit_anything;
+}
+
+template <uint32_t WIDTH, typename LeafFunc>
+inline bool BVH::occluded_wide(const std::vector<WideBVHNode<WIDTH>> &nodes, const Ray &ray, float t_min, float t_max,
+							   LeafFunc &&leaf_occluded) {
+
+	using float_type = typename WideBVHNode<WIDTH>::float_type;
+
+	struct StackEntry {
+		uint32_t	m_first;
+		uint32_t	m_count;
+	};
+
+	const auto origin = ray.origin();
+	const auto inv_direction = 1.0f / ray.direction();
+	const float_type v_origin[3] = {float_type(origin.x), float_type(origin.y), float_type(origin.z)};
+	const float_type v_inv_direction[3] = {float_type(inv_direction.x), float_type(inv_direction.y), float_type(inv_direction.z)};
+	const float_type v_t_min(t_min);
+	const float_type v_t_max(t_max);
+
+	StackEntry stack[STACK_SIZE * (WIDTH - 1)];
+	uint32_t stack_top = 0;
+
+	stack[stack_top++] = {0, 0};
+
+	while (stack_top > 0) {
+		const auto entry = stack[--stack_top];
+
+		if (entry.m_count > 0) {
+			if (leaf_occluded(entry.m_first, entry.m_count, ray, t_min, t_max)) {
+				return true;
+			}
+			continue;
+		}
+
+		// any hit will do: the children are visited in the order in which they are stored
+		const auto &node = nodes[entry.m_first];
+		float_type t_enter;
+		auto bits = node.hit(v_origin, v_inv_direction, v_t_min, v_t_max, t_enter).bits();
+		RTIOW_STATS(m_node_tests += WIDTH);
+
+		for (; bits != 0; bits &= bits - 1) {
+			const auto child = simd::first_lane(bits);
+			stack[stack_top++] = {node.m_first[child], node.m_count[child]};
+		}
+	}
+
+	return false;
+}
+
+} // namespace rtiow
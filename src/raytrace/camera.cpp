@@ -28,8 +28,16 @@ Camera::Camera( float aspect_ratio, float vertical_fov,
 	m_lens_radius = aperture / 2.0f;
 }
 
-Ray Camera::create_ray(float s, float t) const {
-	auto rd = m_lens_radius * random_vector_in_unit_disc();
+Ray Camera::create_ray(float s, float t, RandomGenerator &rng) const {
+	return create_ray(s, t, random_vector_in_unit_disc(rng));
+}
+
+Ray Camera::create_ray(float s, float t, Sampler &sampler) const {
+	return create_ray(s, t, random_vector_in_unit_disc(sampler));
+}
+
+Ray Camera::create_ray(float s, float t, const vector_t &lens) const {
+	auto rd = m_lens_radius * lens;
 	auto offset = m_u * rd.x + m_v * rd.y;
 	return Ray(
 		m_origin + offset,
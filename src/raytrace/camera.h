@@ -2,6 +2,8 @@
 #pragma once
 
 #include "ray.h"
+#include "random.h"
+#include "sampler.h"
 
 namespace rtiow {
 
@@ -17,9 +19,12 @@ public:
 			float focus_distance = 0.0f);
 
 	// ray generation
-	Ray create_ray(float u, float v) const;
+	Ray create_ray(float u, float v, RandomGenerator &rng) const;
+	Ray create_ray(float u, float v, Sampler &sampler) const;
 
 private:
+	Ray create_ray(float u, float v, const vector_t &lens) const;
+
 	point_t		m_origin;
 	point_t		m_lower_left;
 	vector_t	m_vec_horizontal;
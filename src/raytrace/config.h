@@ -5,12 +5,73 @@
 
 namespace rtiow {
 
+enum class AccelerationStructure : int32_t {
+	NONE = 0,			// brute force: test every primitive
+	BVH = 1,			// bounding volume hierarchy (surface area heuristic)
+	BVH4 = 2,			// BVH collapsed to 4 children per node, tested together with SIMD instructions
+	BVH8 = 3			// BVH collapsed to 8 children per node
+};
+
+enum class BVHBuilder : int32_t {
+	SWEEP = 0,			// surface area heuristic evaluated at every split position (sorts the primitives at every node)
+	BINNED = 1,			// surface area heuristic evaluated at the bin boundaries, large nodes and subtrees are built in parallel
+	LBVH = 2			// linear BVH: primitives sorted along a Morton curve, fast to build but more expensive to trace
+};
+
+enum class TileOrder : int32_t {
+	ROWS = 0,			// row by row, from the top-left corner
+	CENTER = 1,			// spiral outwards from the center of the image
+	HILBERT = 2			// along a Hilbert curve (neighbouring tiles are rendered close together in time)
+};
+
+enum class Integrator : int32_t {
+	MEGAKERNEL = 0,		// each path is traced from start to finish before starting the next one
+	WAVEFRONT = 1		// large batches of paths are traced together, one bounce at a time, in separate stages
+};
+
+enum class SamplerType : int32_t {
+	RANDOM = 0,			// independent uniform random numbers
+	STRATIFIED = 1,		// correlated multi-jittered samples, stratified per block of m_samples_per_pixel samples
+	SOBOL = 2			// Owen-scrambled Sobol points
+};
+
 struct RayTracerConfig {
 	uint32_t	m_render_resolution_x = 1280;		// horizontal resolution
 	uint32_t	m_render_resolution_y = 720;		// vertical resolution
 
 	uint32_t	m_samples_per_pixel = 64;			// multi-sampling: number of sample points per pixel
 	int32_t		m_max_ray_bounces = 32;				// maximum number of ray bounces before giving up
+	int32_t		m_russian_roulette_depth = 5;		// number of bounces before paths are randomly terminated based on their
+													//	throughput (0 = disabled)
+
+	SamplerType	m_sampler = SamplerType::SOBOL;	// distribution of the samples of a pixel over the random decisions of the paths
+
+	uint32_t	m_samples_per_pass = 0;				// progressive rendering: samples per pixel added in each pass over the image
+													//	(0 = take all samples in a single pass)
+	uint32_t	m_time_budget_ms = 0;				// progressive rendering: don't start a new pass after this time (0 = no limit)
+
+	float		m_adaptive_threshold = 0.0f;		// adaptive sampling: stop sampling a pixel when the 95% confidence interval of its
+													//	luminance is smaller than this fraction of its mean (0 = disabled)
+													//	=> m_samples_per_pixel becomes the average sample budget for the whole image
+	uint32_t	m_adaptive_min_samples = 16;		// adaptive sampling: minimum number of samples for each pixel
+	uint32_t	m_adaptive_max_samples = 0;			// adaptive sampling: maximum number of samples for a pixel (0 = 4 * m_samples_per_pixel)
+
+	uint32_t	m_tile_size = 128;					// the image is rendered in square tiles of this size
+	TileOrder	m_tile_order = TileOrder::CENTER;	// order in which the tiles are rendered
+	bool		m_tile_split = true;				// progressive rendering: split tiles that took much longer than average
+													//	in the previous pass
+
+	bool		m_light_sampling = true;			// sample the emissive spheres directly at diffuse hits (next event estimation)
+
+	bool		m_packet_tracing = true;			// trace the primary rays in packets of 8 (the bounces are traced one by one)
+
+	Integrator	m_integrator = Integrator::MEGAKERNEL;
+	uint32_t	m_wavefront_batch_size = 16384;		// wavefront integrator: maximum number of paths traced together
+
+	AccelerationStructure m_acceleration = AccelerationStructure::BVH;	// acceleration structure built when finalizing the scene
+	BVHBuilder	m_bvh_builder = BVHBuilder::BINNED;	// algorithm used to build the BVH
+
+	bool		m_print_report = true;				// print the render time and statistics when a render is done
 
 	int32_t		m_threads_ignore = 1;				// number of hardware threads to ignore and leave available for other system tasks
 	int32_t		m_threads_use_percent = 100;		// percentage of available hardware threads to actually use for raytracing
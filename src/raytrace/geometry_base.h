@@ -27,6 +27,9 @@ class GeometryBase {
 public:
 	// hit detection
 	virtual bool hit(const Ray &ray, float t_min, HitRecord &hit_record) const = 0;
+
+	// any hit between t_min and t_max, without determining the closest one (shadow rays, ambient occlusion, ...)
+	virtual bool occluded(const Ray &ray, float t_min, float t_max) const = 0;
 };
 
 } // namespace rtiow
@@ -1,11 +1,24 @@
 // raytrace/geometry_base.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
 #include "geometry_spheres.h"
+#include "render_stats.h"
+#include "simd.h"
 
 namespace rtiow {
 
 namespace {
 
-static inline bool hit_sphere(const Sphere &sphere, const Ray &ray, float t_min, float t_max, HitRecord &hit_record) {
+static constexpr uint32_t SIMD_WIDTH = 8;
+static constexpr uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+
+static inline void register_hit(const Sphere &sphere, material_id_t material, const Ray &ray, float root, HitRecord &hit_record) {
+	hit_record.m_at_t		= root;
+	hit_record.m_point		= ray.at(root);
+	hit_record.m_material	= material;
+	hit_record.set_face_normal(ray, (hit_record.m_point - sphere.m_center) / sphere.m_radius);
+}
+
+// nearest intersection of the ray with the sphere in the range [t_min, t_max]
+static inline bool intersect_sphere(const Sphere &sphere, const Ray &ray, float t_min, float t_max, float &root) {
 
 	auto oc = ray.origin() - sphere.m_center;
 
@@ -22,7 +35,7 @@ static inline bool hit_sphere(const Sphere &sphere, const Ray &ray, float t_min,
 	auto sqrt_discriminant = sqrtf(discriminant);
 
 	// find the nearest root in the target range
-	auto root = (-half_b - sqrt_discriminant) / a;
+	root = (-half_b - sqrt_discriminant) / a;
 	if (root < t_min || root > t_max) {
 		root = (-half_b + sqrt_discriminant) / a;
 		if (root < t_min || root > t_max) {
@@ -31,32 +44,126 @@ static inline bool hit_sphere(const Sphere &sphere, const Ray &ray, float t_min,
 		}
 	}
 
-	// register hit
-	hit_record.m_at_t		= root;
-	hit_record.m_point		= ray.at(root);
-	hit_record.m_material	= sphere.m_material;
-	hit_record.set_face_normal(ray, (hit_record.m_point - sphere.m_center) / sphere.m_radius);
-
 	return true;
 }
 
-
 } // unnamed namespace
 
 void GeometrySpheres::clear() {
 	m_spheres.clear();
+	m_materials.clear();
+	m_bvh.clear();
+	pad();
+}
+
+size_t GeometrySpheres::memory_usage() const {
+	return m_spheres.size() * sizeof(Sphere) + m_materials.size() * sizeof(material_id_t) + m_bvh.memory_usage();
 }
 
 void GeometrySpheres::add_sphere(const point_t &center, float radius, material_id_t material) {
-	m_spheres.push_back(Sphere{center, radius, material});
+	// the acceleration structures are no longer valid
+	m_bvh.clear();
+	m_spheres.resize(m_materials.size());
+
+	m_spheres.push_back(Sphere{center, radius});
+	m_materials.push_back(material);
+}
+
+void GeometrySpheres::finalize(AccelerationStructure acceleration, BVHBuilder builder, ThreadPool *pool) {
+
+	m_spheres.resize(m_materials.size());
+
+	if (acceleration == AccelerationStructure::NONE) {
+		m_bvh.clear();
+		pad();
+		return;
+	}
+
+	std::vector<AABB> bounds;
+	bounds.reserve(m_spheres.size());
+
+	for (const auto &sphere : m_spheres) {
+		// radius can be negative (hollow spheres)
+		auto extent = vector_t(glm::abs(sphere.m_radius));
+		bounds.emplace_back(sphere.m_center - extent, sphere.m_center + extent);
+	}
+
+	std::vector<uint32_t> order;
+	m_bvh.build(bounds, order, builder, pool);
+	m_bvh.collapse(bvh_width(acceleration));
+
+	// store the spheres in the order of the leaves of the BVH
+	std::vector<Sphere> sorted;
+	std::vector<material_id_t> sorted_materials;
+	sorted.reserve(m_spheres.size() + 2 * SIMD_WIDTH);
+	sorted_materials.reserve(m_materials.size());
+	for (auto idx : order) {
+		sorted.push_back(m_spheres[idx]);
+		sorted_materials.push_back(m_materials[idx]);
+	}
+	m_spheres = std::move(sorted);
+	m_materials = std::move(sorted_materials);
+
+	pad();
+}
+
+void GeometrySpheres::restore(const Sphere *spheres, const material_id_t *materials, size_t count, const BVHNode *nodes, size_t node_count,
+							  AccelerationStructure acceleration) {
+	m_spheres.assign(spheres, spheres + count);
+	m_materials.assign(materials, materials + count);
+	m_bvh.assign(nodes, node_count);
+	m_bvh.collapse(bvh_width(acceleration));
+	pad();
+}
+
+void GeometrySpheres::pad() {
+	// 8 spheres can be loaded from any starting index (the lanes past the end are masked out)
+	auto padded_size = ((m_materials.size() + 2 * SIMD_WIDTH - 1) / SIMD_WIDTH) * SIMD_WIDTH;
+	m_spheres.resize(padded_size, Sphere{point_t(0.0f, 0.0f, 0.0f), 0.0f});
 }
 
 bool GeometrySpheres::hit(const Ray &ray, float t_min, HitRecord &hit_record) const {
 
+	// the emulated SIMD kernel is slower than the scalar one when no SIMD instruction set is available
+	auto use_simd = simd::ENABLED && is_padded();
+
+	auto hit_range = [this, use_simd](uint32_t first, uint32_t count, const Ray &r, float t, HitRecord &hr) {
+		RTIOW_STATS(m_primitive_tests += count);
+		return use_simd ? hit_range_simd(first, count, r, t, hr) : hit_range_scalar(first, count, r, t, hr);
+	};
+
+	if (m_bvh.empty()) {
+		// brute force: check every sphere
+		return hit_range(0, static_cast<uint32_t>(size()), ray, t_min, hit_record);
+	}
+
+	return m_bvh.hit(ray, t_min, hit_record, hit_range);
+}
+
+bool GeometrySpheres::occluded(const Ray &ray, float t_min, float t_max) const {
+
+	auto use_simd = simd::ENABLED && is_padded();
+
+	auto occluded_range = [this, use_simd](uint32_t first, uint32_t count, const Ray &r, float t0, float t1) {
+		RTIOW_STATS(m_primitive_tests += count);
+		return use_simd ? occluded_range_simd(first, count, r, t0, t1) : occluded_range_scalar(first, count, r, t0, t1);
+	};
+
+	if (m_bvh.empty()) {
+		return occluded_range(0, static_cast<uint32_t>(size()), ray, t_min, t_max);
+	}
+
+	return m_bvh.occluded(ray, t_min, t_max, occluded_range);
+}
+
+bool GeometrySpheres::hit_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const {
+
 	bool hit_anything = false;
 
-	for (const auto &sphere: m_spheres) {
-		if (hit_sphere(sphere, ray, t_min, hit_record.m_at_t, hit_record)) {
+	for (uint32_t idx = first; idx < first + count; ++idx) {
+		float root;
+		if (intersect_sphere(m_spheres[idx], ray, t_min, hit_record.m_at_t, root)) {
+			register_hit(m_spheres[idx], m_materials[idx], ray, root, hit_record);
 			hit_anything = true;
 		}
 	}
@@ -64,5 +171,231 @@ bool GeometrySpheres::hit(const Ray &ray, float t_min, HitRecord &hit_record) co
 	return hit_anything;
 }
 
+bool GeometrySpheres::hit_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const {
+
+	using namespace simd;
+
+	assert(m_spheres.size() >= first + count + SIMD_WIDTH - 1);
+
+	const auto origin = ray.origin();
+	const auto direction = ray.direction();
+
+	const float8 origin_x(origin.x), origin_y(origin.y), origin_z(origin.z);
+	const float8 dir_x(direction.x), dir_y(direction.y), dir_z(direction.z);
+	const float8 a(glm::dot(direction, direction));
+	const float8 zero(0.0f);
+	const float8 infinity(std::numeric_limits<float>::infinity());
+	const float8 v_t_min(t_min);
+
+	// per lane: distance to the nearest hit so far and the block of 8 spheres that contains the sphere that was hit
+	float8 best_t(hit_record.m_at_t);
+	float8 best_block(-1.0f);
+	bool hit_anything = false;
+
+	for (uint32_t base = first, block = 0; base < first + count; base += SIMD_WIDTH, ++block) {
+		auto active = float8::lane_index() < float8(float(first + count - base));
+
+		float8 center_x, center_y, center_z, radius;
+		load_transposed(&m_spheres[base].m_center.x, center_x, center_y, center_z, radius);
+
+		auto oc_x = origin_x - center_x;
+		auto oc_y = origin_y - center_y;
+		auto oc_z = origin_z - center_z;
+
+		auto half_b = oc_x * dir_x + oc_y * dir_y + oc_z * dir_z;
+		auto c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - radius * radius;
+		auto discriminant = half_b * half_b - a * c;
+
+		active = active & (discriminant >= zero);
+		if (!active.any()) {
+			continue;
+		}
+
+		// nearest root in the acceptable range
+		auto sqrt_discriminant = sqrt(max(discriminant, zero));
+		auto root_near = (-half_b - sqrt_discriminant) / a;
+		auto root_far = (-half_b + sqrt_discriminant) / a;
+
+		auto near_ok = (root_near >= v_t_min) & (root_near <= best_t);
+		auto far_ok = (root_far >= v_t_min) & (root_far <= best_t);
+		auto root = select(near_ok, root_near, root_far);
+
+		active = active & (near_ok | far_ok);
+		if (!active.any()) {
+			continue;
+		}
+
+		best_t = select(active, root, best_t);
+		best_block = select(active, float8(float(block)), best_block);
+		hit_anything = true;
+	}
+
+	if (!hit_anything) {
+		return false;
+	}
+
+	// reduce to the nearest hit over all lanes
+	auto nearest_t = horizontal_min(best_t);
+	auto lane = first_lane(((best_t <= float8(nearest_t)) & (best_block >= zero)).bits());
+
+	float blocks[SIMD_WIDTH];
+	best_block.store(blocks);
+
+	auto index = first + static_cast<uint32_t>(blocks[lane]) * SIMD_WIDTH + static_cast<uint32_t>(lane);
+	register_hit(m_spheres[index], m_materials[index], ray, nearest_t, hit_record);
+	return true;
+}
+
+bool GeometrySpheres::occluded_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const {
+
+	float root;
+
+	for (uint32_t idx = first; idx < first + count; ++idx) {
+		if (intersect_sphere(m_spheres[idx], ray, t_min, t_max, root)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool GeometrySpheres::occluded_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const {
+
+	using namespace simd;
+
+	assert(m_spheres.size() >= first + count + SIMD_WIDTH - 1);
+
+	const auto origin = ray.origin();
+	const auto direction = ray.direction();
+
+	const float8 origin_x(origin.x), origin_y(origin.y), origin_z(origin.z);
+	const float8 dir_x(direction.x), dir_y(direction.y), dir_z(direction.z);
+	const float8 a(glm::dot(direction, direction));
+	const float8 zero(0.0f);
+	const float8 v_t_min(t_min);
+	const float8 v_t_max(t_max);
+
+	// same tests as hit_range_simd, but done as soon as one of the lanes reports a hit
+	for (uint32_t base = first; base < first + count; base += SIMD_WIDTH) {
+		auto active = float8::lane_index() < float8(float(first + count - base));
+
+		float8 center_x, center_y, center_z, radius;
+		load_transposed(&m_spheres[base].m_center.x, center_x, center_y, center_z, radius);
+
+		auto oc_x = origin_x - center_x;
+		auto oc_y = origin_y - center_y;
+		auto oc_z = origin_z - center_z;
+
+		auto half_b = oc_x * dir_x + oc_y * dir_y + oc_z * dir_z;
+		auto c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - radius * radius;
+		auto discriminant = half_b * half_b - a * c;
+
+		active = active & (discriminant >= zero);
+		if (!active.any()) {
+			continue;
+		}
+
+		auto sqrt_discriminant = sqrt(max(discriminant, zero));
+		auto root_near = (-half_b - sqrt_discriminant) / a;
+		auto root_far = (-half_b + sqrt_discriminant) / a;
+
+		auto near_ok = (root_near >= v_t_min) & (root_near <= v_t_max);
+		auto far_ok = (root_far >= v_t_min) & (root_far <= v_t_max);
+
+		if ((active & (near_ok | far_ok)).any()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void GeometrySpheres::hit_packet(const RayPacket &packet, float t_min, HitRecord *hit_records) const {
+
+	using namespace simd;
+
+	if (m_materials.empty()) {
+		return;
+	}
+
+	float t[RayPacket::SIZE];
+	uint32_t index[RayPacket::SIZE];
+
+	// only the lanes that contain a ray have a hit record
+	for (uint32_t lane = 0; lane < RayPacket::SIZE; ++lane) {
+		t[lane] = (packet.valid() & (1 << lane)) ? hit_records[lane].m_at_t : std::numeric_limits<float>::infinity();
+		index[lane] = NO_HIT;
+	}
+
+	auto best_t = float8::load(t);
+
+	auto hit_range = [this, &index](uint32_t first, uint32_t count, const RayPacket &p, mask8 active, float t0, float8 &best) {
+		RTIOW_STATS(m_primitive_tests += count);
+		hit_range_packet(first, count, p, active, t0, best, index);
+	};
+
+	if (m_bvh.empty()) {
+		hit_range(0, static_cast<uint32_t>(size()), packet, mask8::from_bits(packet.valid()), t_min, best_t);
+	} else {
+		m_bvh.hit_packet(packet, t_min, best_t, hit_range);
+	}
+
+	best_t.store(t);
+
+	for (uint32_t lane = 0; lane < RayPacket::SIZE; ++lane) {
+		if (index[lane] != NO_HIT) {
+			register_hit(m_spheres[index[lane]], m_materials[index[lane]], packet.ray(lane), t[lane], hit_records[lane]);
+		}
+	}
+}
+
+void GeometrySpheres::hit_range_packet(uint32_t first, uint32_t count, const RayPacket &packet, simd::mask8 active, float t_min,
+									   simd::float8 &best_t, uint32_t *best_index) const {
+
+	using namespace simd;
+
+	assert(m_spheres.size() >= first + count);
+
+	// one sphere against all rays of the packet, the same calculations as hit_range_simd
+	const float8 zero(0.0f);
+	const float8 v_t_min(t_min);
+	const auto &a = packet.direction_dot();
+
+	for (uint32_t idx = first; idx < first + count; ++idx) {
+		const auto &sphere = m_spheres[idx];
+		auto oc_x = packet.origin(0) - float8(sphere.m_center.x);
+		auto oc_y = packet.origin(1) - float8(sphere.m_center.y);
+		auto oc_z = packet.origin(2) - float8(sphere.m_center.z);
+		auto radius = float8(sphere.m_radius);
+
+		auto half_b = oc_x * packet.direction(0) + oc_y * packet.direction(1) + oc_z * packet.direction(2);
+		auto c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - radius * radius;
+		auto discriminant = half_b * half_b - a * c;
+
+		auto hit = active & (discriminant >= zero);
+		if (!hit.any()) {
+			continue;
+		}
+
+		auto sqrt_discriminant = sqrt(max(discriminant, zero));
+		auto root_near = (-half_b - sqrt_discriminant) / a;
+		auto root_far = (-half_b + sqrt_discriminant) / a;
+
+		auto near_ok = (root_near >= v_t_min) & (root_near <= best_t);
+		auto far_ok = (root_far >= v_t_min) & (root_far <= best_t);
+		auto root = select(near_ok, root_near, root_far);
+
+		hit = hit & (near_ok | far_ok);
+		auto bits = hit.bits();
+		if (bits == 0) {
+			continue;
+		}
+
+		best_t = select(hit, root, best_t);
+		for (; bits != 0; bits &= bits - 1) {
+			best_index[first_lane(bits)] = idx;
+		}
+	}
+}
 
 } // namespace rtiow
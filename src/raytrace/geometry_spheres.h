@@ -2,16 +2,19 @@
 #pragma once
 
 #include "geometry_base.h"
+#include "bvh.h"
 #include <vector>
 
 namespace rtiow {
 
-struct Sphere {
+// center and radius packed in 16 bytes (8 spheres fit in 2 cache lines), the material is kept in a parallel array
+struct alignas(16) Sphere {
 	point_t		m_center;
 	float		m_radius;
-	material_id_t	m_material;
 };
 
+static_assert(sizeof(Sphere) == 16, "the SIMD kernels load spheres as 4 consecutive floats");
+
 class GeometrySpheres: public GeometryBase {
 public:
 	// construction
@@ -24,11 +27,48 @@ public:
 	void clear();
 	void add_sphere(const point_t &center, float radius, material_id_t material);
 
+	// prepare for rendering: build the BVH of the acceleration structure (if any) and pad the spheres so the SIMD kernels can load 8 spheres from any index
+	void finalize(AccelerationStructure acceleration, BVHBuilder builder = BVHBuilder::BINNED, ThreadPool *pool = nullptr);
+	const BVH &bvh() const {return m_bvh;}
+
+	// restore finalized geometry: the spheres should be in the order of the leaves of the BVH nodes (if any),
+	//	the nodes are collapsed when the acceleration structure is a wide BVH
+	void restore(const Sphere *spheres, const material_id_t *materials, size_t count, const BVHNode *nodes, size_t node_count,
+				 AccelerationStructure acceleration);
+
+	// information
+	size_t size() const {return m_materials.size();}
+	const Sphere &sphere(uint32_t index) const {return m_spheres[index];}
+	material_id_t material(uint32_t index) const {return m_materials[index];}
+	const Sphere *sphere_data() const {return m_spheres.data();}
+	const material_id_t *material_data() const {return m_materials.data();}
+	size_t memory_usage() const;		// bytes used by the spheres, their materials and the BVH
+
 	// hit detection
 	bool hit(const Ray &ray, float t_min, HitRecord &hit_record) const;
+	bool occluded(const Ray &ray, float t_min, float t_max) const;
+
+	// hit detection for a packet of rays (requires the geometry to be finalized): the hit record of each lane that
+	//	hits something closer than its current hit is updated, hit_records only needs a record for the valid lanes
+	void hit_packet(const RayPacket &packet, float t_min, HitRecord *hit_records) const;
+
+	// intersection kernels for a range of spheres (public for benchmarking)
+	//	hit_range_simd, hit_range_packet and occluded_range_simd require the geometry to be finalized
+	bool hit_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const;
+	bool hit_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const;
+	void hit_range_packet(uint32_t first, uint32_t count, const RayPacket &packet, simd::mask8 active, float t_min,
+						  simd::float8 &best_t, uint32_t *best_index) const;
+	bool occluded_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const;
+	bool occluded_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const;
+
+private:
+	void pad();
+	bool is_padded() const {return m_spheres.size() > m_materials.size();}
 
 private:
-	std::vector<Sphere>		m_spheres;
+	std::vector<Sphere>			m_spheres;			// padded when finalized
+	std::vector<material_id_t>	m_materials;
+	BVH							m_bvh;
 };
 
 
@@ -0,0 +1,534 @@
+// raytrace/geometry_triangles.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+#include "geometry_triangles.h"
+#include "render_stats.h"
+#include "simd.h"
+
+#include <cassert>
+
+namespace rtiow {
+
+namespace {
+
+static constexpr uint32_t SIMD_WIDTH = 8;
+static constexpr uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+static constexpr float PARALLEL_EPSILON = 1e-8f;		// rays (almost) parallel to the plane of the triangle never hit it
+
+// Möller-Trumbore: intersection of the ray with the triangle in the range [t_min, t_max]
+static inline bool intersect_triangle(const point_t &v0, const vector_t &edge1, const vector_t &edge2, const Ray &ray,
+									  float t_min, float t_max, float &t) {
+	auto p = glm::cross(ray.direction(), edge2);
+	auto det = glm::dot(edge1, p);
+	if (det > -PARALLEL_EPSILON && det < PARALLEL_EPSILON) {
+		return false;
+	}
+
+	auto inv_det = 1.0f / det;
+	auto s = ray.origin() - v0;
+	auto u = glm::dot(s, p) * inv_det;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+
+	auto q = glm::cross(s, edge1);
+	auto v = glm::dot(ray.direction(), q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+
+	t = glm::dot(edge2, q) * inv_det;
+	return t >= t_min && t <= t_max;
+}
+
+} // unnamed namespace
+
+void GeometryTriangles::clear() {
+	m_vertex_x.clear();
+	m_vertex_y.clear();
+	m_vertex_z.clear();
+	m_triangles.clear();
+	m_bvh.clear();
+	build_soa();
+}
+
+uint32_t GeometryTriangles::add_vertex(const point_t &position) {
+	m_vertex_x.push_back(position.x);
+	m_vertex_y.push_back(position.y);
+	m_vertex_z.push_back(position.z);
+	return static_cast<uint32_t>(m_vertex_x.size() - 1);
+}
+
+size_t GeometryTriangles::memory_usage() const {
+	size_t soa = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		soa += m_v0[axis].size() + m_edge1[axis].size() + m_edge2[axis].size();
+	}
+
+	return (m_vertex_x.size() + m_vertex_y.size() + m_vertex_z.size() + soa) * sizeof(float) +
+		   m_triangles.size() * sizeof(Triangle) +
+		   m_bvh.memory_usage();
+}
+
+void GeometryTriangles::add_triangle(uint32_t v0, uint32_t v1, uint32_t v2, material_id_t material) {
+	assert(v0 < vertex_count() && v1 < vertex_count() && v2 < vertex_count());
+	m_triangles.push_back(Triangle{{v0, v1, v2}, material});
+
+	// the acceleration structures are no longer valid
+	m_bvh.clear();
+	m_v0[0].clear();
+}
+
+void GeometryTriangles::add_mesh(const std::vector<point_t> &vertices, const std::vector<uint32_t> &indices, material_id_t material) {
+	assert(indices.size() % 3 == 0);
+
+	const auto base = static_cast<uint32_t>(vertex_count());
+
+	for (const auto &v : vertices) {
+		add_vertex(v);
+	}
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		add_triangle(base + indices[i], base + indices[i + 1], base + indices[i + 2], material);
+	}
+}
+
+uint32_t GeometryTriangles::append_vertices(size_t count) {
+	auto first = vertex_count();
+	m_vertex_x.resize(first + count);
+	m_vertex_y.resize(first + count);
+	m_vertex_z.resize(first + count);
+	return static_cast<uint32_t>(first);
+}
+
+uint32_t GeometryTriangles::append_triangles(size_t count) {
+	auto first = m_triangles.size();
+	m_triangles.resize(first + count);
+
+	// the acceleration structures are no longer valid
+	m_bvh.clear();
+	m_v0[0].clear();
+
+	return static_cast<uint32_t>(first);
+}
+
+void GeometryTriangles::set_vertex(uint32_t index, const point_t &position) {
+	m_vertex_x[index] = position.x;
+	m_vertex_y[index] = position.y;
+	m_vertex_z[index] = position.z;
+}
+
+void GeometryTriangles::set_triangle(uint32_t index, uint32_t v0, uint32_t v1, uint32_t v2, material_id_t material) {
+	assert(v0 < vertex_count() && v1 < vertex_count() && v2 < vertex_count());
+	m_triangles[index] = Triangle{{v0, v1, v2}, material};
+}
+
+void GeometryTriangles::finalize(AccelerationStructure acceleration, BVHBuilder builder, ThreadPool *pool) {
+
+	if (acceleration == AccelerationStructure::NONE) {
+		m_bvh.clear();
+		build_soa();
+		return;
+	}
+
+	std::vector<AABB> bounds;
+	bounds.reserve(m_triangles.size());
+
+	for (const auto &tri : m_triangles) {
+		AABB box;
+		for (auto v : tri.m_vertex) {
+			box.grow(vertex(v));
+		}
+		bounds.push_back(box);
+	}
+
+	std::vector<uint32_t> order;
+	m_bvh.build(bounds, order, builder, pool);
+	m_bvh.collapse(bvh_width(acceleration));
+
+	// store the triangles in the order of the leaves of the BVH (the vertices are left as is)
+	std::vector<Triangle> sorted;
+	sorted.reserve(m_triangles.size());
+	for (auto idx : order) {
+		sorted.push_back(m_triangles[idx]);
+	}
+	m_triangles = std::move(sorted);
+
+	build_soa();
+}
+
+void GeometryTriangles::restore(const float *vertex_x, const float *vertex_y, const float *vertex_z, size_t vertex_count,
+								const Triangle *triangles, size_t count, const BVHNode *nodes, size_t node_count,
+								AccelerationStructure acceleration) {
+	m_vertex_x.assign(vertex_x, vertex_x + vertex_count);
+	m_vertex_y.assign(vertex_y, vertex_y + vertex_count);
+	m_vertex_z.assign(vertex_z, vertex_z + vertex_count);
+	m_triangles.assign(triangles, triangles + count);
+	m_bvh.assign(nodes, node_count);
+	m_bvh.collapse(bvh_width(acceleration));
+	build_soa();
+}
+
+void GeometryTriangles::build_soa() {
+
+	auto padded_size = ((m_triangles.size() + 2 * SIMD_WIDTH - 1) / SIMD_WIDTH) * SIMD_WIDTH;
+
+	for (int axis = 0; axis < 3; ++axis) {
+		m_v0[axis].assign(padded_size, 0.0f);
+		m_edge1[axis].assign(padded_size, 0.0f);
+		m_edge2[axis].assign(padded_size, 0.0f);
+	}
+
+	for (size_t idx = 0; idx < m_triangles.size(); ++idx) {
+		const auto &tri = m_triangles[idx];
+		auto v0 = vertex(tri.m_vertex[0]);
+		auto edge1 = vertex(tri.m_vertex[1]) - v0;
+		auto edge2 = vertex(tri.m_vertex[2]) - v0;
+
+		for (int axis = 0; axis < 3; ++axis) {
+			m_v0[axis][idx] = v0[axis];
+			m_edge1[axis][idx] = edge1[axis];
+			m_edge2[axis][idx] = edge2[axis];
+		}
+	}
+}
+
+void GeometryTriangles::register_hit(uint32_t index, const Ray &ray, float t, HitRecord &hit_record) const {
+	const auto &tri = m_triangles[index];
+	auto v0 = vertex(tri.m_vertex[0]);
+	auto normal = glm::normalize(glm::cross(vertex(tri.m_vertex[1]) - v0, vertex(tri.m_vertex[2]) - v0));
+
+	hit_record.m_at_t		= t;
+	hit_record.m_point		= ray.at(t);
+	hit_record.m_material	= tri.m_material;
+	hit_record.set_face_normal(ray, normal);
+}
+
+bool GeometryTriangles::hit(const Ray &ray, float t_min, HitRecord &hit_record) const {
+
+	if (m_triangles.empty()) {
+		return false;
+	}
+
+	// the emulated SIMD kernel is slower than the scalar one when no SIMD instruction set is available
+	auto use_simd = simd::ENABLED && !m_v0[0].empty();
+
+	auto hit_range = [this, use_simd](uint32_t first, uint32_t count, const Ray &r, float t, HitRecord &hr) {
+		RTIOW_STATS(m_primitive_tests += count);
+		return use_simd ? hit_range_simd(first, count, r, t, hr) : hit_range_scalar(first, count, r, t, hr);
+	};
+
+	if (m_bvh.empty()) {
+		// brute force: check every triangle
+		return hit_range(0, static_cast<uint32_t>(m_triangles.size()), ray, t_min, hit_record);
+	}
+
+	return m_bvh.hit(ray, t_min, hit_record, hit_range);
+}
+
+bool GeometryTriangles::occluded(const Ray &ray, float t_min, float t_max) const {
+
+	if (m_triangles.empty()) {
+		return false;
+	}
+
+	auto use_simd = simd::ENABLED && !m_v0[0].empty();
+
+	auto occluded_range = [this, use_simd](uint32_t first, uint32_t count, const Ray &r, float t0, float t1) {
+		RTIOW_STATS(m_primitive_tests += count);
+		return use_simd ? occluded_range_simd(first, count, r, t0, t1) : occluded_range_scalar(first, count, r, t0, t1);
+	};
+
+	if (m_bvh.empty()) {
+		return occluded_range(0, static_cast<uint32_t>(m_triangles.size()), ray, t_min, t_max);
+	}
+
+	return m_bvh.occluded(ray, t_min, t_max, occluded_range);
+}
+
+bool GeometryTriangles::hit_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const {
+
+	bool hit_anything = false;
+	uint32_t hit_index = 0;
+	float best_t = hit_record.m_at_t;
+
+	for (uint32_t idx = first; idx < first + count; ++idx) {
+		const auto &tri = m_triangles[idx];
+		auto v0 = vertex(tri.m_vertex[0]);
+
+		float t;
+		if (!intersect_triangle(v0, vertex(tri.m_vertex[1]) - v0, vertex(tri.m_vertex[2]) - v0, ray, t_min, best_t, t)) {
+			continue;
+		}
+
+		best_t = t;
+		hit_index = idx;
+		hit_anything = true;
+	}
+
+	if (hit_anything) {
+		register_hit(hit_index, ray, best_t, hit_record);
+	}
+
+	return hit_anything;
+}
+
+bool GeometryTriangles::hit_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const {
+
+	using namespace simd;
+
+	assert(m_v0[0].size() >= first + count + SIMD_WIDTH - 1);
+
+	const auto origin = ray.origin();
+	const auto direction = ray.direction();
+
+	const float8 origin_x(origin.x), origin_y(origin.y), origin_z(origin.z);
+	const float8 dir_x(direction.x), dir_y(direction.y), dir_z(direction.z);
+	const float8 zero(0.0f);
+	const float8 one(1.0f);
+	const float8 epsilon(PARALLEL_EPSILON);
+	const float8 v_t_min(t_min);
+
+	// per lane: distance to the nearest hit so far and the block of 8 triangles that contains the triangle that was hit
+	float8 best_t(hit_record.m_at_t);
+	float8 best_block(-1.0f);
+	bool hit_anything = false;
+
+	for (uint32_t base = first, block = 0; base < first + count; base += SIMD_WIDTH, ++block) {
+		auto active = float8::lane_index() < float8(float(first + count - base));
+
+		auto e1_x = float8::load(&m_edge1[0][base]);
+		auto e1_y = float8::load(&m_edge1[1][base]);
+		auto e1_z = float8::load(&m_edge1[2][base]);
+		auto e2_x = float8::load(&m_edge2[0][base]);
+		auto e2_y = float8::load(&m_edge2[1][base]);
+		auto e2_z = float8::load(&m_edge2[2][base]);
+
+		// p = direction x edge2
+		auto p_x = dir_y * e2_z - dir_z * e2_y;
+		auto p_y = dir_z * e2_x - dir_x * e2_z;
+		auto p_z = dir_x * e2_y - dir_y * e2_x;
+
+		auto det = e1_x * p_x + e1_y * p_y + e1_z * p_z;
+		active = active & ((det > epsilon) | (det < -epsilon));
+		if (!active.any()) {
+			continue;
+		}
+
+		auto inv_det = one / det;
+
+		auto s_x = origin_x - float8::load(&m_v0[0][base]);
+		auto s_y = origin_y - float8::load(&m_v0[1][base]);
+		auto s_z = origin_z - float8::load(&m_v0[2][base]);
+
+		auto u = (s_x * p_x + s_y * p_y + s_z * p_z) * inv_det;
+
+		// q = s x edge1
+		auto q_x = s_y * e1_z - s_z * e1_y;
+		auto q_y = s_z * e1_x - s_x * e1_z;
+		auto q_z = s_x * e1_y - s_y * e1_x;
+
+		auto v = (dir_x * q_x + dir_y * q_y + dir_z * q_z) * inv_det;
+		auto t = (e2_x * q_x + e2_y * q_y + e2_z * q_z) * inv_det;
+
+		active = active & (u >= zero) & (v >= zero) & ((u + v) <= one) & (t >= v_t_min) & (t <= best_t);
+		if (!active.any()) {
+			continue;
+		}
+
+		best_t = select(active, t, best_t);
+		best_block = select(active, float8(float(block)), best_block);
+		hit_anything = true;
+	}
+
+	if (!hit_anything) {
+		return false;
+	}
+
+	// reduce to the nearest hit over all lanes
+	auto nearest_t = horizontal_min(best_t);
+	auto lane = first_lane(((best_t <= float8(nearest_t)) & (best_block >= zero)).bits());
+
+	float blocks[SIMD_WIDTH];
+	best_block.store(blocks);
+
+	auto index = first + static_cast<uint32_t>(blocks[lane]) * SIMD_WIDTH + static_cast<uint32_t>(lane);
+	register_hit(index, ray, nearest_t, hit_record);
+	return true;
+}
+
+bool GeometryTriangles::occluded_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const {
+
+	for (uint32_t idx = first; idx < first + count; ++idx) {
+		const auto &tri = m_triangles[idx];
+		auto v0 = vertex(tri.m_vertex[0]);
+
+		float t;
+		if (intersect_triangle(v0, vertex(tri.m_vertex[1]) - v0, vertex(tri.m_vertex[2]) - v0, ray, t_min, t_max, t)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool GeometryTriangles::occluded_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const {
+
+	using namespace simd;
+
+	assert(m_v0[0].size() >= first + count + SIMD_WIDTH - 1);
+
+	const auto origin = ray.origin();
+	const auto direction = ray.direction();
+
+	const float8 origin_x(origin.x), origin_y(origin.y), origin_z(origin.z);
+	const float8 dir_x(direction.x), dir_y(direction.y), dir_z(direction.z);
+	const float8 zero(0.0f);
+	const float8 one(1.0f);
+	const float8 epsilon(PARALLEL_EPSILON);
+	const float8 v_t_min(t_min);
+	const float8 v_t_max(t_max);
+
+	// same tests as hit_range_simd, but done as soon as one of the lanes reports a hit
+	for (uint32_t base = first; base < first + count; base += SIMD_WIDTH) {
+		auto active = float8::lane_index() < float8(float(first + count - base));
+
+		auto e1_x = float8::load(&m_edge1[0][base]);
+		auto e1_y = float8::load(&m_edge1[1][base]);
+		auto e1_z = float8::load(&m_edge1[2][base]);
+		auto e2_x = float8::load(&m_edge2[0][base]);
+		auto e2_y = float8::load(&m_edge2[1][base]);
+		auto e2_z = float8::load(&m_edge2[2][base]);
+
+		auto p_x = dir_y * e2_z - dir_z * e2_y;
+		auto p_y = dir_z * e2_x - dir_x * e2_z;
+		auto p_z = dir_x * e2_y - dir_y * e2_x;
+
+		auto det = e1_x * p_x + e1_y * p_y + e1_z * p_z;
+		active = active & ((det > epsilon) | (det < -epsilon));
+		if (!active.any()) {
+			continue;
+		}
+
+		auto inv_det = one / det;
+
+		auto s_x = origin_x - float8::load(&m_v0[0][base]);
+		auto s_y = origin_y - float8::load(&m_v0[1][base]);
+		auto s_z = origin_z - float8::load(&m_v0[2][base]);
+
+		auto u = (s_x * p_x + s_y * p_y + s_z * p_z) * inv_det;
+
+		auto q_x = s_y * e1_z - s_z * e1_y;
+		auto q_y = s_z * e1_x - s_x * e1_z;
+		auto q_z = s_x * e1_y - s_y * e1_x;
+
+		auto v = (dir_x * q_x + dir_y * q_y + dir_z * q_z) * inv_det;
+		auto t = (e2_x * q_x + e2_y * q_y + e2_z * q_z) * inv_det;
+
+		if ((active & (u >= zero) & (v >= zero) & ((u + v) <= one) & (t >= v_t_min) & (t <= v_t_max)).any()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void GeometryTriangles::hit_packet(const RayPacket &packet, float t_min, HitRecord *hit_records) const {
+
+	using namespace simd;
+
+	if (m_triangles.empty()) {
+		return;
+	}
+
+	float t[RayPacket::SIZE];
+	uint32_t index[RayPacket::SIZE];
+
+	// only the lanes that contain a ray have a hit record
+	for (uint32_t lane = 0; lane < RayPacket::SIZE; ++lane) {
+		t[lane] = (packet.valid() & (1 << lane)) ? hit_records[lane].m_at_t : std::numeric_limits<float>::infinity();
+		index[lane] = NO_HIT;
+	}
+
+	auto best_t = float8::load(t);
+
+	auto hit_range = [this, &index](uint32_t first, uint32_t count, const RayPacket &p, mask8 active, float t0, float8 &best) {
+		RTIOW_STATS(m_primitive_tests += count);
+		hit_range_packet(first, count, p, active, t0, best, index);
+	};
+
+	if (m_bvh.empty()) {
+		hit_range(0, static_cast<uint32_t>(m_triangles.size()), packet, mask8::from_bits(packet.valid()), t_min, best_t);
+	} else {
+		m_bvh.hit_packet(packet, t_min, best_t, hit_range);
+	}
+
+	best_t.store(t);
+
+	for (uint32_t lane = 0; lane < RayPacket::SIZE; ++lane) {
+		if (index[lane] != NO_HIT) {
+			register_hit(index[lane], packet.ray(lane), t[lane], hit_records[lane]);
+		}
+	}
+}
+
+void GeometryTriangles::hit_range_packet(uint32_t first, uint32_t count, const RayPacket &packet, simd::mask8 active, float t_min,
+										 simd::float8 &best_t, uint32_t *best_index) const {
+
+	using namespace simd;
+
+	assert(m_v0[0].size() >= first + count);
+
+	// one triangle against all rays of the packet, the same calculations as hit_range_simd
+	const float8 zero(0.0f);
+	const float8 one(1.0f);
+	const float8 epsilon(PARALLEL_EPSILON);
+	const float8 v_t_min(t_min);
+
+	const auto &dir_x = packet.direction(0);
+	const auto &dir_y = packet.direction(1);
+	const auto &dir_z = packet.direction(2);
+
+	for (uint32_t idx = first; idx < first + count; ++idx) {
+		const float8 e1_x(m_edge1[0][idx]), e1_y(m_edge1[1][idx]), e1_z(m_edge1[2][idx]);
+		const float8 e2_x(m_edge2[0][idx]), e2_y(m_edge2[1][idx]), e2_z(m_edge2[2][idx]);
+
+		// p = direction x edge2
+		auto p_x = dir_y * e2_z - dir_z * e2_y;
+		auto p_y = dir_z * e2_x - dir_x * e2_z;
+		auto p_z = dir_x * e2_y - dir_y * e2_x;
+
+		auto det = e1_x * p_x + e1_y * p_y + e1_z * p_z;
+		auto hit = active & ((det > epsilon) | (det < -epsilon));
+		if (!hit.any()) {
+			continue;
+		}
+
+		auto inv_det = one / det;
+
+		auto s_x = packet.origin(0) - float8(m_v0[0][idx]);
+		auto s_y = packet.origin(1) - float8(m_v0[1][idx]);
+		auto s_z = packet.origin(2) - float8(m_v0[2][idx]);
+
+		auto u = (s_x * p_x + s_y * p_y + s_z * p_z) * inv_det;
+
+		// q = s x edge1
+		auto q_x = s_y * e1_z - s_z * e1_y;
+		auto q_y = s_z * e1_x - s_x * e1_z;
+		auto q_z = s_x * e1_y - s_y * e1_x;
+
+		auto v = (dir_x * q_x + dir_y * q_y + dir_z * q_z) * inv_det;
+		auto t = (e2_x * q_x + e2_y * q_y + e2_z * q_z) * inv_det;
+
+		hit = hit & (u >= zero) & (v >= zero) & ((u + v) <= one) & (t >= v_t_min) & (t <= best_t);
+		auto bits = hit.bits();
+		if (bits == 0) {
+			continue;
+		}
+
+		best_t = select(hit, t, best_t);
+		for (; bits != 0; bits &= bits - 1) {
+			best_index[first_lane(bits)] = idx;
+		}
+	}
+}
+
+} // namespace rtiow
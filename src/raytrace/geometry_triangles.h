@@ -0,0 +1,95 @@
+// raytrace/geometry_triangles.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// indexed triangle meshes
+#pragma once
+
+#include "geometry_base.h"
+#include "bvh.h"
+#include <vector>
+
+namespace rtiow {
+
+struct Triangle {
+	uint32_t		m_vertex[3];		// indices into the vertex arrays
+	material_id_t	m_material;
+};
+
+class GeometryTriangles: public GeometryBase {
+public:
+	// construction
+	GeometryTriangles() = default;
+	GeometryTriangles(const GeometryTriangles &other) = delete;
+	GeometryTriangles(const GeometryTriangles &&other) = delete;
+	virtual ~GeometryTriangles() = default ;
+
+	// object interface
+	void clear();
+	uint32_t add_vertex(const point_t &position);
+	void add_triangle(uint32_t v0, uint32_t v1, uint32_t v2, material_id_t material);
+
+	// add a complete mesh: the indices (3 per triangle) are relative to the start of the vertices of the mesh
+	void add_mesh(const std::vector<point_t> &vertices, const std::vector<uint32_t> &indices, material_id_t material);
+
+	// bulk interface for loaders: make room for a number of vertices or triangles and return the index of the first one,
+	//	the new elements can then be filled in from multiple threads (as long as each index is written by one thread)
+	uint32_t append_vertices(size_t count);
+	uint32_t append_triangles(size_t count);
+	void set_vertex(uint32_t index, const point_t &position);
+	void set_triangle(uint32_t index, uint32_t v0, uint32_t v1, uint32_t v2, material_id_t material);
+
+	// prepare for rendering: build the BVH of the acceleration structure (if any) and create the structure-of-arrays copy used by the SIMD kernel
+	void finalize(AccelerationStructure acceleration, BVHBuilder builder = BVHBuilder::BINNED, ThreadPool *pool = nullptr);
+	const BVH &bvh() const {return m_bvh;}
+
+	// restore finalized geometry: the triangles should be in the order of the leaves of the BVH nodes (if any),
+	//	the nodes are collapsed when the acceleration structure is a wide BVH
+	void restore(const float *vertex_x, const float *vertex_y, const float *vertex_z, size_t vertex_count,
+				 const Triangle *triangles, size_t count, const BVHNode *nodes, size_t node_count,
+				 AccelerationStructure acceleration);
+
+	// information
+	size_t size() const {return m_triangles.size();}
+	size_t vertex_count() const {return m_vertex_x.size();}
+	point_t vertex(uint32_t index) const {return {m_vertex_x[index], m_vertex_y[index], m_vertex_z[index]};}
+	const std::vector<float> &vertex_coordinates(int axis) const {return axis == 0 ? m_vertex_x : (axis == 1 ? m_vertex_y : m_vertex_z);}
+	const std::vector<Triangle> &triangles() const {return m_triangles;}
+	size_t memory_usage() const;		// bytes used by the vertices, the triangles, their SIMD copy and the BVH
+
+	// hit detection
+	bool hit(const Ray &ray, float t_min, HitRecord &hit_record) const;
+	bool occluded(const Ray &ray, float t_min, float t_max) const;
+
+	// hit detection for a packet of rays (requires the geometry to be finalized): the hit record of each lane that
+	//	hits something closer than its current hit is updated, hit_records only needs a record for the valid lanes
+	void hit_packet(const RayPacket &packet, float t_min, HitRecord *hit_records) const;
+
+	// intersection kernels for a range of triangles (public for benchmarking)
+	//	hit_range_simd, hit_range_packet and occluded_range_simd require the geometry to be finalized
+	bool hit_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const;
+	bool hit_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, HitRecord &hit_record) const;
+	void hit_range_packet(uint32_t first, uint32_t count, const RayPacket &packet, simd::mask8 active, float t_min,
+						  simd::float8 &best_t, uint32_t *best_index) const;
+	bool occluded_range_scalar(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const;
+	bool occluded_range_simd(uint32_t first, uint32_t count, const Ray &ray, float t_min, float t_max) const;
+
+private:
+	void build_soa();
+	void register_hit(uint32_t index, const Ray &ray, float t, HitRecord &hit_record) const;
+
+private:
+	// vertex positions (structure-of-arrays)
+	std::vector<float>		m_vertex_x;
+	std::vector<float>		m_vertex_y;
+	std::vector<float>		m_vertex_z;
+
+	std::vector<Triangle>	m_triangles;
+	BVH						m_bvh;
+
+	// per triangle data for the SIMD kernel (first vertex and both edges, structure-of-arrays),
+	// padded so 8 lanes can be loaded from any starting index
+	std::vector<float>		m_v0[3];
+	std::vector<float>		m_edge1[3];
+	std::vector<float>		m_edge2[3];
+};
+
+} // namespace rtiow
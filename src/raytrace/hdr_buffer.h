@@ -0,0 +1,57 @@
+// raytrace/hdr_buffer.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// floating point (RGB32F) image buffer, used to accumulate samples over multiple render passes
+//	Besides the sum of the samples, each pixel keeps its number of samples and the sum of the squared sample
+//	luminance, enough to estimate the variance of the pixel for adaptive sampling.
+
+#pragma once
+
+#include "types.h"
+#include <algorithm>
+#include <vector>
+
+namespace rtiow {
+
+class HDRBuffer {
+public:
+	// construction
+	HDRBuffer() = delete;
+	HDRBuffer(uint32_t width, uint32_t height) : m_width(width), m_height(height) {
+		m_buffer.resize(size_t(width) * height);
+		m_sample_count.resize(size_t(width) * height);
+		m_luminance_sq.resize(size_t(width) * height);
+	}
+	HDRBuffer(const HDRBuffer &other) = delete;
+
+	void clear() {
+		std::fill(m_buffer.begin(), m_buffer.end(), color_t(0.0f, 0.0f, 0.0f));
+		std::fill(m_sample_count.begin(), m_sample_count.end(), 0u);
+		std::fill(m_luminance_sq.begin(), m_luminance_sq.end(), 0.0f);
+	}
+
+	// data access
+	uint32_t width() const {return m_width;}
+	uint32_t height() const {return m_height;}
+
+	const color_t *data() const {return m_buffer.data();}
+	color_t *data() {return m_buffer.data();}
+
+	const uint32_t *sample_count() const {return m_sample_count.data();}
+	uint32_t *sample_count() {return m_sample_count.data();}
+
+	const float *luminance_sq() const {return m_luminance_sq.data();}
+	float *luminance_sq() {return m_luminance_sq.data();}
+
+private:
+	uint32_t				m_width;
+	uint32_t				m_height;
+	std::vector<color_t>	m_buffer;			// sum of all samples
+	std::vector<uint32_t>	m_sample_count;		// number of samples
+	std::vector<float>		m_luminance_sq;		// sum of the squared luminance of all samples
+};
+
+inline float luminance(const color_t &c) {
+	return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+} // namespace rtiow
@@ -0,0 +1,44 @@
+// raytrace/material.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "material.h"
+
+namespace rtiow {
+
+void MaterialTable::clear() {
+	m_lobes.clear();
+	m_albedo.clear();
+	m_specular.clear();
+	m_refraction.clear();
+	m_emission.clear();
+}
+
+void MaterialTable::build(const std::vector<Material> &materials) {
+	clear();
+
+	m_lobes.reserve(materials.size());
+	m_albedo.reserve(materials.size());
+	m_specular.reserve(materials.size());
+	m_refraction.reserve(materials.size());
+	m_emission.reserve(materials.size());
+
+	for (const auto &mat : materials) {
+		auto &lobes = m_lobes.emplace_back();
+		lobes.m_specular_cdf = mat.m_specular_chance;
+		lobes.m_refraction_cdf = mat.m_specular_chance + mat.m_refraction_chance;
+		lobes.m_probability[LOBE_SPECULAR] = glm::max(mat.m_specular_chance, 0.001f);
+		lobes.m_probability[LOBE_REFRACTION] = glm::max(mat.m_refraction_chance, 0.001f);
+		lobes.m_probability[LOBE_DIFFUSE] = glm::max(1.0f - mat.m_specular_chance - mat.m_refraction_chance, 0.001f);
+		lobes.m_emissive = mat.is_emissive() ? 1 : 0;
+
+		m_albedo.push_back(mat.m_albedo);
+		m_specular.push_back({mat.m_specular_color, mat.m_specular_roughness});
+		m_refraction.push_back({mat.m_refraction_color, mat.m_refraction_roughness, mat.m_index_of_refraction});
+		m_emission.push_back(mat.m_emission);
+	}
+}
+
+size_t MaterialTable::memory_usage() const {
+	return m_lobes.size() * (sizeof(MaterialLobes) + sizeof(color_t) + sizeof(SpecularLobe) + sizeof(RefractionLobe) + sizeof(color_t));
+}
+
+} // namespace rtiow
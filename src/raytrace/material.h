@@ -0,0 +1,89 @@
+// raytrace/material.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// materials: the description used to build scenes and the compact table used while rendering
+//	The table stores the materials per lobe (structure of arrays). Choosing the type of reflection only needs the
+//	precomputed lobe probabilities of the material, after that only the parameters of the chosen lobe are loaded.
+
+#pragma once
+
+#include "types.h"
+
+#include <cassert>
+#include <vector>
+
+namespace rtiow {
+
+struct Material {
+	color_t		m_albedo;
+
+	float		m_specular_chance;			// chance that the reflection will choose the specular path instead of the diffuse (0 .. 1)
+	color_t		m_specular_color;			// color of specular reflection
+	float		m_specular_roughness;		// how blurry the specular reflection is (from 0.0 == sharp to 1.0 == blurry)
+
+	float		m_index_of_refraction;
+	float		m_refraction_chance;		// change that the reflection will choose the refraction path (0 .. 1 - specular-change)
+	color_t		m_refraction_color;			// color of the refraction
+	float		m_refraction_roughness;		// how blurry the refraction is (from 0.0 == sharp to 1.0 == blurry)
+
+	color_t		m_emission;					// light emitted by the front face (black for materials that aren't a light)
+
+	bool is_emissive() const {return m_emission.r > 0.0f || m_emission.g > 0.0f || m_emission.b > 0.0f;}
+};
+
+enum MaterialLobe : uint32_t {
+	LOBE_SPECULAR = 0,
+	LOBE_REFRACTION = 1,
+	LOBE_DIFFUSE = 2
+};
+
+// cumulative distribution of the lobes of a material: a uniform random value picks the lobe
+struct MaterialLobes {
+	float		m_specular_cdf;				// value <= m_specular_cdf: specular reflection
+	float		m_refraction_cdf;			// value <= m_refraction_cdf: refraction, otherwise diffuse reflection
+	float		m_probability[3];			// probability of each lobe (clamped to avoid dividing by zero), see MaterialLobe
+	uint32_t	m_emissive;					// the material is a light and doesn't reflect
+};
+
+struct SpecularLobe {
+	color_t		m_color;
+	float		m_roughness;
+};
+
+struct RefractionLobe {
+	color_t		m_color;					// also absorption inside the object
+	float		m_roughness;
+	float		m_index_of_refraction;
+};
+
+class MaterialTable {
+public:
+	// construction
+	MaterialTable() = default;
+	void clear();
+	void build(const std::vector<Material> &materials);
+
+	// data access
+	size_t size() const {return m_lobes.size();}
+	bool is_emissive(material_id_t id) const {return lobes(id).m_emissive != 0;}
+
+	const MaterialLobes &lobes(material_id_t id) const {
+		assert(id < m_lobes.size());
+		return m_lobes[id];
+	}
+	const color_t &albedo(material_id_t id) const {return m_albedo[id];}
+	const SpecularLobe &specular(material_id_t id) const {return m_specular[id];}
+	const RefractionLobe &refraction(material_id_t id) const {return m_refraction[id];}
+	const color_t &emission(material_id_t id) const {return m_emission[id];}
+
+	// information
+	size_t memory_usage() const;
+
+private:
+	std::vector<MaterialLobes>	m_lobes;
+	std::vector<color_t>		m_albedo;		// diffuse lobe
+	std::vector<SpecularLobe>	m_specular;
+	std::vector<RefractionLobe>	m_refraction;
+	std::vector<color_t>		m_emission;
+};
+
+} // namespace rtiow
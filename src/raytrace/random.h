@@ -0,0 +1,64 @@
+// raytrace/random.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// small and fast pseudo random number generator (PCG32, see https://www.pcg-random.org)
+//	Generators are cheap to create and are seeded explicitly, e.g. per pixel sample, so the result of a
+//	render doesn't depend on which thread rendered which part of the image.
+
+#pragma once
+
+#include "types.h"
+
+namespace rtiow {
+
+class RandomGenerator {
+public:
+	// construction
+	RandomGenerator() : RandomGenerator(0) {
+	}
+
+	explicit RandomGenerator(uint64_t seed, uint64_t sequence = 0) {
+		this->seed(seed, sequence);
+	}
+
+	void seed(uint64_t seed, uint64_t sequence = 0) {
+		m_state = 0;
+		m_increment = (sequence << 1u) | 1u;
+		next_uint();
+		m_state += seed;
+		next_uint();
+	}
+
+	// generation
+	uint32_t next_uint() {
+		auto old_state = m_state;
+		m_state = old_state * 6364136223846793005ull + m_increment;
+		auto xor_shifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+		auto rot = static_cast<uint32_t>(old_state >> 59u);
+		return (xor_shifted >> rot) | (xor_shifted << ((~rot + 1u) & 31u));
+	}
+
+	// uniform float in [0, 1)
+	float next_float() {
+		return static_cast<float>(next_uint() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t	m_state;
+	uint64_t	m_increment;
+};
+
+// mix several values into a well distributed 64-bit seed (splitmix64 finalizer)
+inline uint64_t random_seed(uint64_t a, uint64_t b = 0, uint64_t c = 0) {
+	auto mix = [](uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	};
+
+	return mix(mix(mix(a + 0x9e3779b97f4a7c15ull) ^ b) ^ c);
+}
+
+} // namespace rtiow
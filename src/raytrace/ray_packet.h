@@ -0,0 +1,150 @@
+// raytrace/ray_packet.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// packet of (up to) 8 coherent rays that are traced through the acceleration structures together
+//	Used for the primary rays: the rays of a packet start (nearly) at the same point and have similar directions, so
+//	they mostly visit the same BVH nodes and the node tests can be done for all rays at once. Besides the rays
+//	(structure-of-arrays) the packet keeps the bounds of the origins and the reciprocal directions of its rays: with
+//	interval arithmetic this rejects a node for the whole packet at the cost of a single scalar box test.
+
+#pragma once
+
+#include "aabb.h"
+#include "ray.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace rtiow {
+
+class RayPacket {
+public:
+	static constexpr uint32_t SIZE = 8;
+
+public:
+	// construction
+	RayPacket(const Ray *rays, uint32_t count) : m_rays(rays), m_valid((1 << count) - 1) {
+		assert(count > 0 && count <= SIZE);
+
+		float lanes[3][3][SIZE];
+
+		for (uint32_t lane = 0; lane < SIZE; ++lane) {
+			// unused lanes repeat the first ray to avoid surprises (NaN, ...) in the calculations
+			const auto &ray = rays[lane < count ? lane : 0];
+			const auto inv_direction = 1.0f / ray.direction();
+
+			for (int axis = 0; axis < 3; ++axis) {
+				lanes[0][axis][lane] = ray.origin()[axis];
+				lanes[1][axis][lane] = ray.direction()[axis];
+				lanes[2][axis][lane] = inv_direction[axis];
+			}
+
+			if (lane == 0) {
+				m_origin_min = m_origin_max = ray.origin();
+				m_inv_direction_min = m_inv_direction_max = inv_direction;
+			} else {
+				m_origin_min = glm::min(m_origin_min, ray.origin());
+				m_origin_max = glm::max(m_origin_max, ray.origin());
+				m_inv_direction_min = glm::min(m_inv_direction_min, inv_direction);
+				m_inv_direction_max = glm::max(m_inv_direction_max, inv_direction);
+			}
+		}
+
+		for (int axis = 0; axis < 3; ++axis) {
+			m_origin[axis] = simd::float8::load(lanes[0][axis]);
+			m_direction[axis] = simd::float8::load(lanes[1][axis]);
+			m_inv_direction[axis] = simd::float8::load(lanes[2][axis]);
+
+			// interval arithmetic only works when no ray is (nearly) parallel to the slabs and all rays point the same way
+			m_interval_valid[axis] = std::isfinite(m_inv_direction_min[axis]) && std::isfinite(m_inv_direction_max[axis]) &&
+									 ((m_inv_direction_min[axis] > 0.0f) == (m_inv_direction_max[axis] > 0.0f));
+		}
+
+		// same evaluation order as glm::dot, the SIMD kernels should produce exactly the same result as for single rays
+		m_direction_dot = m_direction[0] * m_direction[0] + m_direction[1] * m_direction[1] + m_direction[2] * m_direction[2];
+	}
+
+	// data access
+	const Ray &ray(uint32_t lane) const {return m_rays[lane];}
+	int valid() const {return m_valid;}
+
+	const simd::float8 &origin(int axis) const {return m_origin[axis];}
+	const simd::float8 &direction(int axis) const {return m_direction[axis];}
+	const simd::float8 &direction_dot() const {return m_direction_dot;}
+
+	// box test: returns the lanes of 'active' that hit the box within [t_min, t_max] and their entry distance
+	simd::mask8 hit(const AABB &box, float t_min, const simd::float8 &t_max, float t_max_upper,
+					simd::mask8 active, simd::float8 &t_enter) const {
+		using namespace simd;
+
+		if (!interval_hit(box, t_min, t_max_upper)) {
+			t_enter = float8(std::numeric_limits<float>::infinity());
+			return mask8::from_bits(0);
+		}
+
+		// same as AABB::hit for each lane (min/max arguments are swapped to match the NaN behaviour of glm)
+		float8 near[3], far[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			auto t0 = (float8(box.m_min[axis]) - m_origin[axis]) * m_inv_direction[axis];
+			auto t1 = (float8(box.m_max[axis]) - m_origin[axis]) * m_inv_direction[axis];
+			near[axis] = min(t1, t0);
+			far[axis] = max(t1, t0);
+		}
+
+		t_enter = max(max(float8(t_min), near[2]), max(near[1], near[0]));
+		auto t_exit = min(min(t_max, far[2]), min(far[1], far[0]));
+
+		return active & (t_enter <= t_exit);
+	}
+
+private:
+	// conservative test for the entire packet: false when none of the rays can hit the box before t_max_upper
+	bool interval_hit(const AABB &box, float t_min, float t_max_upper) const {
+		float t_enter = t_min;
+		float t_exit = t_max_upper;
+
+		for (int axis = 0; axis < 3; ++axis) {
+			if (!m_interval_valid[axis]) {
+				continue;
+			}
+
+			// distance to the slabs: [box - origin] * [inv_direction], the near slab depends on the sign of the direction
+			const bool positive = m_inv_direction_min[axis] > 0.0f;
+			const auto near_plane = positive ? box.m_min[axis] : box.m_max[axis];
+			const auto far_plane = positive ? box.m_max[axis] : box.m_min[axis];
+
+			t_enter = std::max(t_enter, interval_mul_min(near_plane - m_origin_max[axis], near_plane - m_origin_min[axis], axis));
+			t_exit = std::min(t_exit, interval_mul_max(far_plane - m_origin_max[axis], far_plane - m_origin_min[axis], axis));
+		}
+
+		return t_enter <= t_exit;
+	}
+
+	float interval_mul_min(float lo, float hi, int axis) const {
+		const auto a = m_inv_direction_min[axis], b = m_inv_direction_max[axis];
+		return std::min(std::min(lo * a, lo * b), std::min(hi * a, hi * b));
+	}
+
+	float interval_mul_max(float lo, float hi, int axis) const {
+		const auto a = m_inv_direction_min[axis], b = m_inv_direction_max[axis];
+		return std::max(std::max(lo * a, lo * b), std::max(hi * a, hi * b));
+	}
+
+private:
+	const Ray *		m_rays;
+	int				m_valid;			// bit mask of the lanes that contain a ray
+
+	simd::float8	m_origin[3];
+	simd::float8	m_direction[3];
+	simd::float8	m_inv_direction[3];
+	simd::float8	m_direction_dot;
+
+	point_t			m_origin_min;
+	point_t			m_origin_max;
+	vector_t		m_inv_direction_min;
+	vector_t		m_inv_direction_max;
+	bool			m_interval_valid[3];
+};
+
+} // namespace rtiow
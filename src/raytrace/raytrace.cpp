@@ -4,9 +4,13 @@
 
 #include "geometry_spheres.h"
 #include "ray.h"
+#include "ray_packet.h"
 #include "utils.h"
 #include "scene.h"
+#include "shading.h"
 #include "thread_pool.h"
+#include "tile_buffer.h"
+#include "tile_scheduler.h"
 
 #include <algorithm>
 #include <cassert>
@@ -19,161 +23,394 @@ RayTracer::RayTracer(const RayTracerConfig &config) : m_config(config) {
 	assert(m_config.m_render_resolution_x > 0);
 	assert(m_config.m_render_resolution_y > 0);
 	m_output = std::make_unique<RGBBuffer>(m_config.m_render_resolution_x, m_config.m_render_resolution_y);
+	m_accumulation = std::make_unique<HDRBuffer>(m_config.m_render_resolution_x, m_config.m_render_resolution_y);
+
+	auto num_workers = (m_config.m_num_render_workers > 0) ?
+							m_config.m_num_render_workers :
+							((ThreadPool::hardware_concurrency() - m_config.m_threads_ignore) * m_config.m_threads_use_percent) / 100;
+	m_thread_pool = std::make_unique<ThreadPool>(size_t(std::max(1, num_workers)));
 }
 
 RayTracer::~RayTracer() {
+	// the render tasks reference the output buffer
+	render_wait();
 }
 
-static inline color_t environment_color(const Ray &ray) {
-	auto unit_direction = glm::normalize(ray.direction());
-	auto t = 0.5f * (unit_direction.y + 1.0f);
-	return (1.0f-t) * color_t(1.0f, 1.0f, 1.0f) + t * color_t(0.5f, 0.7f, 1.0f);
+// primary_hit: result of the hit detection for start_ray when it was already traced (in a packet)
+color_t ray_color(const Scene &scene, const Ray &start_ray, const RayTracerConfig &config, Sampler &sampler,
+				  const HitRecord *primary_hit = nullptr) {
+
+	auto result = color_t{0.0f, 0.0f, 0.0f};
+	auto attenuation = color_t{1.0f, 1.0f, 1.0f};
+	auto ray = start_ray;
+	float bsdf_pdf = 0.0f;		// density of the direction of the ray when it was sampled at a diffuse hit (for MIS)
+	int32_t bounce = 0;
+
+	for (; bounce < config.m_max_ray_bounces; ++bounce) {
+
+		if (bounce == 0) {
+			RTIOW_STATS(m_primary_rays++);
+		} else {
+			RTIOW_STATS(m_secondary_rays++);
+		}
+
+		// shoot the ray into the scene
+		HitRecord hit;
+		bool hit_anything = false;
+
+		if (bounce == 0 && primary_hit != nullptr) {
+			hit = *primary_hit;
+			hit_anything = hit.m_at_t < std::numeric_limits<float>::infinity();
+		} else {
+			hit_anything = scene.hit_detection(ray, hit);
+		}
+
+		// stop tracing if the ray didn't hit anything
+		if (!hit_anything) {
+			RTIOW_STATS(m_rays_missed++);
+			result += environment_color(ray) * attenuation;
+			break;
+		}
+
+		RTIOW_STATS(m_rays_hit++);
+
+		// lights don't reflect: the path ends at the light
+		if (scene.material_table().is_emissive(hit.m_material)) {
+			if (hit.m_front_face) {
+				result += attenuation * scene.material_table().emission(hit.m_material) * emission_weight(scene, ray, hit, bsdf_pdf);
+			}
+			break;
+		}
+
+		sampler.start_bounce(bounce);
+		scatter(ray, hit, attenuation, sampler, scene, config.m_light_sampling, result, bsdf_pdf);
+
+		if (!russian_roulette(bounce, config, attenuation, sampler)) {
+			++bounce;
+			break;
+		}
+	}
+
+	if (bounce >= config.m_max_ray_bounces) {
+		RTIOW_STATS(m_paths_max_bounces++);
+	}
+	RTIOW_STATS(add_path(uint32_t(bounce)));
+
+	return result;
 }
 
-static inline float reflectance(float cosine, float ref_idx) {
-	// Use Schlick's approximation for reflectance.
-	auto r0 = (1.0f - ref_idx) / (1.0f + ref_idx);
-	r0 = r0 * r0;
-	return r0 + (1 - r0) * glm::pow((1.0f - cosine), 5.0f);
+void RayTracer::render(Scene &scene) {
+	render_start(scene);
+	render_wait();
 }
 
-static inline color_t specular_reflect(Ray &ray, const HitRecord &hit, const Material &mat) {
+void RayTracer::render_start(Scene &scene) {
 
-	auto reflected_dir = glm::reflect(ray.direction(), hit.m_normal);
-	ray = Ray(hit.m_point, glm::normalize(reflected_dir + mat.m_specular_roughness * random_vector_in_unit_sphere()));
+	// only one render can be active at a time
+	if (m_render_tasks) {
+		render_wait();
+	}
 
-	if (glm::dot(ray.direction(), hit.m_normal) > 0) {
-		return mat.m_specular_color;
-	} else {
-		return {0.0f, 0.0f, 0.0f};
+	// make sure the acceleration structures are available
+	if (!scene.is_finalized()) {
+		scene.finalize(m_config.m_acceleration, m_config.m_bvh_builder, m_thread_pool.get());
 	}
 
+	m_render_start_time = clock_t::now();
+	m_render_tasks = std::make_unique<TaskGroup>();
+	m_thread_pool->reset_worker_stats();
+
+	m_accumulation->clear();
+	m_work_done = 0;
+	m_tiles_rendered = 0;
+	m_render_stats.clear();
+	m_wavefront_timings.clear();
+	m_work_total = uint64_t(m_config.m_render_resolution_x) * m_config.m_render_resolution_y * m_config.m_samples_per_pixel;
+	m_stop_requested = false;
+
+	m_max_samples = m_config.m_samples_per_pixel;
+	if (m_config.m_adaptive_threshold > 0.0f) {
+		m_max_samples = (m_config.m_adaptive_max_samples > 0) ? m_config.m_adaptive_max_samples : 4 * m_config.m_samples_per_pixel;
+	}
+
+	// the passes are driven from a task (waiting inside a task helps executing the other tasks)
+	m_thread_pool->add_task(*m_render_tasks, [this, &scene, frame_index = m_frame_index++]() {
+		render_passes(scene, frame_index);
+	});
 }
 
-color_t ray_color(const Scene &scene, const Ray &start_ray, int32_t max_ray_bounces) {
+void RayTracer::render_passes(const Scene &scene, uint64_t frame_index) {
 
-	auto result = color_t{0.0f, 0.0f, 0.0f};
-	auto attenuation = color_t{1.0f, 1.0f, 1.0f};
-	auto ray = start_ray;
+	TileScheduler tiles(m_config.m_render_resolution_x, m_config.m_render_resolution_y, m_config.m_tile_size, m_config.m_tile_order);
+	const auto num_tasks = m_thread_pool->num_workers();
 
-	for (int32_t bounce = 0; bounce < max_ray_bounces; ++bounce) {
+	auto samples_per_pass = m_config.m_samples_per_pass;
+	if (samples_per_pass == 0) {
+		// adaptive sampling needs several passes: after the minimum number of samples all pixels are checked for convergence
+		samples_per_pass = (m_config.m_adaptive_threshold > 0.0f) ? std::max(1u, m_config.m_adaptive_min_samples) : m_max_samples;
+	}
 
-		// shoot the ray into the scene
-		HitRecord hit;
+	// every pixel that isn't converged yet gets new samples in each pass until the sample budget is used up
+	//	(without adaptive sampling no pixel converges and every pixel ends up with exactly m_samples_per_pixel samples)
+	while (m_work_done < m_work_total) {
+		TaskGroup pass_tasks;
+		std::atomic<uint64_t> pass_samples = 0;
+		std::atomic<size_t> next_tile = 0;
+
+		// one task per worker, each task keeps taking the next tile until all tiles of the pass are done
+		for (size_t t = 0; t < num_tasks; ++t) {
+			m_thread_pool->add_task(pass_tasks, [&, frame_index] () {
+				for (auto idx = next_tile++; idx < tiles.size(); idx = next_tile++) {
+					auto &tile = tiles.tile(idx);
+					auto tile_start = clock_t::now();
+					pass_samples += render_tile(scene, tile.m_x0, tile.m_y0, tile.m_x1, tile.m_y1, samples_per_pass, frame_index);
+					tile.m_cost = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - tile_start).count());
+				}
+			});
+		}
 
-		// stop tracing if the ray didn't hit anything
-		if (!scene.hit_detection(ray, hit)) {
-			result += environment_color(ray) * attenuation;
+		m_thread_pool->wait(pass_tasks);
+		m_tiles_rendered += tiles.size();
+
+		// stop when all pixels have converged, when requested or when out of time
+		if (pass_samples == 0 || m_stop_requested) {
 			break;
 		}
 
-		auto mat = scene.material(hit.m_material);
+		auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock_t::now() - m_render_start_time).count();
+		if (m_config.m_time_budget_ms > 0 && elapsed_ms >= m_config.m_time_budget_ms) {
+			break;
+		}
 
-		// absorption if hit is from the inside of the object
-		if (!hit.m_front_face) {
-			attenuation *= glm::exp(-mat.m_refraction_color * hit.m_at_t);
+		if (m_config.m_tile_split) {
+			tiles.split_expensive(num_tasks);
 		}
+	}
+}
 
-		// decide how this ray will be reflected
-		float ray_probability = 1.0f;
-		bool  choose_specular = false;
-		bool  choose_refraction = false;
+uint64_t RayTracer::render_tile(const Scene &scene, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+								uint32_t pass_samples, uint64_t frame_index) {
+
+	// render into a private copy of the tile, reused by all tiles rendered on this thread
+	static thread_local TileBuffer tile;
+	tile.load(*m_accumulation, *m_output, x0, y0, x1, y1);
+
+	// samples taken in this pass, added to the accumulated samples when the tile is done
+	static thread_local std::vector<color_t> pass_color;
+	static thread_local std::vector<uint32_t> pass_end;
+	pass_color.assign(size_t(tile.width()) * tile.height(), color_t(0.0f, 0.0f, 0.0f));
+	pass_end.resize(pass_color.size());
+
+	RenderStats tile_stats;
+	ScopedRenderStats scoped_stats(tile_stats);
+
+	auto add_sample = [&](size_t tile_index, const color_t &sample_color) {
+		pass_color[tile_index] += sample_color;
+		auto l = luminance(sample_color);
+		tile.luminance_sq()[tile_index] += l * l;
+	};
+
+	// primary rays are gathered in packets, the paths continue one by one after the first hit
+	struct {
+		Ray					m_rays[RayPacket::SIZE];
+		Sampler				m_sampler[RayPacket::SIZE];
+		size_t				m_tile_index[RayPacket::SIZE];
+		uint32_t			m_count = 0;
+	} packet;
+
+	// wavefront integrator: the samples are gathered in large batches that are traced stage by stage
+	static thread_local WavefrontBatch wavefront;
+	static thread_local std::vector<size_t> wavefront_tile_index;
+	WavefrontTimings tile_timings;
+	wavefront.reset(m_config.m_wavefront_batch_size);
+	wavefront_tile_index.clear();
+
+	auto trace_wavefront = [&]() {
+		wavefront.trace(scene, m_config, frame_index, tile_timings);
+
+		for (size_t i = 0; i < wavefront.size(); ++i) {
+			add_sample(wavefront_tile_index[i], wavefront.color(i));
+		}
+		wavefront.reset(m_config.m_wavefront_batch_size);
+		wavefront_tile_index.clear();
+	};
 
-		float random_chance = random_float();
+	auto trace_packet = [&]() {
+		HitRecord hits[RayPacket::SIZE];
+		scene.hit_detection(RayPacket(packet.m_rays, packet.m_count), hits);
 
-		if (random_chance <= mat.m_specular_chance) {
-			choose_specular = true;
-			ray_probability = mat.m_specular_chance;
-		} else if (random_chance <= mat.m_specular_chance + mat.m_refraction_chance) {
-			choose_refraction = true;
-			ray_probability = mat.m_refraction_chance;
-		} else {
-			ray_probability = 1.0f - mat.m_specular_chance - mat.m_refraction_chance;
+		for (uint32_t i = 0; i < packet.m_count; ++i) {
+			add_sample(packet.m_tile_index[i], ray_color(scene, packet.m_rays[i], m_config, packet.m_sampler[i], &hits[i]));
 		}
-		ray_probability = glm::max(ray_probability, 0.001f);
-
-		if (choose_specular) {
-			// specular reflection
-			attenuation *= specular_reflect(ray, hit, mat);
-		} else if (choose_refraction) {
-			// refraction
-			float refraction_ratio = hit.m_front_face ? 1.0f / mat.m_index_of_refraction : mat.m_index_of_refraction;
-			float cos_theta = glm::min(glm::dot(-ray.direction(), hit.m_normal), 1.0f);
-            float sin_theta = glm::sqrt(1.0f - cos_theta*cos_theta);
-
-            if (refraction_ratio * sin_theta > 1.0f || reflectance(cos_theta, refraction_ratio) > ray_probability) {
-				// refraction not possible or looking at steep angle so material becomes reflective
-				attenuation *= specular_reflect(ray, hit, mat);
-			} else {
-				auto refraction_dir = glm::refract(ray.direction(), hit.m_normal, refraction_ratio);
-				ray = Ray(hit.m_point, glm::normalize(refraction_dir + mat.m_refraction_roughness * random_vector_in_unit_sphere()));
+		packet.m_count = 0;
+	};
+
+	for (uint32_t y = y0; y < y1; ++y) {
+		for (uint32_t x = x0; x < x1; ++x) {
+
+			const size_t pixel_index = size_t(y) * m_config.m_render_resolution_x + x;
+			const size_t tile_index = size_t(y - y0) * tile.width() + (x - x0);
+			const auto sample_begin = tile.sample_count()[tile_index];
+
+			if (pixel_converged(tile.data()[tile_index], sample_begin, tile.luminance_sq()[tile_index])) {
+				pass_end[tile_index] = sample_begin;
+				continue;
 			}
-		} else {
-			// diffuse reflection
-			auto diffuse_dir = glm::normalize(hit.m_normal + random_unit_vector());
-			if (glm::all(glm::epsilonEqual(diffuse_dir, vector_t(0.0f, 0.0f, 0.0f), 1e-6f))) {
-				diffuse_dir = hit.m_normal;
+
+			const auto sample_end = std::min(m_max_samples, sample_begin + pass_samples);
+			pass_end[tile_index] = sample_end;
+
+			for (uint32_t sample = sample_begin; sample < sample_end; ++sample) {
+
+				if (m_config.m_integrator == Integrator::WAVEFRONT) {
+					wavefront.add_sample(x, y, sample);
+					wavefront_tile_index.push_back(tile_index);
+					if (wavefront.full()) {
+						trace_wavefront();
+					}
+					continue;
+				}
+
+				// each sample gets its own random sequence: the result doesn't depend on the thread that renders it
+				Sampler sampler(m_config.m_sampler, pixel_index, sample, m_config.m_samples_per_pixel, frame_index);
+				Ray ray = camera_ray(scene, m_config, x, y, sampler);
+
+				if (!m_config.m_packet_tracing) {
+					add_sample(tile_index, ray_color(scene, ray, m_config, sampler));
+					continue;
+				}
+
+				packet.m_rays[packet.m_count] = ray;
+				packet.m_sampler[packet.m_count] = sampler;
+				packet.m_tile_index[packet.m_count] = tile_index;
+				if (++packet.m_count == RayPacket::SIZE) {
+					trace_packet();
+				}
 			}
-			ray = Ray(hit.m_point, diffuse_dir);
-			attenuation *= mat.m_albedo;
 		}
+	}
 
-		// divide attentuation by the probability that this ray-type was chosen to make sure
-		// they count the same in the final average
-		attenuation /= ray_probability;
+	if (packet.m_count > 0) {
+		trace_packet();
 	}
 
-	return result;
+	if (!wavefront.empty()) {
+		trace_wavefront();
+	}
+
+	// accumulate and update the displayed image
+	uint64_t samples_taken = 0;
+
+	for (size_t tile_index = 0; tile_index < pass_color.size(); ++tile_index) {
+		auto &sample_count = tile.sample_count()[tile_index];
+		if (pass_end[tile_index] == sample_count) {
+			continue;
+		}
+
+		auto &accum = tile.data()[tile_index];
+		accum += pass_color[tile_index];
+		samples_taken += pass_end[tile_index] - sample_count;
+		sample_count = pass_end[tile_index];
+
+		auto *pixel_out = tile.rgb() + 3 * tile_index;
+		write_color(&pixel_out, accum, sample_count);
+	}
+
+	tile.publish(*m_accumulation, *m_output);
+
+	if (RENDER_STATS_ENABLED || m_config.m_integrator == Integrator::WAVEFRONT) {
+		std::lock_guard<std::mutex> lock(m_render_stats_mutex);
+		m_render_stats.merge(tile_stats);
+		m_wavefront_timings.merge(tile_timings);
+	}
+
+	m_work_done += samples_taken;
+	return samples_taken;
 }
 
-void RayTracer::render(Scene &scene) {
+bool RayTracer::pixel_converged(const color_t &sum, uint32_t n, float luminance_sq) const {
 
-	auto start_time = std::chrono::system_clock::now();
+	if (n >= m_max_samples) {
+		return true;
+	}
 
-	// Creating and destroying the threadpool per render might seem like a bad idea, and it is.
-	// But destroying the pool is currently the only way to wait until rendering is done :-(
-	// And besides, render() isn't going to be called multiple times in the current setup
-	auto num_workers = (m_config.m_num_render_workers > 0) ?
-							m_config.m_num_render_workers :
-							((ThreadPool::hardware_concurrency() - m_config.m_threads_ignore) * m_config.m_threads_use_percent) / 100;
-	m_thread_pool = std::make_unique<ThreadPool>(std::max(1, num_workers));
+	if (m_config.m_adaptive_threshold <= 0.0f || n < std::max(2u, m_config.m_adaptive_min_samples)) {
+		return false;
+	}
+
+	// compare the 95% confidence interval of the mean luminance with the mean itself
+	//	(the mean is clamped to avoid spending the entire budget on nearly black pixels)
+	constexpr float MIN_LUMINANCE = 0.01f;
 
-	// split scene into quads and render them in parallel
-	constexpr uint32_t CHUNK_SIZE = 128;
+	const auto fn = float(n);
+	const auto mean = luminance(sum) / fn;
+	const auto variance = std::max(0.0f, (luminance_sq - fn * mean * mean) / (fn - 1.0f));
+	const auto error = 1.96f * std::sqrt(variance / fn);
 
-	for (uint32_t y0 = 0; y0 < m_output->height(); y0 += CHUNK_SIZE) {
-		for (uint32_t x0 = 0; x0 < m_output->width(); x0 += CHUNK_SIZE) {
-			auto x1 = std::min(m_config.m_render_resolution_x, x0 + CHUNK_SIZE);
-			auto y1 = std::min(m_config.m_render_resolution_y, y0 + CHUNK_SIZE);
+	return error <= m_config.m_adaptive_threshold * std::max(mean, MIN_LUMINANCE);
+}
 
-			m_thread_pool->add_task([=, &scene] () {
-				for (uint32_t y = y0; y < y1; ++y) {
-					uint8_t *out = m_output->data() + (3 * (y * m_config.m_render_resolution_x + x0));
+void RayTracer::render_wait() {
 
-					for (uint32_t x = x0; x < x1; ++x) {
+	if (!m_render_tasks) {
+		return;
+	}
 
-						color_t pixel_color(0.0f, 0.0f, 0.0f);
+	m_thread_pool->wait(*m_render_tasks);
+	m_render_tasks = nullptr;
 
-						for (uint32_t sample = 0; sample < m_config.m_samples_per_pixel; ++sample) {
+	if (!m_config.m_print_report) {
+		return;
+	}
 
-							auto u = (static_cast<float>(x) + random_float()) / static_cast<float>(m_output->width() - 1);
-							auto v = (static_cast<float>(y) + random_float()) / static_cast<float>(m_output->height() - 1);
+	auto finish_time = clock_t::now();
+	auto render_ms = std::chrono::duration_cast<std::chrono::milliseconds>(finish_time - m_render_start_time).count();
+	auto primary_rays = m_work_done.load();
+	std::printf("Rendering took %" PRIu64 "ms (%.1f samples per pixel, %.2f M primary rays/s)\n",
+				uint64_t(render_ms), double(average_samples_per_pixel()),
+				double(primary_rays) / (1000.0 * double(std::max<int64_t>(render_ms, 1))));
 
-							Ray ray = scene.camera().create_ray(u, v);
-							pixel_color += ray_color(scene, ray, m_config.m_max_ray_bounces);
-						}
-						write_color(&out, pixel_color, m_config.m_samples_per_pixel);
-					}
-				}
-			});
-		}
+	if constexpr (RENDER_STATS_ENABLED) {
+		m_render_stats.print();
 	}
 
-	// destroy the thread pool to wait for work to finish
-	m_thread_pool = nullptr;
+	if (m_config.m_integrator == Integrator::WAVEFRONT) {
+		m_wavefront_timings.print();
+	}
+
+	// load balancing
+	uint64_t tasks_total = 0, tasks_stolen = 0;
+	uint64_t tasks_min = std::numeric_limits<uint64_t>::max(), tasks_max = 0;
+
+	for (const auto &stats : m_thread_pool->worker_stats()) {
+		tasks_total += stats.m_tasks_executed;
+		tasks_stolen += stats.m_tasks_stolen;
+		tasks_min = std::min(tasks_min, stats.m_tasks_executed);
+		tasks_max = std::max(tasks_max, stats.m_tasks_executed);
+	}
+
+	std::printf("Executed %" PRIu64 " tasks on %zu workers (%" PRIu64 " - %" PRIu64 " per worker, %" PRIu64 " stolen), %" PRIu64 " tiles\n",
+				tasks_total, m_thread_pool->num_workers(), tasks_min, tasks_max, tasks_stolen, m_tiles_rendered);
+}
+
+float RayTracer::average_samples_per_pixel() const {
+	return float(double(m_work_done.load()) / (double(m_config.m_render_resolution_x) * m_config.m_render_resolution_y));
+}
+
+void RayTracer::render_stop() {
+	m_stop_requested = true;
+}
+
+bool RayTracer::render_done() const {
+	return !m_render_tasks || m_render_tasks->is_done();
+}
+
+float RayTracer::render_progress() const {
+	if (!m_render_tasks || m_work_total == 0) {
+		return 1.0f;
+	}
 
-	auto finish_time = std::chrono::system_clock::now();
-	std::printf("Rendering took %" PRIu64 "ms\n", std::chrono::duration_cast<std::chrono::milliseconds>(finish_time - start_time).count());
+	return std::min(1.0f, float(double(m_work_done.load()) / double(m_work_total)));
 }
 
 } // namespace rtiow
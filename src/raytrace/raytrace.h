@@ -2,10 +2,16 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include "config.h"
+#include "hdr_buffer.h"
+#include "render_stats.h"
 #include "rgb_buffer.h"
 #include "scene.h"
+#include "wavefront.h"
 
 namespace rtiow {
 
@@ -17,14 +23,48 @@ public:
 
 	// data access
 	const uint8_t *output_ptr() const {return m_output->data();}
+	const HDRBuffer &accumulation() const {return *m_accumulation;}		// sum of all samples per pixel
+	uint64_t samples_taken() const {return m_work_done.load();}			// total number of samples (= primary rays) of the last render
+	float average_samples_per_pixel() const;
+	const RenderStats &render_stats() const {return m_render_stats;}		// only gathered when RENDER_STATS_ENABLED
+	const WavefrontTimings &wavefront_timings() const {return m_wavefront_timings;}	// only with the wavefront integrator
+	class ThreadPool &thread_pool() {return *m_thread_pool;}
 
-	// rendering
+	// rendering (blocking)
 	void render(Scene &scene);
 
+	// rendering (asynchronous): render_start() returns as soon as all work has been queued
+	//	the scene must remain valid until render_wait() returns
+	void render_start(Scene &scene);
+	void render_wait();
+	void render_stop();							// don't start any new passes in progressive mode
+	bool render_done() const;
+	float render_progress() const;
+
 private:
+	using clock_t = std::chrono::steady_clock;
+
+	void render_passes(const Scene &scene, uint64_t frame_index);
+	uint64_t render_tile(const Scene &scene, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+						 uint32_t pass_samples, uint64_t frame_index);
+	bool pixel_converged(const color_t &sum, uint32_t n, float luminance_sq) const;
+
 	RayTracerConfig						m_config;
 	std::unique_ptr<RGBBuffer>			m_output;
+	std::unique_ptr<HDRBuffer>			m_accumulation;
 	std::unique_ptr<class ThreadPool>	m_thread_pool;
+	std::unique_ptr<class TaskGroup>	m_render_tasks;
+	clock_t::time_point					m_render_start_time;
+	RenderStats							m_render_stats;
+	WavefrontTimings					m_wavefront_timings;
+	std::mutex							m_render_stats_mutex;
+	uint64_t							m_frame_index = 0;		// incremented for each render, part of the random seed
+
+	uint32_t							m_max_samples = 0;		// maximum number of samples for a single pixel
+	std::atomic<uint64_t>				m_work_done = 0;		// progress tracking: number of finished pixel samples
+	uint64_t							m_work_total = 0;		// sample budget for the entire image
+	uint64_t							m_tiles_rendered = 0;	// number of tiles rendered over all passes
+	std::atomic<bool>					m_stop_requested = false;
 };
 
 }
@@ -0,0 +1,90 @@
+// raytrace/render_stats.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "render_stats.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+namespace rtiow {
+
+void RenderStats::merge(const RenderStats &other) {
+	m_primary_rays += other.m_primary_rays;
+	m_secondary_rays += other.m_secondary_rays;
+	m_rays_hit += other.m_rays_hit;
+	m_rays_missed += other.m_rays_missed;
+	m_node_tests += other.m_node_tests;
+	m_primitive_tests += other.m_primitive_tests;
+	m_diffuse += other.m_diffuse;
+	m_specular += other.m_specular;
+	m_refraction += other.m_refraction;
+	m_refraction_reflected += other.m_refraction_reflected;
+	m_light_samples += other.m_light_samples;
+	m_shadow_rays += other.m_shadow_rays;
+	m_shadow_rays_occluded += other.m_shadow_rays_occluded;
+	m_paths_terminated += other.m_paths_terminated;
+	m_paths_max_bounces += other.m_paths_max_bounces;
+
+	for (uint32_t i = 0; i < PATH_LENGTH_BUCKETS; ++i) {
+		m_path_length[i] += other.m_path_length[i];
+	}
+}
+
+double RenderStats::average_path_length() const {
+	return double(total_rays()) / double(std::max<uint64_t>(m_primary_rays, 1));
+}
+
+void RenderStats::print() const {
+	auto per_ray = [this](uint64_t count) {return double(count) / double(std::max<uint64_t>(total_rays(), 1));};
+
+	std::printf("Rays: %" PRIu64 " primary, %" PRIu64 " secondary (%.2f per path), %.1f%% hit\n",
+				m_primary_rays, m_secondary_rays, average_path_length(), 100.0 * per_ray(m_rays_hit));
+	std::printf("Intersection tests per ray: %.1f nodes, %.1f primitives\n", per_ray(m_node_tests), per_ray(m_primitive_tests));
+	std::printf("Scattering: %" PRIu64 " diffuse, %" PRIu64 " specular, %" PRIu64 " refraction (%" PRIu64 " reflected)\n",
+				m_diffuse, m_specular, m_refraction, m_refraction_reflected);
+	if (m_light_samples > 0) {
+		std::printf("Light samples: %" PRIu64 ", %" PRIu64 " shadow rays (%.1f%% occluded)\n", m_light_samples, m_shadow_rays,
+					100.0 * double(m_shadow_rays_occluded) / double(std::max<uint64_t>(m_shadow_rays, 1)));
+	}
+	std::printf("Paths: %" PRIu64 " terminated by russian roulette, %" PRIu64 " reached the maximum number of bounces\n",
+				m_paths_terminated, m_paths_max_bounces);
+}
+
+std::string RenderStats::to_json() const {
+	std::string result;
+	char buffer[128];
+
+	auto add_counter = [&](const char *name, uint64_t value) {
+		std::snprintf(buffer, sizeof(buffer), "\t\"%s\": %" PRIu64 ",\n", name, value);
+		result.append(buffer);
+	};
+
+	result.append("{\n");
+	add_counter("primary_rays", m_primary_rays);
+	add_counter("secondary_rays", m_secondary_rays);
+	add_counter("rays_hit", m_rays_hit);
+	add_counter("rays_missed", m_rays_missed);
+	add_counter("node_tests", m_node_tests);
+	add_counter("primitive_tests", m_primitive_tests);
+	add_counter("diffuse", m_diffuse);
+	add_counter("specular", m_specular);
+	add_counter("refraction", m_refraction);
+	add_counter("refraction_reflected", m_refraction_reflected);
+	add_counter("light_samples", m_light_samples);
+	add_counter("shadow_rays", m_shadow_rays);
+	add_counter("shadow_rays_occluded", m_shadow_rays_occluded);
+	add_counter("paths_terminated", m_paths_terminated);
+	add_counter("paths_max_bounces", m_paths_max_bounces);
+
+	// the last bucket also contains the longer paths
+	result.append("\t\"path_length\": [");
+	for (uint32_t i = 0; i < PATH_LENGTH_BUCKETS; ++i) {
+		std::snprintf(buffer, sizeof(buffer), "%s%" PRIu64, (i > 0) ? ", " : "", m_path_length[i]);
+		result.append(buffer);
+	}
+	result.append("]\n}\n");
+
+	return result;
+}
+
+} // namespace rtiow
@@ -0,0 +1,94 @@
+// raytrace/render_stats.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// counters that describe the work done during a render
+//	Each render task gathers its own counters, they are merged into the totals of the render when the task is done.
+//	The instrumentation is only compiled in when RTIOW_RENDER_STATS is defined (CMake option with the same name).
+
+#pragma once
+
+#include "types.h"
+
+#include <string>
+
+namespace rtiow {
+
+#if defined(RTIOW_RENDER_STATS)
+constexpr bool RENDER_STATS_ENABLED = true;
+#else
+constexpr bool RENDER_STATS_ENABLED = false;
+#endif
+
+struct RenderStats {
+	static constexpr uint32_t PATH_LENGTH_BUCKETS = 33;		// paths with 0 - 31 bounces + one bucket for longer paths
+
+	// rays
+	uint64_t	m_primary_rays = 0;
+	uint64_t	m_secondary_rays = 0;
+	uint64_t	m_rays_hit = 0;
+	uint64_t	m_rays_missed = 0;
+
+	// intersection tests
+	uint64_t	m_node_tests = 0;				// bounding box tests while traversing the acceleration structure
+	uint64_t	m_primitive_tests = 0;			// ray / primitive intersection tests
+
+	// scattering choices at each hit
+	uint64_t	m_diffuse = 0;
+	uint64_t	m_specular = 0;
+	uint64_t	m_refraction = 0;
+	uint64_t	m_refraction_reflected = 0;		// refraction was chosen but the ray was reflected (total internal reflection, fresnel)
+
+	// direct lighting
+	uint64_t	m_light_samples = 0;			// lights sampled at diffuse hits
+	uint64_t	m_shadow_rays = 0;				// visibility tests of the sampled points on the lights
+	uint64_t	m_shadow_rays_occluded = 0;
+
+	// path termination
+	uint64_t	m_paths_terminated = 0;			// stopped by russian roulette
+	uint64_t	m_paths_max_bounces = 0;		// stopped by reaching the maximum number of bounces
+	uint64_t	m_path_length[PATH_LENGTH_BUCKETS] = {};
+
+	void clear() {*this = RenderStats{};}
+	void merge(const RenderStats &other);
+	void add_path(uint32_t bounces) {++m_path_length[(bounces < PATH_LENGTH_BUCKETS) ? bounces : PATH_LENGTH_BUCKETS - 1];}
+
+	uint64_t total_rays() const {return m_primary_rays + m_secondary_rays;}
+	double average_path_length() const;
+
+	void print() const;
+	std::string to_json() const;
+};
+
+// counters of the render task running on the calling thread (nullptr when the thread isn't rendering)
+inline RenderStats *&current_render_stats() {
+	static thread_local RenderStats *current = nullptr;
+	return current;
+}
+
+// make the counters of a render task current for the calling thread (restores the previous ones when done)
+class ScopedRenderStats {
+public:
+	explicit ScopedRenderStats(RenderStats &stats) : m_previous(current_render_stats()) {
+		current_render_stats() = &stats;
+	}
+	~ScopedRenderStats() {
+		current_render_stats() = m_previous;
+	}
+	ScopedRenderStats(const ScopedRenderStats &) = delete;
+	ScopedRenderStats &operator=(const ScopedRenderStats &) = delete;
+
+private:
+	RenderStats *	m_previous;
+};
+
+} // namespace rtiow
+
+#if defined(RTIOW_RENDER_STATS)
+	#define RTIOW_STATS(stmt)												\
+		do {																\
+			if (auto *stats_ = ::rtiow::current_render_stats(); stats_) {	\
+				stats_->stmt;												\
+			}																\
+		} while (false)
+#else
+	#define RTIOW_STATS(stmt) do {} while (false)
+#endif
@@ -0,0 +1,216 @@
+// raytrace/sampler.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// sample generation for the paths of a pixel
+//	Every random decision of a path (pixel position, lens position, reflection type and direction, light choice, ...)
+//	uses its own dimension of the sample vector of the path. With SamplerType::RANDOM all dimensions are independent
+//	uniform random numbers. The other samplers spread the samples of a pixel evenly over each dimension, which
+//	converges faster than independent random samples:
+//	- STRATIFIED: correlated multi-jittered samples (Kensler 2013) in blocks of m_samples_per_pixel samples
+//	- SOBOL: the first two dimensions of the Sobol sequence, shuffled and Owen-scrambled with a hash (Burley 2020)
+//	Each pair of dimensions is decorrelated from the others by scrambling it with its own seed (padding), so there is no
+//	limit on the number of dimensions. Each bounce of a path starts at a fixed dimension, paths that make different
+//	decisions at a hit still use the same dimensions at the next one.
+
+#pragma once
+
+#include "config.h"
+#include "random.h"
+#include "types.h"
+
+#include <cmath>
+
+namespace rtiow {
+
+class Sampler {
+public:
+	// the camera ray uses the first dimensions (pixel position, lens position), each bounce gets DIMENSIONS_PER_BOUNCE after them
+	static constexpr uint32_t DIMENSIONS_CAMERA = 2;
+	static constexpr uint32_t DIMENSIONS_PER_BOUNCE = 8;
+
+	// construction
+	Sampler() = default;
+
+	// sample with index 'sample' of the pixel (the index continues over render passes)
+	Sampler(SamplerType type, uint64_t pixel_index, uint32_t sample, uint32_t samples_per_pixel, uint64_t frame_index) :
+		m_rng(random_seed(pixel_index, sample, frame_index)),
+		m_seed(random_seed(pixel_index, frame_index)),
+		m_type(type) {
+
+		if (m_type == SamplerType::STRATIFIED) {
+			// samples beyond the first m_samples_per_pixel start a new, independently permuted block
+			auto block_size = samples_per_pixel > 0 ? samples_per_pixel : 1u;
+			m_seed = random_seed(m_seed, sample / block_size);
+			m_sample = sample % block_size;
+			m_samples_per_pixel = block_size;
+		} else {
+			m_sample = sample;
+			m_samples_per_pixel = samples_per_pixel;
+		}
+	}
+
+	SamplerType type() const {return m_type;}
+	RandomGenerator &rng() {return m_rng;}
+
+	// the next samples are used by the given bounce of the path (dimensions of a previous bounce that weren't used are skipped)
+	void start_bounce(int32_t bounce) {
+		m_dimension = DIMENSIONS_CAMERA + static_cast<uint32_t>(bounce) * DIMENSIONS_PER_BOUNCE;
+	}
+
+	// uniform values in [0, 1), each call uses a new dimension
+	float next_1d() {
+		if (m_type == SamplerType::RANDOM) {
+			return m_rng.next_float();
+		}
+
+		auto seed = dimension_seed();
+		if (m_type == SamplerType::STRATIFIED) {
+			auto stratum = permute(m_sample, m_samples_per_pixel, seed);
+			return to_unit((static_cast<float>(stratum) + hash_float(m_sample, seed * 0xa399d265u)) /
+						   static_cast<float>(m_samples_per_pixel));
+		}
+
+		auto index = nested_uniform_scramble(m_sample, seed);
+		return uint_to_float(nested_uniform_scramble(reverse_bits(index), hash_combine(seed, 0)));
+	}
+
+	glm::vec2 next_2d() {
+		if (m_type == SamplerType::RANDOM) {
+			auto x = m_rng.next_float();
+			auto y = m_rng.next_float();
+			return {x, y};
+		}
+
+		auto seed = dimension_seed();
+		if (m_type == SamplerType::STRATIFIED) {
+			return correlated_multi_jitter(m_sample, m_samples_per_pixel, seed);
+		}
+
+		auto index = nested_uniform_scramble(m_sample, seed);
+		return {uint_to_float(nested_uniform_scramble(reverse_bits(index), hash_combine(seed, 0))),
+				uint_to_float(nested_uniform_scramble(sobol_dimension_1(index), hash_combine(seed, 1)))};
+	}
+
+private:
+	uint32_t dimension_seed() {
+		return static_cast<uint32_t>(random_seed(m_seed, m_dimension++));
+	}
+
+	static constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+	static float to_unit(float v) {
+		return v < ONE_MINUS_EPSILON ? v : ONE_MINUS_EPSILON;
+	}
+
+	static float uint_to_float(uint32_t v) {
+		return static_cast<float>(v >> 8) * (1.0f / 16777216.0f);
+	}
+
+	static uint32_t hash_combine(uint32_t seed, uint32_t v) {
+		return seed ^ (v + (seed << 6) + (seed >> 2));
+	}
+
+	static uint32_t reverse_bits(uint32_t v) {
+		v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+		v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+		v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+		v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+		return (v >> 16) | (v << 16);
+	}
+
+	// second dimension of the Sobol sequence (the first one is the bit reversed index)
+	static uint32_t sobol_dimension_1(uint32_t index) {
+		uint32_t result = 0;
+		for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+			if (index & 1u) {
+				result ^= v;
+			}
+		}
+		return result;
+	}
+
+	// hash based Owen scrambling (Laine-Karras permutation on the reversed bits, see Burley 2020)
+	static uint32_t nested_uniform_scramble(uint32_t v, uint32_t seed) {
+		v = reverse_bits(v);
+		v += seed;
+		v ^= v * 0x6c50b47cu;
+		v ^= v * 0xb82f1e52u;
+		v ^= v * 0xc7afe638u;
+		v ^= v * 0x8d22f6e6u;
+		return reverse_bits(v);
+	}
+
+	// random permutation of [0, n) without a table (Kensler 2013)
+	static uint32_t permute(uint32_t i, uint32_t n, uint32_t p) {
+		uint32_t w = n - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+
+		do {
+			i ^= p;
+			i *= 0xe170893du;
+			i ^= p >> 16;
+			i ^= (i & w) >> 4;
+			i ^= p >> 8;
+			i *= 0x0929eb3fu;
+			i ^= p >> 23;
+			i ^= (i & w) >> 1;
+			i *= 1u | p >> 27;
+			i *= 0x6935fa69u;
+			i ^= (i & w) >> 11;
+			i *= 0x74dcb303u;
+			i ^= (i & w) >> 2;
+			i *= 0x9e501cc3u;
+			i ^= (i & w) >> 2;
+			i *= 0xc860a3dfu;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= n);
+
+		return (i + p) % n;
+	}
+
+	static float hash_float(uint32_t i, uint32_t p) {
+		i ^= p;
+		i ^= i >> 17;
+		i ^= i >> 10;
+		i *= 0xb36534e5u;
+		i ^= i >> 12;
+		i ^= i >> 21;
+		i *= 0x93fc4795u;
+		i ^= 0xdf6e307fu;
+		i ^= i >> 17;
+		i *= 1u | p >> 18;
+		return uint_to_float(i);
+	}
+
+	// sample s of n stratified in both dimensions and in each dimension separately (m x k grid with m * k >= n)
+	static glm::vec2 correlated_multi_jitter(uint32_t s, uint32_t n, uint32_t p) {
+		auto m = static_cast<uint32_t>(std::sqrt(static_cast<float>(n)));
+		while ((m + 1) * (m + 1) <= n) {
+			++m;
+		}
+		auto k = (n + m - 1) / m;
+
+		s = permute(s, n, p * 0x51633e2du);
+		auto sx = permute(s % m, m, p * 0x68bc21ebu);
+		auto sy = permute(s / m, k, p * 0x02e5be93u);
+		auto jx = hash_float(s, p * 0x967a889bu);
+		auto jy = hash_float(s, p * 0x368cc8b7u);
+
+		return {to_unit((static_cast<float>(s % m) + (static_cast<float>(sy) + jx) / static_cast<float>(k)) / static_cast<float>(m)),
+				to_unit((static_cast<float>(s / m) + (static_cast<float>(sx) + jy) / static_cast<float>(m)) / static_cast<float>(k))};
+	}
+
+private:
+	RandomGenerator	m_rng;
+	uint64_t		m_seed = 0;
+	uint32_t		m_sample = 0;
+	uint32_t		m_samples_per_pixel = 1;
+	uint32_t		m_dimension = 0;
+	SamplerType		m_type = SamplerType::RANDOM;
+};
+
+} // namespace rtiow
@@ -5,6 +5,7 @@
 namespace rtiow {
 
 Material &Scene::material_create_default() {
+	m_finalized = false;
 	auto &mat = m_materials.emplace_back();
 	mat.m_albedo = {0.0f, 0.0f, 0.0f};
 	mat.m_specular_chance =	0.0f;
@@ -14,6 +15,7 @@ Material &Scene::material_create_default() {
 	mat.m_refraction_chance = 0.0f;
 	mat.m_refraction_color = {0.0f, 0.0f, 0.0f};
 	mat.m_refraction_roughness = 0.0f;
+	mat.m_emission = {0.0f, 0.0f, 0.0f};
 	return mat;
 }
 
@@ -33,13 +35,13 @@ material_id_t Scene::material_create(
 	mat.m_refraction_color = refraction_color;
 	mat.m_refraction_roughness = refraction_roughness;
 
-	return m_materials.size() - 1;
+	return static_cast<material_id_t>(m_materials.size() - 1);
 }
 
 material_id_t Scene::material_create_diffuse(const color_t &albedo) {
 	auto &mat = material_create_default();
 	mat.m_albedo = albedo;
-	return m_materials.size() - 1;
+	return static_cast<material_id_t>(m_materials.size() - 1);
 }
 
 material_id_t Scene::material_create_specular(	const color_t &albedo,
@@ -50,7 +52,19 @@ material_id_t Scene::material_create_specular(	const color_t &albedo,
 	mat.m_specular_color = specular_color;
 	mat.m_specular_roughness = specular_roughness;
 
-	return m_materials.size() - 1;
+	return static_cast<material_id_t>(m_materials.size() - 1);
+}
+
+material_id_t Scene::material_create_emissive(const color_t &emission) {
+	auto &mat = material_create_default();
+	mat.m_emission = emission;
+	return static_cast<material_id_t>(m_materials.size() - 1);
+}
+
+material_id_t Scene::material_add(const Material &material) {
+	m_materials.push_back(material);
+	m_finalized = false;
+	return static_cast<material_id_t>(m_materials.size() - 1);
 }
 
 void Scene::setup_camera(float aspect_ratio, float vertical_fov,
@@ -61,11 +75,58 @@ void Scene::setup_camera(float aspect_ratio, float vertical_fov,
 
 void Scene::sphere_add(const point_t &center, float radius, material_id_t material) {
 	m_spheres.add_sphere(center, radius, material);
+	m_finalized = false;
+}
+
+void Scene::mesh_add(const std::vector<point_t> &vertices, const std::vector<uint32_t> &indices, material_id_t material) {
+	m_triangles.add_mesh(vertices, indices, material);
+	m_finalized = false;
+}
+
+void Scene::finalize(AccelerationStructure acceleration, BVHBuilder builder, ThreadPool *pool) {
+	m_spheres.finalize(acceleration, builder, pool);
+	m_triangles.finalize(acceleration, builder, pool);
+	m_material_table.build(m_materials);
+	collect_lights();
+
+	m_finalized = true;
+}
+
+void Scene::finalize_restored() {
+	m_material_table.build(m_materials);
+	collect_lights();
+	m_finalized = true;
+}
+
+void Scene::collect_lights() {
+	m_lights.clear();
+
+	// hollow spheres (negative radius) only emit inwards, they aren't sampled
+	for (uint32_t i = 0; i < m_spheres.size(); ++i) {
+		const auto &sphere = m_spheres.sphere(i);
+		auto material = m_spheres.material(i);
+		if (sphere.m_radius > 0.0f && m_material_table.is_emissive(material)) {
+			m_lights.push_back({sphere.m_center, sphere.m_radius, material});
+		}
+	}
 }
 
 bool Scene::hit_detection(const Ray &ray, HitRecord &hit) const {
-	// there are only spheres right now
-	return m_spheres.hit(ray, 0.001f, hit);
+	// each type of geometry has its own BVH (when the scene has been finalized with one),
+	//	the closest hit so far limits the search in the next one
+	bool hit_anything = m_spheres.hit(ray, 0.001f, hit);
+	hit_anything |= m_triangles.hit(ray, 0.001f, hit);
+	return hit_anything;
+}
+
+bool Scene::occluded(const Ray &ray, float t_max) const {
+	// done as soon as any hit is found, no need to find the closest one
+	return m_spheres.occluded(ray, 0.001f, t_max) || m_triangles.occluded(ray, 0.001f, t_max);
+}
+
+void Scene::hit_detection(const RayPacket &packet, HitRecord *hits) const {
+	m_spheres.hit_packet(packet, 0.001f, hits);
+	m_triangles.hit_packet(packet, 0.001f, hits);
 }
 
 } // namespace rtiow
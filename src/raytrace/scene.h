@@ -1,24 +1,21 @@
 // raytrace/scene.h - Johan Smet - BSD-3-Clause (see LICENSE)
 #pragma once
 
+#include "config.h"
 #include "geometry_spheres.h"
+#include "geometry_triangles.h"
 #include "camera.h"
+#include "material.h"
 
 #include <vector>
 
 namespace rtiow {
 
-struct Material {
-	color_t		m_albedo;
-
-	float		m_specular_chance;			// chance that the reflection will choose the specular path instead of the diffuse (0 .. 1)
-	color_t		m_specular_color;			// color of specular reflection
-	float		m_specular_roughness;		// how blurry the specular reflection is (from 0.0 == sharp to 1.0 == blurry)
-
-	float		m_index_of_refraction;
-	float		m_refraction_chance;		// change that the reflection will choose the refraction path (0 .. 1 - specular-change)
-	color_t		m_refraction_color;			// color of the refraction
-	float		m_refraction_roughness;		// how blurry the refraction is (from 0.0 == sharp to 1.0 == blurry)
+// sphere with an emissive material: sampled explicitly when shading diffuse hits
+struct SphereLight {
+	point_t			m_center;
+	float			m_radius;
+	material_id_t	m_material;
 };
 
 class Scene {
@@ -35,10 +32,18 @@ public:
 	material_id_t material_create_diffuse(const color_t &albedo);
 	material_id_t material_create_specular(const color_t &albedo, float specular_chance, const color_t &specular_color, float specular_roughness);
 
+	material_id_t material_create_emissive(const color_t &emission);		// a light: emits but doesn't reflect
+
+	material_id_t material_add(const Material &material);
+
 	const Material &material(material_id_t material) const {
 		assert(material < m_materials.size());
 		return m_materials[material];
 	}
+	const std::vector<Material> &materials() const {return m_materials;}
+
+	// compact copy of the materials used while rendering (available after finalizing the scene)
+	const MaterialTable &material_table() const {return m_material_table;}
 
 	// camera
 	void setup_camera(float aspect_ratio, float vertical_fov, point_t look_from, point_t look_at, vector_t v_up,
@@ -47,18 +52,41 @@ public:
 
 	// geometry
 	const GeometrySpheres &spheres() const {return m_spheres;}
+	GeometrySpheres &spheres_modify() {m_finalized = false; return m_spheres;}			// direct access for scene loaders
 	void sphere_add(const point_t &center, float radius, material_id_t material);
 
+	const GeometryTriangles &triangles() const {return m_triangles;}
+	GeometryTriangles &triangles_modify() {m_finalized = false; return m_triangles;}		// direct access for mesh loaders
+	void mesh_add(const std::vector<point_t> &vertices, const std::vector<uint32_t> &indices, material_id_t material);
+
+	// lights: the spheres with an emissive material (available after finalizing the scene)
+	const std::vector<SphereLight> &lights() const {return m_lights;}
+
+	// build the acceleration structures, should be called after all geometry has been added
+	//	(adding more geometry invalidates the acceleration structures), the BVH builder uses the thread pool when one is given
+	void finalize(AccelerationStructure acceleration, BVHBuilder builder = BVHBuilder::BINNED, ThreadPool *pool = nullptr);
+	bool is_finalized() const {return m_finalized;}
+
+	// mark the scene as finalized when all geometry was restored together with its acceleration structures
+	void finalize_restored();
+
 	// ray tracing
 	bool hit_detection(const Ray &ray, HitRecord &hit) const;
+	void hit_detection(const RayPacket &packet, HitRecord *hits) const;		// one hit record for each ray of the packet (count records)
+	bool occluded(const Ray &ray, float t_max) const;						// is anything hit before t_max?
 
 private:
 	Material &material_create_default();
+	void collect_lights();
 
 private:
 	Camera					m_camera;
 	GeometrySpheres			m_spheres;
+	GeometryTriangles		m_triangles;
 	std::vector<Material>	m_materials;
+	MaterialTable			m_material_table;
+	std::vector<SphereLight>	m_lights;
+	bool					m_finalized = false;
 };
 
 } // namespace rtiow
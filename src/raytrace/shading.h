@@ -0,0 +1,245 @@
+// raytrace/shading.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// what happens to a path at a hit: absorption, choosing the type of reflection and the direction of the next ray
+//	Shared by the integrators so they produce exactly the same paths for the same random sequence.
+//
+//	Diffuse hits also sample the spherical lights of the scene directly (next event estimation). Light that is found
+//	both by a light sample and by the next ray of the path is weighted by multiple importance sampling (power
+//	heuristic), so small lights are found quickly without counting their light twice.
+
+#pragma once
+
+#include "config.h"
+#include "geometry_base.h"
+#include "ray.h"
+#include "render_stats.h"
+#include "scene.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace rtiow {
+
+// camera ray through a random position in pixel (x, y), the sampler should be at the start of the path
+inline Ray camera_ray(const Scene &scene, const RayTracerConfig &config, uint32_t x, uint32_t y, Sampler &sampler) {
+	auto jitter = sampler.next_2d();
+	auto u = (static_cast<float>(x) + jitter.x) / static_cast<float>(config.m_render_resolution_x - 1);
+	auto v = (static_cast<float>(y) + jitter.y) / static_cast<float>(config.m_render_resolution_y - 1);
+	return scene.camera().create_ray(u, v, sampler);
+}
+
+inline color_t environment_color(const Ray &ray) {
+	auto unit_direction = glm::normalize(ray.direction());
+	auto t = 0.5f * (unit_direction.y + 1.0f);
+	return (1.0f-t) * color_t(1.0f, 1.0f, 1.0f) + t * color_t(0.5f, 0.7f, 1.0f);
+}
+
+inline float reflectance(float cosine, float ref_idx) {
+	// Use Schlick's approximation for reflectance.
+	auto r0 = (1.0f - ref_idx) / (1.0f + ref_idx);
+	r0 = r0 * r0;
+	return r0 + (1 - r0) * glm::pow((1.0f - cosine), 5.0f);
+}
+
+inline color_t specular_reflect(Ray &ray, const HitRecord &hit, const SpecularLobe &specular, Sampler &sampler) {
+
+	auto reflected_dir = glm::reflect(ray.direction(), hit.m_normal);
+	ray = Ray(hit.m_point, glm::normalize(reflected_dir + specular.m_roughness * random_vector_in_unit_sphere(sampler)));
+
+	if (glm::dot(ray.direction(), hit.m_normal) > 0) {
+		return specular.m_color;
+	} else {
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+}
+
+inline float power_heuristic(float pdf, float other_pdf) {
+	return (pdf * pdf) / (pdf * pdf + other_pdf * other_pdf);
+}
+
+// 1 - cos(theta_max) of the cone of directions from p that contains the light (0 when p is inside the light)
+inline float sphere_light_cone(const SphereLight &light, const point_t &p) {
+	auto to_center = light.m_center - p;
+	auto distance_sq = glm::dot(to_center, to_center);
+	auto radius_sq = light.m_radius * light.m_radius;
+	if (distance_sq <= radius_sq) {
+		return 0.0f;
+	}
+
+	// written to avoid cancellation for distant lights
+	auto sin_sq_max = radius_sq / distance_sq;
+	return sin_sq_max / (1.0f + glm::sqrt(1.0f - sin_sq_max));
+}
+
+// density (per solid angle) of sampling a direction towards the light from point p
+inline float sphere_light_pdf(const SphereLight &light, const point_t &p, size_t num_lights) {
+	auto cone = sphere_light_cone(light, p);
+	return (cone > 0.0f) ? 1.0f / (2.0f * PI * cone * static_cast<float>(num_lights)) : 0.0f;
+}
+
+// light arriving at a diffuse hit from one randomly chosen light, multiplied with the cosine term and the 1/pi of the
+//	diffuse lobe and divided by the density of the sample (the caller applies the albedo)
+inline color_t sample_lights(const Scene &scene, const HitRecord &hit, Sampler &sampler) {
+	RTIOW_STATS(m_light_samples++);
+
+	const auto &lights = scene.lights();
+	auto index = std::min(static_cast<size_t>(random_float(sampler) * static_cast<float>(lights.size())), lights.size() - 1);
+	const auto &light = lights[index];
+
+	auto cone = sphere_light_cone(light, hit.m_point);
+	if (cone <= 0.0f) {
+		return {0.0f, 0.0f, 0.0f};
+	}
+	auto light_pdf = 1.0f / (2.0f * PI * cone * static_cast<float>(lights.size()));
+
+	// uniform direction in the cone around the direction to the center of the light
+	auto to_center = light.m_center - hit.m_point;
+	auto distance_sq = glm::dot(to_center, to_center);
+	auto w = to_center / glm::sqrt(distance_sq);
+
+	auto cone_sample = sampler.next_2d();
+	auto cos_theta = 1.0f - cone_sample.x * cone;
+	auto sin_theta = glm::sqrt(glm::max(0.0f, 1.0f - cos_theta * cos_theta));
+	auto phi = 2.0f * PI * cone_sample.y;
+
+	// orthonormal basis around w (Duff et al. 2017)
+	auto sign = std::copysign(1.0f, w.z);
+	auto a = -1.0f / (sign + w.z);
+	auto b = w.x * w.y * a;
+	auto u = vector_t(1.0f + sign * w.x * w.x * a, sign * b, -sign * w.x);
+	auto v = vector_t(b, sign + w.y * w.y * a, -w.y);
+
+	auto direction = glm::normalize((std::cos(phi) * sin_theta) * u + (std::sin(phi) * sin_theta) * v + cos_theta * w);
+
+	auto cos_surface = glm::dot(direction, hit.m_normal);
+	if (cos_surface <= 0.0f) {
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+	// the light must be visible: nothing may be hit before the near side of the light sphere
+	auto b_half = glm::dot(direction, to_center);
+	auto t_light = b_half - glm::sqrt(glm::max(0.0f, light.m_radius * light.m_radius - (distance_sq - b_half * b_half)));
+
+	RTIOW_STATS(m_shadow_rays++);
+	if (scene.occluded(Ray(hit.m_point, direction), t_light * 0.999f)) {
+		RTIOW_STATS(m_shadow_rays_occluded++);
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+	auto bsdf_pdf = cos_surface / PI;
+	return scene.material_table().emission(light.m_material) * (bsdf_pdf * power_heuristic(light_pdf, bsdf_pdf) / light_pdf);
+}
+
+// weight of the light of an emissive hit: the part of the light that wasn't already found by sampling the lights at the
+//	previous hit (bsdf_pdf is the density of the direction of the ray at the previous hit, 0 if no lights were sampled)
+inline float emission_weight(const Scene &scene, const Ray &ray, const HitRecord &hit, float bsdf_pdf) {
+	if (bsdf_pdf <= 0.0f) {
+		return 1.0f;
+	}
+
+	// find the light that was hit (emissive triangles or hollow spheres aren't sampled and always count completely)
+	const auto &lights = scene.lights();
+
+	for (const auto &light : lights) {
+		if (light.m_material == hit.m_material &&
+			glm::abs(glm::length(hit.m_point - light.m_center) - light.m_radius) <= 1e-3f * light.m_radius) {
+			return power_heuristic(bsdf_pdf, sphere_light_pdf(light, ray.origin(), lights.size()));
+		}
+	}
+
+	return 1.0f;
+}
+
+// replace the ray by the next ray of the path and update the attenuation of the path
+//	light_sampling: sample the lights at diffuse hits, the light that is found is added to radiance. bsdf_pdf receives
+//	the density of the direction of the new ray when it should be used to weight the light it finds (0 otherwise).
+inline void scatter(Ray &ray, const HitRecord &hit, color_t &attenuation, Sampler &sampler,
+					const Scene &scene, bool light_sampling, color_t &radiance, float &bsdf_pdf) {
+
+	const auto &materials = scene.material_table();
+	const auto &lobes = materials.lobes(hit.m_material);
+
+	bsdf_pdf = 0.0f;
+
+	// absorption if hit is from the inside of the object
+	if (!hit.m_front_face) {
+		attenuation *= glm::exp(-materials.refraction(hit.m_material).m_color * hit.m_at_t);
+	}
+
+	// decide how this ray will be reflected
+	float random_chance = random_float(sampler);
+	float ray_probability;
+
+	if (random_chance <= lobes.m_specular_cdf) {
+		// specular reflection
+		RTIOW_STATS(m_specular++);
+		ray_probability = lobes.m_probability[LOBE_SPECULAR];
+		attenuation *= specular_reflect(ray, hit, materials.specular(hit.m_material), sampler);
+	} else if (random_chance <= lobes.m_refraction_cdf) {
+		RTIOW_STATS(m_refraction++);
+		ray_probability = lobes.m_probability[LOBE_REFRACTION];
+
+		// refraction
+		const auto &refraction = materials.refraction(hit.m_material);
+		float refraction_ratio = hit.m_front_face ? 1.0f / refraction.m_index_of_refraction : refraction.m_index_of_refraction;
+		float cos_theta = glm::min(glm::dot(-ray.direction(), hit.m_normal), 1.0f);
+		float sin_theta = glm::sqrt(1.0f - cos_theta*cos_theta);
+
+		if (refraction_ratio * sin_theta > 1.0f || reflectance(cos_theta, refraction_ratio) > ray_probability) {
+			// refraction not possible or looking at steep angle so material becomes reflective
+			RTIOW_STATS(m_refraction_reflected++);
+			attenuation *= specular_reflect(ray, hit, materials.specular(hit.m_material), sampler);
+		} else {
+			auto refraction_dir = glm::refract(ray.direction(), hit.m_normal, refraction_ratio);
+			ray = Ray(hit.m_point, glm::normalize(refraction_dir + refraction.m_roughness * random_vector_in_unit_sphere(sampler)));
+		}
+	} else {
+		// diffuse reflection
+		RTIOW_STATS(m_diffuse++);
+		ray_probability = lobes.m_probability[LOBE_DIFFUSE];
+
+		const auto &albedo = materials.albedo(hit.m_material);
+		light_sampling = light_sampling && !scene.lights().empty();
+		if (light_sampling) {
+			radiance += attenuation * albedo * sample_lights(scene, hit, sampler) / ray_probability;
+		}
+
+		auto diffuse_dir = glm::normalize(hit.m_normal + random_unit_vector(sampler));
+		if (glm::all(glm::epsilonEqual(diffuse_dir, vector_t(0.0f, 0.0f, 0.0f), 1e-6f))) {
+			diffuse_dir = hit.m_normal;
+		}
+		ray = Ray(hit.m_point, diffuse_dir);
+		attenuation *= albedo;
+
+		if (light_sampling) {
+			// cosine weighted hemisphere
+			bsdf_pdf = glm::max(glm::dot(diffuse_dir, hit.m_normal), 0.0f) / PI;
+		}
+	}
+
+	// divide attentuation by the probability that this ray-type was chosen to make sure
+	// they count the same in the final average
+	attenuation /= ray_probability;
+}
+
+// russian roulette: randomly stop paths that can only contribute a little to the final color,
+//	the surviving paths are boosted to compensate for the terminated ones. Returns false when the path stops.
+inline bool russian_roulette(int32_t bounce, const RayTracerConfig &config, color_t &attenuation, Sampler &sampler) {
+
+	if (config.m_russian_roulette_depth <= 0 || bounce + 1 < config.m_russian_roulette_depth) {
+		return true;
+	}
+
+	auto survive_probability = glm::min(glm::max(attenuation.r, glm::max(attenuation.g, attenuation.b)), 1.0f);
+	if (random_float(sampler) >= survive_probability) {
+		RTIOW_STATS(m_paths_terminated++);
+		return false;
+	}
+
+	attenuation /= survive_probability;
+	return true;
+}
+
+} // namespace rtiow
@@ -0,0 +1,364 @@
+// raytrace/simd.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// minimal 8-wide SIMD abstraction used by the intersection kernels
+//	The instruction set is selected at build time (RTIOW_SIMD in CMake): AVX2 uses a single 256-bit register,
+//	SSE4 uses two 128-bit registers and the scalar fallback a plain array (which the compiler might vectorize).
+//	A 4-wide variant with the operations needed by the node test of the 4-wide BVH uses a single 128-bit register.
+
+#pragma once
+
+#include "types.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+#if defined(RTIOW_SIMD_AVX2)
+	#include <immintrin.h>
+#elif defined(RTIOW_SIMD_SSE4)
+	#include <smmintrin.h>
+#else
+	#include <cmath>
+#endif
+
+namespace rtiow {
+namespace simd {
+
+#if defined(RTIOW_SIMD_AVX2)
+
+constexpr const char *INSTRUCTION_SET = "AVX2";
+constexpr bool ENABLED = true;
+
+struct float8 {
+	__m256	v;
+
+	float8() = default;
+	float8(__m256 value) : v(value) {}
+	explicit float8(float f) : v(_mm256_set1_ps(f)) {}
+
+	static float8 load(const float *p) {return _mm256_loadu_ps(p);}
+	static float8 lane_index() {return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);}
+	void store(float *p) const {_mm256_storeu_ps(p, v);}
+};
+
+// each lane of a mask is either all ones or all zeros
+struct mask8 {
+	__m256	v;
+
+	mask8(__m256 value) : v(value) {}
+	static mask8 from_bits(int bits) {
+		const auto lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lane_bits), lane_bits));
+	}
+	int bits() const {return _mm256_movemask_ps(v);}
+	bool any() const {return bits() != 0;}
+};
+
+inline float8 operator+(float8 a, float8 b) {return _mm256_add_ps(a.v, b.v);}
+inline float8 operator-(float8 a, float8 b) {return _mm256_sub_ps(a.v, b.v);}
+inline float8 operator*(float8 a, float8 b) {return _mm256_mul_ps(a.v, b.v);}
+inline float8 operator/(float8 a, float8 b) {return _mm256_div_ps(a.v, b.v);}
+inline float8 operator-(float8 a) {return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f));}
+inline float8 min(float8 a, float8 b) {return _mm256_min_ps(a.v, b.v);}
+inline float8 max(float8 a, float8 b) {return _mm256_max_ps(a.v, b.v);}
+inline float8 sqrt(float8 a) {return _mm256_sqrt_ps(a.v);}
+
+inline mask8 operator<(float8 a, float8 b) {return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);}
+inline mask8 operator<=(float8 a, float8 b) {return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ);}
+inline mask8 operator>(float8 a, float8 b) {return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ);}
+inline mask8 operator>=(float8 a, float8 b) {return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ);}
+inline mask8 operator&(mask8 a, mask8 b) {return _mm256_and_ps(a.v, b.v);}
+inline mask8 operator|(mask8 a, mask8 b) {return _mm256_or_ps(a.v, b.v);}
+
+// per lane: mask ? a : b
+inline float8 select(mask8 mask, float8 a, float8 b) {return _mm256_blendv_ps(b.v, a.v, mask.v);}
+
+inline float horizontal_min(float8 a) {
+	auto m = _mm_min_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+	m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+inline float horizontal_max(float8 a) {
+	auto m = _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+	m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+// load 8 consecutive groups of 4 floats (array of structures) as one vector per member
+inline void load_transposed(const float *p, float8 &a, float8 &b, float8 &c, float8 &d) {
+	// 128-bit lanes: groups 0 and 4, 1 and 5, 2 and 6, 3 and 7
+	auto r0 = _mm256_loadu_ps(p);
+	auto r1 = _mm256_loadu_ps(p + 8);
+	auto r2 = _mm256_loadu_ps(p + 16);
+	auto r3 = _mm256_loadu_ps(p + 24);
+	auto t0 = _mm256_permute2f128_ps(r0, r2, 0x20);
+	auto t1 = _mm256_permute2f128_ps(r0, r2, 0x31);
+	auto t2 = _mm256_permute2f128_ps(r1, r3, 0x20);
+	auto t3 = _mm256_permute2f128_ps(r1, r3, 0x31);
+
+	// 4x4 transpose in each 128-bit lane
+	auto u0 = _mm256_unpacklo_ps(t0, t1);
+	auto u1 = _mm256_unpackhi_ps(t0, t1);
+	auto u2 = _mm256_unpacklo_ps(t2, t3);
+	auto u3 = _mm256_unpackhi_ps(t2, t3);
+	a = _mm256_shuffle_ps(u0, u2, _MM_SHUFFLE(1, 0, 1, 0));
+	b = _mm256_shuffle_ps(u0, u2, _MM_SHUFFLE(3, 2, 3, 2));
+	c = _mm256_shuffle_ps(u1, u3, _MM_SHUFFLE(1, 0, 1, 0));
+	d = _mm256_shuffle_ps(u1, u3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+#elif defined(RTIOW_SIMD_SSE4)
+
+constexpr const char *INSTRUCTION_SET = "SSE4";
+constexpr bool ENABLED = true;
+
+struct float8 {
+	__m128	lo;
+	__m128	hi;
+
+	float8() = default;
+	float8(__m128 l, __m128 h) : lo(l), hi(h) {}
+	explicit float8(float f) : lo(_mm_set1_ps(f)), hi(_mm_set1_ps(f)) {}
+
+	static float8 load(const float *p) {return {_mm_loadu_ps(p), _mm_loadu_ps(p + 4)};}
+	static float8 lane_index() {return {_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f)};}
+	void store(float *p) const {_mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi);}
+};
+
+struct mask8 {
+	__m128	lo;
+	__m128	hi;
+
+	mask8(__m128 l, __m128 h) : lo(l), hi(h) {}
+	static mask8 from_bits(int bits) {
+		const auto lo_bits = _mm_setr_epi32(1, 2, 4, 8);
+		const auto hi_bits = _mm_setr_epi32(16, 32, 64, 128);
+		const auto b = _mm_set1_epi32(bits);
+		return {_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, lo_bits), lo_bits)),
+				_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, hi_bits), hi_bits))};
+	}
+	int bits() const {return _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4);}
+	bool any() const {return bits() != 0;}
+};
+
+#define RTIOW_SSE_OP(name, intrinsic, result_t)												\
+	inline result_t name(float8 a, float8 b) {return {intrinsic(a.lo, b.lo), intrinsic(a.hi, b.hi)};}
+
+RTIOW_SSE_OP(operator+, _mm_add_ps, float8)
+RTIOW_SSE_OP(operator-, _mm_sub_ps, float8)
+RTIOW_SSE_OP(operator*, _mm_mul_ps, float8)
+RTIOW_SSE_OP(operator/, _mm_div_ps, float8)
+RTIOW_SSE_OP(min, _mm_min_ps, float8)
+RTIOW_SSE_OP(max, _mm_max_ps, float8)
+RTIOW_SSE_OP(operator<, _mm_cmplt_ps, mask8)
+RTIOW_SSE_OP(operator<=, _mm_cmple_ps, mask8)
+RTIOW_SSE_OP(operator>, _mm_cmpgt_ps, mask8)
+RTIOW_SSE_OP(operator>=, _mm_cmpge_ps, mask8)
+
+#undef RTIOW_SSE_OP
+
+inline float8 operator-(float8 a) {return {_mm_xor_ps(a.lo, _mm_set1_ps(-0.0f)), _mm_xor_ps(a.hi, _mm_set1_ps(-0.0f))};}
+inline float8 sqrt(float8 a) {return {_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)};}
+inline mask8 operator&(mask8 a, mask8 b) {return {_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)};}
+inline mask8 operator|(mask8 a, mask8 b) {return {_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)};}
+
+inline float8 select(mask8 mask, float8 a, float8 b) {
+	return {_mm_blendv_ps(b.lo, a.lo, mask.lo), _mm_blendv_ps(b.hi, a.hi, mask.hi)};
+}
+
+inline float horizontal_min(float8 a) {
+	auto m = _mm_min_ps(a.lo, a.hi);
+	m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+inline float horizontal_max(float8 a) {
+	auto m = _mm_max_ps(a.lo, a.hi);
+	m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+// load 8 consecutive groups of 4 floats (array of structures) as one vector per member
+inline void load_transposed(const float *p, float8 &a, float8 &b, float8 &c, float8 &d) {
+	auto lo0 = _mm_loadu_ps(p), lo1 = _mm_loadu_ps(p + 4), lo2 = _mm_loadu_ps(p + 8), lo3 = _mm_loadu_ps(p + 12);
+	auto hi0 = _mm_loadu_ps(p + 16), hi1 = _mm_loadu_ps(p + 20), hi2 = _mm_loadu_ps(p + 24), hi3 = _mm_loadu_ps(p + 28);
+	_MM_TRANSPOSE4_PS(lo0, lo1, lo2, lo3);
+	_MM_TRANSPOSE4_PS(hi0, hi1, hi2, hi3);
+	a = {lo0, hi0};
+	b = {lo1, hi1};
+	c = {lo2, hi2};
+	d = {lo3, hi3};
+}
+
+#else
+
+constexpr const char *INSTRUCTION_SET = "none";
+constexpr bool ENABLED = false;
+
+struct float8 {
+	float	v[8];
+
+	float8() = default;
+	explicit float8(float f) {for (auto &x : v) x = f;}
+
+	static float8 load(const float *p) {float8 r; for (int i = 0; i < 8; ++i) r.v[i] = p[i]; return r;}
+	static float8 lane_index() {float8 r; for (int i = 0; i < 8; ++i) r.v[i] = float(i); return r;}
+	void store(float *p) const {for (int i = 0; i < 8; ++i) p[i] = v[i];}
+};
+
+struct mask8 {
+	bool	v[8];
+
+	static mask8 from_bits(int bits) {mask8 r; for (int i = 0; i < 8; ++i) r.v[i] = (bits >> i) & 1; return r;}
+	int bits() const {int r = 0; for (int i = 0; i < 8; ++i) r |= v[i] << i; return r;}
+	bool any() const {return bits() != 0;}
+};
+
+#define RTIOW_SCALAR_OP(name, expr, result_t)												\
+	inline result_t name(float8 a, float8 b) {result_t r; for (int i = 0; i < 8; ++i) r.v[i] = (expr); return r;}
+
+RTIOW_SCALAR_OP(operator+, a.v[i] + b.v[i], float8)
+RTIOW_SCALAR_OP(operator-, a.v[i] - b.v[i], float8)
+RTIOW_SCALAR_OP(operator*, a.v[i] * b.v[i], float8)
+RTIOW_SCALAR_OP(operator/, a.v[i] / b.v[i], float8)
+RTIOW_SCALAR_OP(min, (b.v[i] < a.v[i]) ? b.v[i] : a.v[i], float8)
+RTIOW_SCALAR_OP(max, (a.v[i] < b.v[i]) ? b.v[i] : a.v[i], float8)
+RTIOW_SCALAR_OP(operator<, a.v[i] < b.v[i], mask8)
+RTIOW_SCALAR_OP(operator<=, a.v[i] <= b.v[i], mask8)
+RTIOW_SCALAR_OP(operator>, a.v[i] > b.v[i], mask8)
+RTIOW_SCALAR_OP(operator>=, a.v[i] >= b.v[i], mask8)
+
+#undef RTIOW_SCALAR_OP
+
+inline float8 operator-(float8 a) {float8 r; for (int i = 0; i < 8; ++i) r.v[i] = -a.v[i]; return r;}
+inline float8 sqrt(float8 a) {float8 r; for (int i = 0; i < 8; ++i) r.v[i] = std::sqrt(a.v[i]); return r;}
+inline mask8 operator&(mask8 a, mask8 b) {mask8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] && b.v[i]; return r;}
+inline mask8 operator|(mask8 a, mask8 b) {mask8 r; for (int i = 0; i < 8; ++i) r.v[i] = a.v[i] || b.v[i]; return r;}
+
+inline float8 select(mask8 mask, float8 a, float8 b) {
+	float8 r;
+	for (int i = 0; i < 8; ++i) r.v[i] = mask.v[i] ? a.v[i] : b.v[i];
+	return r;
+}
+
+inline float horizontal_min(float8 a) {
+	float r = a.v[0];
+	for (int i = 1; i < 8; ++i) r = (a.v[i] < r) ? a.v[i] : r;
+	return r;
+}
+
+inline float horizontal_max(float8 a) {
+	float r = a.v[0];
+	for (int i = 1; i < 8; ++i) r = (r < a.v[i]) ? a.v[i] : r;
+	return r;
+}
+
+// load 8 consecutive groups of 4 floats (array of structures) as one vector per member
+inline void load_transposed(const float *p, float8 &a, float8 &b, float8 &c, float8 &d) {
+	for (int i = 0; i < 8; ++i) {
+		a.v[i] = p[4 * i];
+		b.v[i] = p[4 * i + 1];
+		c.v[i] = p[4 * i + 2];
+		d.v[i] = p[4 * i + 3];
+	}
+}
+
+#endif
+
+// 4-wide vectors: one 128-bit register with both AVX2 and SSE4
+#if defined(RTIOW_SIMD_AVX2) || defined(RTIOW_SIMD_SSE4)
+
+struct float4 {
+	__m128	v;
+
+	float4() = default;
+	float4(__m128 value) : v(value) {}
+	explicit float4(float f) : v(_mm_set1_ps(f)) {}
+
+	static float4 load(const float *p) {return _mm_loadu_ps(p);}
+	void store(float *p) const {_mm_storeu_ps(p, v);}
+};
+
+struct mask4 {
+	__m128	v;
+
+	mask4(__m128 value) : v(value) {}
+	int bits() const {return _mm_movemask_ps(v);}
+	bool any() const {return bits() != 0;}
+};
+
+inline float4 operator-(float4 a, float4 b) {return _mm_sub_ps(a.v, b.v);}
+inline float4 operator*(float4 a, float4 b) {return _mm_mul_ps(a.v, b.v);}
+inline float4 min(float4 a, float4 b) {return _mm_min_ps(a.v, b.v);}
+inline float4 max(float4 a, float4 b) {return _mm_max_ps(a.v, b.v);}
+inline mask4 operator<=(float4 a, float4 b) {return _mm_cmple_ps(a.v, b.v);}
+inline mask4 operator&(mask4 a, mask4 b) {return _mm_and_ps(a.v, b.v);}
+
+#else
+
+struct float4 {
+	float	v[4];
+
+	float4() = default;
+	explicit float4(float f) {for (auto &x : v) x = f;}
+
+	static float4 load(const float *p) {float4 r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r;}
+	void store(float *p) const {for (int i = 0; i < 4; ++i) p[i] = v[i];}
+};
+
+struct mask4 {
+	bool	v[4];
+
+	int bits() const {int r = 0; for (int i = 0; i < 4; ++i) r |= v[i] << i; return r;}
+	bool any() const {return bits() != 0;}
+};
+
+#define RTIOW_SCALAR_OP(name, expr, result_t)												\
+	inline result_t name(float4 a, float4 b) {result_t r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r;}
+
+RTIOW_SCALAR_OP(operator-, a.v[i] - b.v[i], float4)
+RTIOW_SCALAR_OP(operator*, a.v[i] * b.v[i], float4)
+RTIOW_SCALAR_OP(min, (b.v[i] < a.v[i]) ? b.v[i] : a.v[i], float4)
+RTIOW_SCALAR_OP(max, (a.v[i] < b.v[i]) ? b.v[i] : a.v[i], float4)
+RTIOW_SCALAR_OP(operator<=, a.v[i] <= b.v[i], mask4)
+
+#undef RTIOW_SCALAR_OP
+
+inline mask4 operator&(mask4 a, mask4 b) {mask4 r; for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] && b.v[i]; return r;}
+
+#endif
+
+// vector and mask type with the given number of lanes
+template <uint32_t WIDTH>
+struct lanes;
+
+template <>
+struct lanes<4> {
+	using float_type = float4;
+	using mask_type = mask4;
+};
+
+template <>
+struct lanes<8> {
+	using float_type = float8;
+	using mask_type = mask8;
+};
+
+// index of the lowest set bit of a (non-zero) lane mask
+inline int first_lane(int bits) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, static_cast<unsigned long>(bits));
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(static_cast<unsigned int>(bits));
+#endif
+}
+
+} // namespace rtiow::simd
+} // namespace rtiow
@@ -1,13 +1,22 @@
 // raytrace/thread_pool.h - Johan Smet - BSD-3-Clause (see LICENSE)
 //
 // a simple thread-pool abstraction (no promises/futures)
+//	Each worker has its own work-stealing deque: tasks added by a worker go to its own deque, tasks added by
+//	other threads go to a shared injection queue from which idle workers grab a batch at a time. Workers without
+//	work steal from randomly chosen other workers.
+//	Completion of a batch of tasks can be tracked with a TaskGroup. Worker threads that wait for completion
+//	help executing the queued tasks, which makes it safe to wait from inside a task.
 
 #pragma once
 
 #include "types.h"
+#include "work_stealing_deque.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <thread>
@@ -15,6 +24,33 @@
 
 namespace rtiow {
 
+// completion counters for a batch of tasks
+class TaskGroup {
+public:
+	// construction
+	TaskGroup() = default;
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup &operator=(const TaskGroup &) = delete;
+
+	// information
+	size_t tasks_total() const {return m_total.load();}
+	size_t tasks_completed() const {return m_completed.load();}
+	bool is_done() const {return tasks_completed() == tasks_total();}
+
+private:
+	friend class ThreadPool;
+
+	std::atomic<size_t>	m_total = 0;
+	std::atomic<size_t>	m_completed = 0;
+};
+
+// per worker load balancing statistics
+struct WorkerStats {
+	uint64_t	m_tasks_executed = 0;		// total number of tasks executed by the worker
+	uint64_t	m_tasks_stolen = 0;			// number of tasks the worker stole from other workers
+	uint64_t	m_steal_attempts = 0;		// number of times the worker tried to steal from another worker
+};
+
 class ThreadPool {
 private:
 	using mutex_t = std::mutex;
@@ -22,26 +58,48 @@ private:
 	using task_func_t = std::function<void()>;
 	using condition_var_t = std::condition_variable;
 
+	struct Task {
+		task_func_t	m_func;
+		TaskGroup *	m_group;
+	};
+
+	struct alignas(64) Worker {
+		WorkStealingDeque<Task *>	m_deque;
+		uint32_t					m_random_state = 1;
+
+		// statistics (only written by the worker itself)
+		std::atomic<uint64_t>		m_tasks_executed = 0;
+		std::atomic<uint64_t>		m_tasks_stolen = 0;
+		std::atomic<uint64_t>		m_steal_attempts = 0;
+	};
+
+	static constexpr int SPIN_COUNT = 64;		// number of times an idle worker looks for work before going to sleep
+
 public:
 	// construction
 	explicit ThreadPool(size_t num_workers) {
 		assert(num_workers > 0);
 
+		for (size_t i = 0; i < num_workers; ++i) {
+			m_workers.emplace_back(std::make_unique<Worker>());
+			m_workers.back()->m_random_state = uint32_t(i + 1) * 0x9e3779b9u;
+		}
+
 		// create worker threads
 		for (size_t i = 0; i < num_workers; ++i) {
-			m_threads.emplace_back(&ThreadPool::thread_func, this);
+			m_threads.emplace_back(&ThreadPool::thread_func, this, i);
 		}
 	}
 
 	~ThreadPool() {
 		// mark that threads should exit asap
 		{
-			unique_lock_t lock(m_tasks_mutex);
+			unique_lock_t lock(m_sleep_mutex);
 			m_should_stop = true;
 		}
 
 		// wake up all threads
-		m_tasks_cv.notify_all();
+		m_sleep_cv.notify_all();
 
 		// wait for all threads to exit
 		for (auto &thread: m_threads) {
@@ -60,51 +118,242 @@ public:
 		return int32_t(std::thread::hardware_concurrency());
 	}
 
+	size_t num_workers() const {
+		return m_threads.size();
+	}
+
+	std::vector<WorkerStats> worker_stats() const {
+		std::vector<WorkerStats> result;
+		for (const auto &worker : m_workers) {
+			result.push_back({worker->m_tasks_executed.load(), worker->m_tasks_stolen.load(), worker->m_steal_attempts.load()});
+		}
+		return result;
+	}
+
+	void reset_worker_stats() {
+		for (auto &worker : m_workers) {
+			worker->m_tasks_executed = 0;
+			worker->m_tasks_stolen = 0;
+			worker->m_steal_attempts = 0;
+		}
+	}
+
 	// task interface
 	void add_task(task_func_t &&task) {
-		{
-			unique_lock_t lock(m_tasks_mutex);
-			m_tasks.emplace_back(std::forward<task_func_t>(task));
-		}
+		add_task(nullptr, std::forward<task_func_t>(task));
+	}
 
-		// kick off a thread to execute this task
-		m_tasks_cv.notify_one();
+	void add_task(TaskGroup &group, task_func_t &&task) {
+		add_task(&group, std::forward<task_func_t>(task));
+	}
+
+	// block until all tasks in the group have finished
+	void wait(const TaskGroup &group) {
+		wait_until([&group]() {return group.is_done();});
+	}
+
+	// block until no more tasks are queued or running (can't be called from a task)
+	void wait_idle() {
+		assert(current_worker() == nullptr);
+		wait_until([this]() {return m_tasks_active.load() == 0;});
 	}
 
 private:
-	void thread_func() {
+	void add_task(TaskGroup *group, task_func_t &&task) {
+		if (group) {
+			group->m_total.fetch_add(1);
+		}
 
-		while (true) {
-			task_func_t task;
+		m_tasks_active.fetch_add(1);
+		m_tasks_queued.fetch_add(1);
+
+		auto *new_task = new Task{std::forward<task_func_t>(task), group};
+
+		if (auto *worker = current_worker(); worker != nullptr) {
+			// lock-free path for tasks spawned by tasks
+			worker->m_deque.push(new_task);
+		} else {
+			unique_lock_t lock(m_inject_mutex);
+			m_inject_queue.push_back(new_task);
+		}
 
-			{
-				// wait for tasks or changes in state flags
-				unique_lock_t lock(m_tasks_mutex);
-				m_tasks_cv.wait(lock, [this] {return m_should_stop || !m_tasks.empty();});
+		// wake up a sleeping worker to execute this task
+		if (m_num_sleeping.load() > 0) {
+			unique_lock_t lock(m_sleep_mutex);
+			m_sleep_cv.notify_one();
+		}
+	}
 
-				// stop if asked unless there are still tasks to run
-				if (m_should_stop && m_tasks.empty()) {
-					return;
+	template <typename Pred>
+	void wait_until(Pred &&is_done) {
+
+		if (auto *worker = current_worker(); worker != nullptr) {
+			// help out instead of just blocking the worker
+			while (!is_done()) {
+				if (auto *task = find_task(*worker); task != nullptr) {
+					run_task(*worker, task);
+				} else {
+					std::this_thread::yield();
 				}
+			}
+			return;
+		}
+
+		unique_lock_t lock(m_done_mutex);
+		m_num_waiting.fetch_add(1);
+		m_done_cv.wait(lock, is_done);
+		m_num_waiting.fetch_sub(1);
+	}
 
-				// fetch next task
-				task = std::move(m_tasks.back());
-				m_tasks.pop_back();
+	Task *find_task(Worker &worker) {
+		// own deque first
+		auto *task = worker.m_deque.pop();
+
+		// grab a batch of tasks from the injection queue
+		if (task == nullptr) {
+			task = take_injected(worker);
+		}
+
+		// steal from other workers, starting at a random victim
+		if (task == nullptr && m_workers.size() > 1) {
+			auto num_workers = uint32_t(m_workers.size());
+			auto start = next_random(worker) % num_workers;
+
+			for (uint32_t i = 0; i < num_workers && task == nullptr; ++i) {
+				auto &victim = *m_workers[(start + i) % num_workers];
+				if (&victim == &worker) {
+					continue;
+				}
+
+				worker.m_steal_attempts.fetch_add(1, std::memory_order_relaxed);
+				task = victim.m_deque.steal();
+				if (task != nullptr) {
+					worker.m_tasks_stolen.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		if (task != nullptr) {
+			m_tasks_queued.fetch_sub(1);
+		}
+
+		return task;
+	}
+
+	Task *take_injected(Worker &worker) {
+		unique_lock_t lock(m_inject_mutex);
+
+		if (m_inject_queue.empty()) {
+			return nullptr;
+		}
+
+		// take a fair share of the queue: execute the first task, make the others available for stealing
+		auto count = std::max<size_t>(1, m_inject_queue.size() / m_workers.size());
+		auto *result = m_inject_queue.front();
+
+		// push in reverse order so the owner pops them in the order they were added
+		for (size_t i = count - 1; i > 0; --i) {
+			worker.m_deque.push(m_inject_queue[i]);
+		}
+		m_inject_queue.erase(m_inject_queue.begin(), m_inject_queue.begin() + std::ptrdiff_t(count));
+
+		return result;
+	}
+
+	void run_task(Worker &worker, Task *task) {
+		task->m_func();
+
+		if (task->m_group) {
+			task->m_group->m_completed.fetch_add(1);
+		}
+
+		delete task;
+		worker.m_tasks_executed.fetch_add(1, std::memory_order_relaxed);
+		m_tasks_active.fetch_sub(1);
+
+		// wake up threads waiting for completion (they check their own condition)
+		if (m_num_waiting.load() > 0) {
+			unique_lock_t lock(m_done_mutex);
+			m_done_cv.notify_all();
+		}
+	}
+
+	static uint32_t next_random(Worker &worker) {
+		// xorshift32
+		auto x = worker.m_random_state;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		worker.m_random_state = x;
+		return x;
+	}
+
+	struct CurrentThread {
+		const ThreadPool *	m_pool = nullptr;
+		Worker *			m_worker = nullptr;
+	};
+
+	static CurrentThread &current_thread() {
+		static thread_local CurrentThread current;
+		return current;
+	}
+
+	Worker *current_worker() const {
+		auto &current = current_thread();
+		return (current.m_pool == this) ? current.m_worker : nullptr;
+	}
+
+	void thread_func(size_t index) {
+
+		auto &worker = *m_workers[index];
+		current_thread() = {this, &worker};
+
+		while (true) {
+			// look for work, spin for a while before going to sleep
+			for (int spin = 0; spin < SPIN_COUNT; ++spin) {
+				if (auto *task = find_task(worker); task != nullptr) {
+					run_task(worker, task);
+					spin = 0;
+				} else {
+					std::this_thread::yield();
+				}
 			}
 
-			// execute tasks
-			task();
+			// wait for tasks or changes in state flags
+			unique_lock_t lock(m_sleep_mutex);
+			m_num_sleeping.fetch_add(1);
+			m_sleep_cv.wait(lock, [this] {return m_should_stop || m_tasks_queued.load() > 0;});
+			m_num_sleeping.fetch_sub(1);
+
+			// stop if asked unless there are still tasks to run
+			if (m_should_stop && m_tasks_queued.load() == 0) {
+				return;
+			}
 		}
 	}
 
 private:
-	std::vector<std::thread>	m_threads;
-	bool						m_should_stop = false;
+	std::vector<std::thread>				m_threads;
+	std::vector<std::unique_ptr<Worker>>	m_workers;
+
+	// tasks added by threads that are not part of the pool
+	std::deque<Task *>						m_inject_queue;
+	mutex_t									m_inject_mutex;
+
+	// task counters
+	std::atomic<size_t>						m_tasks_queued = 0;		// number of tasks waiting to be executed
+	std::atomic<size_t>						m_tasks_active = 0;		// number of tasks that are queued or running
 
-	std::vector<task_func_t>	m_tasks;
-	mutex_t						m_tasks_mutex;
-	condition_var_t				m_tasks_cv;
+	// idle workers
+	bool									m_should_stop = false;
+	std::atomic<size_t>						m_num_sleeping = 0;
+	mutex_t									m_sleep_mutex;
+	condition_var_t							m_sleep_cv;
 
+	// threads waiting for completion
+	std::atomic<size_t>						m_num_waiting = 0;
+	mutex_t									m_done_mutex;
+	condition_var_t							m_done_cv;
 };
 
 
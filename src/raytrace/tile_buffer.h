@@ -0,0 +1,125 @@
+// raytrace/tile_buffer.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// private copy of a rectangular part of the frame buffers
+//	A render task only works in its own cache line aligned copy of the tile. The shared buffers are touched twice: once to
+//	load the accumulated samples of the tile and once to publish the finished tile (a memcpy per row). Writing pixels
+//	straight into the shared buffers makes neighbouring tiles, and the display thread, fight over the cache lines at the
+//	left and right edge of every tile row.
+
+#pragma once
+
+#include "hdr_buffer.h"
+#include "rgb_buffer.h"
+
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace rtiow {
+
+class TileBuffer {
+public:
+	static constexpr size_t ALIGNMENT = 64;
+
+public:
+	// construction
+	TileBuffer() = default;
+	TileBuffer(const TileBuffer &other) = delete;
+	TileBuffer &operator=(const TileBuffer &other) = delete;
+
+	// copy the tile [x0, x1) x [y0, y1) from the shared buffers
+	void load(const HDRBuffer &hdr, const RGBBuffer &rgb, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+		assert(hdr.width() == rgb.width() && hdr.height() == rgb.height());
+		assert(x0 < x1 && x1 <= hdr.width() && y0 < y1 && y1 <= hdr.height());
+
+		m_x0 = x0;
+		m_y0 = y0;
+		m_width = x1 - x0;
+		m_height = y1 - y0;
+		allocate(size_t(m_width) * m_height);
+
+		for (uint32_t row = 0; row < m_height; ++row) {
+			auto src = shared_index(hdr.width(), row);
+			auto dst = size_t(row) * m_width;
+			memcpy(m_color + dst, hdr.data() + src, m_width * sizeof(color_t));
+			memcpy(m_sample_count + dst, hdr.sample_count() + src, m_width * sizeof(uint32_t));
+			memcpy(m_luminance_sq + dst, hdr.luminance_sq() + src, m_width * sizeof(float));
+			memcpy(m_rgb + 3 * dst, rgb.data() + 3 * src, 3 * m_width);
+		}
+	}
+
+	// copy the tile back into the shared buffers
+	void publish(HDRBuffer &hdr, RGBBuffer &rgb) const {
+		assert(hdr.width() == rgb.width() && hdr.height() == rgb.height());
+
+		for (uint32_t row = 0; row < m_height; ++row) {
+			auto dst = shared_index(hdr.width(), row);
+			auto src = size_t(row) * m_width;
+			memcpy(hdr.data() + dst, m_color + src, m_width * sizeof(color_t));
+			memcpy(hdr.sample_count() + dst, m_sample_count + src, m_width * sizeof(uint32_t));
+			memcpy(hdr.luminance_sq() + dst, m_luminance_sq + src, m_width * sizeof(float));
+			memcpy(rgb.data() + 3 * dst, m_rgb + 3 * src, 3 * m_width);
+		}
+	}
+
+	// data access (row-major, m_width pixels per row)
+	uint32_t width() const {return m_width;}
+	uint32_t height() const {return m_height;}
+
+	color_t *data() {return m_color;}
+	uint32_t *sample_count() {return m_sample_count;}
+	float *luminance_sq() {return m_luminance_sq;}
+	uint8_t *rgb() {return m_rgb;}
+
+private:
+	size_t shared_index(uint32_t shared_width, uint32_t row) const {
+		return size_t(m_y0 + row) * shared_width + m_x0;
+	}
+
+	static size_t align(size_t size) {
+		return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	void allocate(size_t pixels) {
+		if (pixels <= m_capacity) {
+			return;
+		}
+
+		// one block for all arrays, each starting on a new cache line
+		auto color_size = align(pixels * sizeof(color_t));
+		auto count_size = align(pixels * sizeof(uint32_t));
+		auto luminance_size = align(pixels * sizeof(float));
+		auto rgb_size = align(pixels * 3);
+
+		m_memory.reset(static_cast<uint8_t *>(::operator new(color_size + count_size + luminance_size + rgb_size,
+															 std::align_val_t(ALIGNMENT))));
+		m_capacity = pixels;
+
+		auto *ptr = m_memory.get();
+		m_color = reinterpret_cast<color_t *>(ptr);
+		m_sample_count = reinterpret_cast<uint32_t *>(ptr + color_size);
+		m_luminance_sq = reinterpret_cast<float *>(ptr + color_size + count_size);
+		m_rgb = ptr + color_size + count_size + luminance_size;
+	}
+
+	struct AlignedDelete {
+		void operator()(uint8_t *ptr) const {::operator delete(ptr, std::align_val_t(ALIGNMENT));}
+	};
+
+private:
+	std::unique_ptr<uint8_t, AlignedDelete>	m_memory;
+	size_t		m_capacity = 0;
+
+	uint32_t	m_x0 = 0;
+	uint32_t	m_y0 = 0;
+	uint32_t	m_width = 0;
+	uint32_t	m_height = 0;
+
+	color_t *	m_color = nullptr;
+	uint32_t *	m_sample_count = nullptr;
+	float *		m_luminance_sq = nullptr;
+	uint8_t *	m_rgb = nullptr;
+};
+
+} // namespace rtiow
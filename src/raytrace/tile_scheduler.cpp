@@ -0,0 +1,152 @@
+// raytrace/tile_scheduler.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+namespace rtiow {
+
+namespace {
+
+// index of the cell (x, y) along the Hilbert curve that fills a grid of n x n cells (n is a power of two)
+uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y) {
+	uint64_t d = 0;
+
+	for (uint32_t s = n / 2; s > 0; s /= 2) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += uint64_t(s) * s * ((3 * rx) ^ ry);
+
+		// rotate the quadrant so the curve stays continuous
+		if (ry == 0) {
+			if (rx == 1) {
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+
+	return d;
+}
+
+} // unnamed namespace
+
+TileScheduler::TileScheduler(uint32_t width, uint32_t height, uint32_t tile_size, TileOrder order) :
+		m_width(width),
+		m_height(height),
+		m_order(order) {
+
+	assert(tile_size > 0);
+
+	for (uint32_t y0 = 0; y0 < height; y0 += tile_size) {
+		for (uint32_t x0 = 0; x0 < width; x0 += tile_size) {
+			m_tiles.push_back({x0, y0, std::min(width, x0 + tile_size), std::min(height, y0 + tile_size)});
+		}
+	}
+
+	sort();
+}
+
+bool TileScheduler::split_expensive(size_t num_workers) {
+
+	uint64_t total_cost = 0;
+	for (const auto &tile : m_tiles) {
+		total_cost += tile.m_cost;
+	}
+
+	const auto max_cost = total_cost / (std::max<size_t>(num_workers, 1) * TILES_PER_WORKER);
+	if (max_cost == 0) {
+		return false;
+	}
+
+	std::vector<Tile> result;
+	result.reserve(m_tiles.size());
+
+	for (const auto &tile : m_tiles) {
+		split_tile(tile, max_cost, result);
+	}
+
+	if (result.size() == m_tiles.size()) {
+		return false;
+	}
+
+	m_tiles = std::move(result);
+	sort();
+	return true;
+}
+
+void TileScheduler::split_tile(const Tile &tile, uint64_t max_cost, std::vector<Tile> &result) const {
+
+	const auto width = tile.m_x1 - tile.m_x0;
+	const auto height = tile.m_y1 - tile.m_y0;
+	const bool split_x = width >= 2 * MIN_TILE_SIZE;
+	const bool split_y = height >= 2 * MIN_TILE_SIZE;
+
+	if (tile.m_cost <= max_cost || (!split_x && !split_y)) {
+		result.push_back(tile);
+		return;
+	}
+
+	// split in halves or quarters, the cost of the parts is estimated until they have been rendered
+	const auto xm = split_x ? tile.m_x0 + width / 2 : tile.m_x1;
+	const auto ym = split_y ? tile.m_y0 + height / 2 : tile.m_y1;
+	const auto cost = tile.m_cost / ((split_x ? 2u : 1u) * (split_y ? 2u : 1u));
+
+	split_tile({tile.m_x0, tile.m_y0, xm, ym, cost}, max_cost, result);
+	if (split_x) {
+		split_tile({xm, tile.m_y0, tile.m_x1, ym, cost}, max_cost, result);
+	}
+	if (split_y) {
+		split_tile({tile.m_x0, ym, xm, tile.m_y1, cost}, max_cost, result);
+	}
+	if (split_x && split_y) {
+		split_tile({xm, ym, tile.m_x1, tile.m_y1, cost}, max_cost, result);
+	}
+}
+
+void TileScheduler::sort() {
+
+	// sort on the center of the tiles, expressed in cells of the minimum tile size
+	auto center_x = [](const Tile &t) {return (t.m_x0 + t.m_x1) / (2 * MIN_TILE_SIZE);};
+	auto center_y = [](const Tile &t) {return (t.m_y0 + t.m_y1) / (2 * MIN_TILE_SIZE);};
+
+	switch (m_order) {
+		case TileOrder::ROWS:
+			std::stable_sort(m_tiles.begin(), m_tiles.end(), [](const Tile &a, const Tile &b) {
+				return std::make_pair(a.m_y0, a.m_x0) < std::make_pair(b.m_y0, b.m_x0);
+			});
+			break;
+
+		case TileOrder::CENTER: {
+			// spiral outwards: by distance to the center of the image, then by angle
+			const auto cx = float(m_width) / float(2 * MIN_TILE_SIZE);
+			const auto cy = float(m_height) / float(2 * MIN_TILE_SIZE);
+
+			auto key = [=](const Tile &t) {
+				auto dx = float(t.m_x0 + t.m_x1) / float(2 * MIN_TILE_SIZE) - cx;
+				auto dy = float(t.m_y0 + t.m_y1) / float(2 * MIN_TILE_SIZE) - cy;
+				return std::make_pair(std::round(std::sqrt(dx * dx + dy * dy)), std::atan2(dy, dx));
+			};
+			std::stable_sort(m_tiles.begin(), m_tiles.end(), [&](const Tile &a, const Tile &b) {return key(a) < key(b);});
+			break;
+		}
+
+		case TileOrder::HILBERT: {
+			uint32_t n = 1;
+			while (n * MIN_TILE_SIZE < std::max(m_width, m_height)) {
+				n *= 2;
+			}
+
+			std::stable_sort(m_tiles.begin(), m_tiles.end(), [&](const Tile &a, const Tile &b) {
+				return hilbert_index(n, center_x(a), center_y(a)) < hilbert_index(n, center_x(b), center_y(b));
+			});
+			break;
+		}
+	}
+}
+
+} // namespace rtiow
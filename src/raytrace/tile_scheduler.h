@@ -0,0 +1,50 @@
+// raytrace/tile_scheduler.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// division of the image into tiles and the order in which they are rendered
+//	The render tasks take the tiles in order from a shared counter, so the order is respected no matter which worker
+//	is free first. Each tile remembers how long it took to render: tiles that took much longer than average are split
+//	before the next pass so a single expensive tile doesn't keep one thread busy while all others are idle.
+
+#pragma once
+
+#include "config.h"
+
+#include <vector>
+
+namespace rtiow {
+
+struct Tile {
+	uint32_t	m_x0, m_y0;			// top-left pixel (inclusive)
+	uint32_t	m_x1, m_y1;			// bottom-right pixel (exclusive)
+	uint64_t	m_cost = 0;			// time it took to render the tile in the previous pass (in ns)
+};
+
+class TileScheduler {
+public:
+	static constexpr uint32_t MIN_TILE_SIZE = 16;		// tiles are never split below this size
+	static constexpr uint32_t TILES_PER_WORKER = 4;	// split tiles that cost more than 1/TILES_PER_WORKER of the share of a worker
+
+public:
+	// construction
+	TileScheduler(uint32_t width, uint32_t height, uint32_t tile_size, TileOrder order);
+
+	// tiles in the order they should be rendered
+	size_t size() const {return m_tiles.size();}
+	Tile &tile(size_t index) {return m_tiles[index];}
+	const Tile &tile(size_t index) const {return m_tiles[index];}
+
+	// split the tiles that took too long in the last pass, returns true if any tile was split
+	bool split_expensive(size_t num_workers);
+
+private:
+	void split_tile(const Tile &tile, uint64_t max_cost, std::vector<Tile> &result) const;
+	void sort();
+
+private:
+	uint32_t			m_width;
+	uint32_t			m_height;
+	TileOrder			m_order;
+	std::vector<Tile>	m_tiles;
+};
+
+} // namespace rtiow
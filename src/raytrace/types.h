@@ -16,6 +16,6 @@ using color_t = glm::vec3;
 using point_t = glm::vec3;
 using vector_t = glm::vec3;
 
-using material_id_t = size_t;
+using material_id_t = uint32_t;
 
 } // namespace rtiow
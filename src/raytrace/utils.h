@@ -4,51 +4,106 @@
 
 #pragma once
 
-#include <random>
 #include "glm/geometric.hpp"
+#include "random.h"
+#include "sampler.h"
 #include "types.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace rtiow {
 
-inline float random_float() {
-	static std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-	static thread_local std::mt19937 generator;
+constexpr float PI = 3.14159265358979323846f;
 
-	return distribution(generator);
+inline float random_float(RandomGenerator &rng) {
+	return rng.next_float();
 }
 
-inline float random_float(float min, float max) {
-	return min + ((max - min) * random_float());
+inline float random_float(RandomGenerator &rng, float min, float max) {
+	return min + ((max - min) * random_float(rng));
 }
 
-inline vector_t random_vector() {
-	return vector_t(random_float(), random_float(), random_float());
+inline vector_t random_vector(RandomGenerator &rng) {
+	return vector_t(random_float(rng), random_float(rng), random_float(rng));
 }
 
-inline vector_t random_vector(float min, float max) {
-	return vector_t(random_float(min, max), random_float(min, max), random_float(min, max));
+inline vector_t random_vector(RandomGenerator &rng, float min, float max) {
+	return vector_t(random_float(rng, min, max), random_float(rng, min, max), random_float(rng, min, max));
 }
 
-inline vector_t random_vector_in_unit_sphere() {
+inline vector_t random_vector_in_unit_sphere(RandomGenerator &rng) {
 	while (true) {
-		auto v = random_vector(-1.0f, 1.0f);
+		auto v = random_vector(rng, -1.0f, 1.0f);
 		if (glm::dot(v, v) < 1.0f) {
 			return v;
 		}
 	}
 }
 
-inline vector_t random_vector_in_unit_disc() {
+inline vector_t random_vector_in_unit_disc(RandomGenerator &rng) {
 	while (true) {
-		auto v = vector_t{random_float(-1.0f, 1.0f), random_float(-1.0f, 1.0f), 0.0f};
+		auto v = vector_t{random_float(rng, -1.0f, 1.0f), random_float(rng, -1.0f, 1.0f), 0.0f};
 		if (glm::dot(v, v) < 1.0f) {
 			return v;
 		}
 	}
 }
 
-inline vector_t random_unit_vector() {
-	return glm::normalize(random_vector_in_unit_sphere());
+inline vector_t random_unit_vector(RandomGenerator &rng) {
+	return glm::normalize(random_vector_in_unit_sphere(rng));
+}
+
+// the same distributions taken from the next dimensions of a sampler
+//	SamplerType::RANDOM uses the functions above, the result is exactly the same as with a RandomGenerator.
+//	The other samplers need a fixed number of dimensions and map them directly to the distribution.
+inline float random_float(Sampler &sampler) {
+	return sampler.next_1d();
+}
+
+inline vector_t random_unit_vector(Sampler &sampler) {
+	if (sampler.type() == SamplerType::RANDOM) {
+		return random_unit_vector(sampler.rng());
+	}
+
+	auto u = sampler.next_2d();
+	auto z = 1.0f - 2.0f * u.x;
+	auto r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+	auto phi = 2.0f * PI * u.y;
+	return vector_t(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline vector_t random_vector_in_unit_sphere(Sampler &sampler) {
+	if (sampler.type() == SamplerType::RANDOM) {
+		return random_vector_in_unit_sphere(sampler.rng());
+	}
+
+	auto direction = random_unit_vector(sampler);
+	return std::cbrt(sampler.next_1d()) * direction;
+}
+
+inline vector_t random_vector_in_unit_disc(Sampler &sampler) {
+	if (sampler.type() == SamplerType::RANDOM) {
+		return random_vector_in_unit_disc(sampler.rng());
+	}
+
+	// concentric mapping of the square onto the disc (Shirley & Chiu 1997)
+	auto u = sampler.next_2d();
+	auto a = 2.0f * u.x - 1.0f;
+	auto b = 2.0f * u.y - 1.0f;
+	if (a == 0.0f && b == 0.0f) {
+		return vector_t(0.0f, 0.0f, 0.0f);
+	}
+
+	float r, phi;
+	if (std::abs(a) > std::abs(b)) {
+		r = a;
+		phi = (PI / 4.0f) * (b / a);
+	} else {
+		r = b;
+		phi = (PI / 2.0f) - (PI / 4.0f) * (a / b);
+	}
+	return vector_t(r * std::cos(phi), r * std::sin(phi), 0.0f);
 }
 
 inline void write_color(uint8_t **out, const color_t &color, uint32_t samples_per_pixel) {
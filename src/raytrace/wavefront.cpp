@@ -0,0 +1,275 @@
+// raytrace/wavefront.cpp - Johan Smet - BSD-3-Clause (see LICENSE)
+
+#include "wavefront.h"
+
+#include "ray_packet.h"
+#include "render_stats.h"
+#include "scene.h"
+#include "shading.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+namespace rtiow {
+
+void WavefrontTimings::merge(const WavefrontTimings &other) {
+	m_generate_ns += other.m_generate_ns;
+	m_intersect_ns += other.m_intersect_ns;
+	m_sort_ns += other.m_sort_ns;
+	m_shade_ns += other.m_shade_ns;
+	m_compact_ns += other.m_compact_ns;
+	m_batches += other.m_batches;
+	m_paths += other.m_paths;
+}
+
+void WavefrontTimings::print() const {
+	auto ms = [](uint64_t ns) {return double(ns) / 1e6;};
+
+	std::printf("Wavefront: %" PRIu64 " batches (%.0f paths per batch), generate %.1fms, intersect %.1fms, sort %.1fms, "
+				"shade %.1fms, compact %.1fms (summed over all threads)\n",
+				m_batches, double(m_paths) / double(std::max<uint64_t>(m_batches, 1)),
+				ms(m_generate_ns), ms(m_intersect_ns), ms(m_sort_ns), ms(m_shade_ns), ms(m_compact_ns));
+}
+
+void WavefrontBatch::Paths::resize(size_t size) {
+	for (int axis = 0; axis < 3; ++axis) {
+		m_origin[axis].resize(size);
+		m_direction[axis].resize(size);
+		m_attenuation[axis].resize(size);
+	}
+	m_bsdf_pdf.resize(size);
+	m_sampler.resize(size);
+	m_sample.resize(size);
+}
+
+Ray WavefrontBatch::Paths::ray(size_t i) const {
+	return Ray(point_t(m_origin[0][i], m_origin[1][i], m_origin[2][i]),
+			   vector_t(m_direction[0][i], m_direction[1][i], m_direction[2][i]));
+}
+
+void WavefrontBatch::Paths::set_ray(size_t i, const Ray &ray) {
+	const auto origin = ray.origin();
+	const auto direction = ray.direction();
+
+	for (int axis = 0; axis < 3; ++axis) {
+		m_origin[axis][i] = origin[axis];
+		m_direction[axis][i] = direction[axis];
+	}
+}
+
+color_t WavefrontBatch::Paths::attenuation(size_t i) const {
+	return color_t(m_attenuation[0][i], m_attenuation[1][i], m_attenuation[2][i]);
+}
+
+void WavefrontBatch::Paths::set_attenuation(size_t i, const color_t &attenuation) {
+	for (int c = 0; c < 3; ++c) {
+		m_attenuation[c][i] = attenuation[c];
+	}
+}
+
+void WavefrontBatch::reset(uint32_t capacity) {
+	m_capacity = std::max(capacity, 1u);
+	m_samples.clear();
+	m_samples.reserve(m_capacity);
+}
+
+void WavefrontBatch::trace(const Scene &scene, const RayTracerConfig &config, uint64_t frame_index, WavefrontTimings &timings) {
+	using clock_t = std::chrono::steady_clock;
+
+	auto stage_start = clock_t::now();
+	auto stage_done = [&stage_start](uint64_t &stage_ns) {
+		auto now = clock_t::now();
+		stage_ns += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - stage_start).count());
+		stage_start = now;
+	};
+
+	generate(scene, config, frame_index);
+	stage_done(timings.m_generate_ns);
+
+	int32_t bounce = 0;
+
+	for (; bounce < config.m_max_ray_bounces && m_num_paths > 0; ++bounce) {
+		intersect(scene, bounce == 0, config.m_packet_tracing);
+		stage_done(timings.m_intersect_ns);
+
+		sort_by_material(scene.material_table().size());
+		stage_done(timings.m_sort_ns);
+
+		shade(scene, config, bounce);
+		stage_done(timings.m_shade_ns);
+
+		compact();
+		stage_done(timings.m_compact_ns);
+	}
+
+	// the paths that are still alive ran out of bounces
+	RTIOW_STATS(m_paths_max_bounces += m_num_paths);
+	for (size_t i = 0; i < m_num_paths; ++i) {
+		RTIOW_STATS(add_path(uint32_t(bounce)));
+	}
+
+	timings.m_batches += 1;
+	timings.m_paths += m_samples.size();
+}
+
+void WavefrontBatch::generate(const Scene &scene, const RayTracerConfig &config, uint64_t frame_index) {
+
+	const auto width = config.m_render_resolution_x;
+
+	m_num_paths = m_samples.size();
+	m_paths.resize(m_num_paths);
+	m_color.assign(m_num_paths, color_t(0.0f, 0.0f, 0.0f));
+
+	for (size_t i = 0; i < m_num_paths; ++i) {
+		const auto &sample = m_samples[i];
+
+		// same random sequence as the other integrator: the image doesn't depend on the integrator
+		auto &sampler = m_paths.m_sampler[i];
+		sampler = Sampler(config.m_sampler, size_t(sample.m_y) * width + sample.m_x, sample.m_sample, config.m_samples_per_pixel, frame_index);
+		m_paths.set_ray(i, camera_ray(scene, config, sample.m_x, sample.m_y, sampler));
+		m_paths.m_sample[i] = uint32_t(i);
+	}
+
+	for (int c = 0; c < 3; ++c) {
+		std::fill_n(m_paths.m_attenuation[c].begin(), m_num_paths, 1.0f);
+	}
+	std::fill_n(m_paths.m_bsdf_pdf.begin(), m_num_paths, 0.0f);
+}
+
+void WavefrontBatch::intersect(const Scene &scene, bool primary, bool packets) {
+
+	if (primary) {
+		RTIOW_STATS(m_primary_rays += m_num_paths);
+	} else {
+		RTIOW_STATS(m_secondary_rays += m_num_paths);
+	}
+
+	m_hits.assign(m_num_paths, HitRecord());
+
+	// the camera rays of consecutive paths are coherent, the bounces aren't
+	if (primary && packets) {
+		Ray rays[RayPacket::SIZE];
+		HitRecord hits[RayPacket::SIZE];
+
+		for (size_t first = 0; first < m_num_paths; first += RayPacket::SIZE) {
+			auto count = static_cast<uint32_t>(std::min<size_t>(RayPacket::SIZE, m_num_paths - first));
+			for (uint32_t lane = 0; lane < count; ++lane) {
+				rays[lane] = m_paths.ray(first + lane);
+				hits[lane] = HitRecord();
+			}
+			scene.hit_detection(RayPacket(rays, count), hits);
+			std::copy_n(hits, count, &m_hits[first]);
+		}
+	} else {
+		for (size_t i = 0; i < m_num_paths; ++i) {
+			scene.hit_detection(m_paths.ray(i), m_hits[i]);
+		}
+	}
+}
+
+void WavefrontBatch::sort_by_material(size_t num_materials) {
+
+	// counting sort of the paths that hit something, the misses don't need a material
+	m_material_start.assign(num_materials + 1, 0);
+
+	for (size_t i = 0; i < m_num_paths; ++i) {
+		if (m_hits[i].m_at_t < std::numeric_limits<float>::infinity()) {
+			++m_material_start[m_hits[i].m_material + 1];
+		}
+	}
+
+	for (size_t m = 0; m < num_materials; ++m) {
+		m_material_start[m + 1] += m_material_start[m];
+	}
+
+	m_order.resize(m_material_start[num_materials]);
+
+	for (size_t i = 0; i < m_num_paths; ++i) {
+		if (m_hits[i].m_at_t < std::numeric_limits<float>::infinity()) {
+			m_order[m_material_start[m_hits[i].m_material]++] = uint32_t(i);
+		}
+	}
+}
+
+void WavefrontBatch::shade(const Scene &scene, const RayTracerConfig &config, int32_t bounce) {
+
+	m_alive.assign(m_num_paths, 0);
+
+	// paths that didn't hit anything pick up the color of the environment
+	for (size_t i = 0; i < m_num_paths; ++i) {
+		if (m_hits[i].m_at_t < std::numeric_limits<float>::infinity()) {
+			continue;
+		}
+
+		RTIOW_STATS(m_rays_missed++);
+		RTIOW_STATS(add_path(uint32_t(bounce)));
+		m_color[m_paths.m_sample[i]] += environment_color(m_paths.ray(i)) * m_paths.attenuation(i);
+	}
+
+	// the other paths scatter, all hits on the same material are handled one after the other
+	const auto &materials = scene.material_table();
+
+	for (auto i : m_order) {
+		const auto &hit = m_hits[i];
+		RTIOW_STATS(m_rays_hit++);
+
+		auto ray = m_paths.ray(i);
+		auto attenuation = m_paths.attenuation(i);
+		auto &sampler = m_paths.m_sampler[i];
+		auto &color = m_color[m_paths.m_sample[i]];
+
+		// lights don't reflect: the path ends at the light
+		if (materials.is_emissive(hit.m_material)) {
+			if (hit.m_front_face) {
+				color += attenuation * materials.emission(hit.m_material) * emission_weight(scene, ray, hit, m_paths.m_bsdf_pdf[i]);
+			}
+			RTIOW_STATS(add_path(uint32_t(bounce)));
+			continue;
+		}
+
+		sampler.start_bounce(bounce);
+		scatter(ray, hit, attenuation, sampler, scene, config.m_light_sampling, color, m_paths.m_bsdf_pdf[i]);
+
+		if (!russian_roulette(bounce, config, attenuation, sampler)) {
+			if (bounce + 1 >= config.m_max_ray_bounces) {
+				RTIOW_STATS(m_paths_max_bounces++);
+			}
+			RTIOW_STATS(add_path(uint32_t(bounce + 1)));
+			continue;
+		}
+
+		m_paths.set_ray(i, ray);
+		m_paths.set_attenuation(i, attenuation);
+		m_alive[i] = 1;
+	}
+}
+
+void WavefrontBatch::compact() {
+
+	// the surviving paths move to the front, in material order
+	m_next.resize(m_order.size());
+	size_t count = 0;
+
+	for (auto i : m_order) {
+		if (!m_alive[i]) {
+			continue;
+		}
+
+		for (int axis = 0; axis < 3; ++axis) {
+			m_next.m_origin[axis][count] = m_paths.m_origin[axis][i];
+			m_next.m_direction[axis][count] = m_paths.m_direction[axis][i];
+			m_next.m_attenuation[axis][count] = m_paths.m_attenuation[axis][i];
+		}
+		m_next.m_bsdf_pdf[count] = m_paths.m_bsdf_pdf[i];
+		m_next.m_sampler[count] = m_paths.m_sampler[i];
+		m_next.m_sample[count] = m_paths.m_sample[i];
+		++count;
+	}
+
+	std::swap(m_paths, m_next);
+	m_num_paths = count;
+}
+
+} // namespace rtiow
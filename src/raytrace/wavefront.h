@@ -0,0 +1,99 @@
+// raytrace/wavefront.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// wavefront (stream) integrator: traces a large batch of paths together, one bounce at a time
+//	Instead of following one path from start to finish (ray_color), every bounce of the batch goes through a number of
+//	stages that are each a simple loop over all live paths: generate the camera rays, find the closest hits, sort the
+//	hits by material, shade (scatter) them and compact the surviving paths. The path state is kept as structure of
+//	arrays. Each path keeps its own sampler and the shading code is shared with ray_color, the image is
+//	exactly the same as with the default integrator.
+
+#pragma once
+
+#include "config.h"
+#include "geometry_base.h"
+#include "sampler.h"
+
+#include <vector>
+
+namespace rtiow {
+
+class Scene;
+
+// time spent in each stage (summed over all threads)
+struct WavefrontTimings {
+	uint64_t	m_generate_ns = 0;
+	uint64_t	m_intersect_ns = 0;
+	uint64_t	m_sort_ns = 0;
+	uint64_t	m_shade_ns = 0;
+	uint64_t	m_compact_ns = 0;
+	uint64_t	m_batches = 0;
+	uint64_t	m_paths = 0;
+
+	void clear() {*this = WavefrontTimings{};}
+	void merge(const WavefrontTimings &other);
+	void print() const;
+};
+
+class WavefrontBatch {
+public:
+	// construction
+	WavefrontBatch() = default;
+	WavefrontBatch(const WavefrontBatch &) = delete;
+	WavefrontBatch &operator=(const WavefrontBatch &) = delete;
+
+	// batch setup: the paths start with the camera ray of a sample of a pixel
+	void reset(uint32_t capacity);
+	bool empty() const {return m_samples.empty();}
+	bool full() const {return m_samples.size() >= m_capacity;}
+	size_t size() const {return m_samples.size();}
+	void add_sample(uint32_t x, uint32_t y, uint32_t sample) {m_samples.push_back({x, y, sample});}
+
+	// trace all paths of the batch to completion, afterwards color(i) is the result of the i-th sample that was added
+	void trace(const Scene &scene, const RayTracerConfig &config, uint64_t frame_index, WavefrontTimings &timings);
+	const color_t &color(size_t index) const {return m_color[index];}
+
+private:
+	struct Sample {
+		uint32_t	m_x;
+		uint32_t	m_y;
+		uint32_t	m_sample;
+	};
+
+	// state of the live paths (structure of arrays)
+	struct Paths {
+		std::vector<float>				m_origin[3];
+		std::vector<float>				m_direction[3];
+		std::vector<float>				m_attenuation[3];
+		std::vector<float>				m_bsdf_pdf;			// density of the direction of a ray sampled at a diffuse hit (MIS)
+		std::vector<Sampler>			m_sampler;
+		std::vector<uint32_t>			m_sample;			// index of the sample the path belongs to
+
+		void resize(size_t size);
+		Ray ray(size_t i) const;
+		void set_ray(size_t i, const Ray &ray);
+		color_t attenuation(size_t i) const;
+		void set_attenuation(size_t i, const color_t &attenuation);
+	};
+
+	void generate(const Scene &scene, const RayTracerConfig &config, uint64_t frame_index);
+	void intersect(const Scene &scene, bool primary, bool packets);
+	void sort_by_material(size_t num_materials);
+	void shade(const Scene &scene, const RayTracerConfig &config, int32_t bounce);
+	void compact();
+
+private:
+	uint32_t				m_capacity = 0;
+	std::vector<Sample>		m_samples;
+	std::vector<color_t>	m_color;			// result per sample
+
+	Paths					m_paths;			// live paths of the current bounce
+	Paths					m_next;				// compaction target
+	size_t					m_num_paths = 0;
+
+	std::vector<HitRecord>	m_hits;				// closest hit for each live path
+	std::vector<uint32_t>	m_order;			// paths that hit something, sorted by material
+	std::vector<uint32_t>	m_material_start;	// counting sort: first entry in m_order of each material
+	std::vector<uint8_t>	m_alive;			// path continues after the current bounce
+};
+
+} // namespace rtiow
@@ -0,0 +1,142 @@
+// raytrace/work_stealing_deque.h - Johan Smet - BSD-3-Clause (see LICENSE)
+//
+// Chase-Lev work-stealing deque (memory orderings as described by Lê, Pop, Cohen and Zappa Nardelli in
+// "Correct and Efficient Work-Stealing for Weak Memory Models").
+//	The owning thread pushes and pops at the bottom, any other thread can steal from the top.
+
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <cassert>
+#include <type_traits>
+#include <vector>
+
+namespace rtiow {
+
+template <typename T>
+class WorkStealingDeque {
+	static_assert(std::is_pointer_v<T>, "WorkStealingDeque only stores pointers");
+
+private:
+	class RingBuffer {
+	public:
+		explicit RingBuffer(int64_t capacity) :
+			m_capacity(capacity),
+			m_mask(capacity - 1),
+			m_data(std::make_unique<std::atomic<T>[]>(size_t(capacity))) {
+			assert((capacity & (capacity - 1)) == 0);
+		}
+
+		int64_t capacity() const {return m_capacity;}
+
+		void put(int64_t index, T value) {
+			m_data[size_t(index & m_mask)].store(value, std::memory_order_relaxed);
+		}
+
+		T get(int64_t index) const {
+			return m_data[size_t(index & m_mask)].load(std::memory_order_relaxed);
+		}
+
+		std::unique_ptr<RingBuffer> grow(int64_t top, int64_t bottom) const {
+			auto result = std::make_unique<RingBuffer>(2 * m_capacity);
+			for (auto i = top; i < bottom; ++i) {
+				result->put(i, get(i));
+			}
+			return result;
+		}
+
+	private:
+		int64_t							m_capacity;
+		int64_t							m_mask;
+		std::unique_ptr<std::atomic<T>[]>	m_data;
+	};
+
+public:
+	// construction
+	explicit WorkStealingDeque(int64_t initial_capacity = 256) {
+		m_buffers.push_back(std::make_unique<RingBuffer>(initial_capacity));
+		m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+	}
+
+	WorkStealingDeque(const WorkStealingDeque &) = delete;
+	WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+	// owner interface
+	void push(T value) {
+		auto bottom = m_bottom.load(std::memory_order_relaxed);
+		auto top = m_top.load(std::memory_order_acquire);
+		auto *buffer = m_buffer.load(std::memory_order_relaxed);
+
+		if (bottom - top > buffer->capacity() - 1) {
+			// full: switch to a larger buffer, the old one is kept alive because thieves might still be reading it
+			m_buffers.push_back(buffer->grow(top, bottom));
+			buffer = m_buffers.back().get();
+			m_buffer.store(buffer, std::memory_order_relaxed);
+		}
+
+		buffer->put(bottom, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	T pop() {
+		auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		auto *buffer = m_buffer.load(std::memory_order_relaxed);
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom) {
+			// empty
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		auto result = buffer->get(bottom);
+
+		if (top == bottom) {
+			// last element: race against thieves
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				result = nullptr;
+			}
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return result;
+	}
+
+	// thief interface (returns nullptr when empty or when losing a race with another thread)
+	T steal() {
+		auto top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto bottom = m_bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom) {
+			return nullptr;
+		}
+
+		auto *buffer = m_buffer.load(std::memory_order_acquire);
+		auto result = buffer->get(top);
+
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+
+		return result;
+	}
+
+	// information (only an estimate when other threads are active)
+	bool empty() const {
+		return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+	}
+
+private:
+	alignas(64) std::atomic<int64_t>	m_top = 0;
+	alignas(64) std::atomic<int64_t>	m_bottom = 0;
+	std::atomic<RingBuffer *>			m_buffer;
+	std::vector<std::unique_ptr<RingBuffer>> m_buffers;		// owned by the owning thread
+};
+
+} // namespace rtiow